@@ -0,0 +1,125 @@
+// Encode scaling over pool sizes (the encodeThreads option): one synthetic
+// 3840x2160 frame, cut into TightPNG tiles as the server does, encoded on
+// a ThreadPool of each size. Output must not depend on the size.
+//
+//   VNC_BUILD_BENCH=1 npx node-gyp rebuild
+//   build/Release/encode_bench [-q quality] [-c compress] [-n runs]
+//                              [threads ...]
+//
+// Without thread counts it runs 1, 2, 4, ... up to the hardware threads.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../native/rfb.h"
+#include "../native/thread_pool.h"
+#include "../native/tight_encoder.h"
+
+const int FRAME_W = 3840;
+const int FRAME_H = 2160;
+// As in vnc_server.cc
+const int ENCODE_TILE_W = 512;
+const int ENCODE_TILE_H = 256;
+
+// Left half flat UI (stripes, panels, text-like specks), right half a
+// noisy gradient standing in for photos and video
+static void FillFrame(std::vector<uint8_t> &fb) {
+  fb.resize((size_t)FRAME_W * FRAME_H * 4);
+  uint32_t seed = 1;
+  for (int y = 0; y < FRAME_H; y++) {
+    for (int x = 0; x < FRAME_W; x++) {
+      uint8_t *p = &fb[((size_t)y * FRAME_W + x) * 4];
+      seed = seed * 1103515245 + 12345;
+      uint8_t noise = (seed >> 16) & 15;
+      if (x < FRAME_W / 2) {
+        bool stripe = (x / 40) % 2 != 0;
+        bool speck = (y % 24) < 12 && ((x * 7 + y * 3) % 11) == 0;
+        p[0] = speck ? 0 : stripe ? 240 : 20;
+        p[1] = speck ? 0 : 200;
+        p[2] = speck ? 0 : 30;
+      } else {
+        p[0] = (uint8_t)(x * y / 64 + noise);
+        p[1] = (uint8_t)((x + y) / 8 + noise);
+        p[2] = (uint8_t)(y * 3 / 8);
+      }
+      p[3] = 255;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int quality = 5;
+  int compress = 1;
+  int runs = 10;
+  std::vector<int> threadCounts;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-q") && i + 1 < argc)
+      quality = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+      compress = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+      runs = std::max(1, atoi(argv[++i]));
+    else if (atoi(argv[i]) > 0)
+      threadCounts.push_back(atoi(argv[i]));
+  }
+  if (threadCounts.empty()) {
+    int hardware = (int)std::max(1u, std::thread::hardware_concurrency());
+    for (int t = 1; t < hardware; t *= 2)
+      threadCounts.push_back(t);
+    threadCounts.push_back(hardware);
+  }
+
+  std::vector<uint8_t> fb;
+  FillFrame(fb);
+  std::vector<Rect> tiles;
+  SplitIntoTiles(Rect{0, 0, FRAME_W, FRAME_H}, ENCODE_TILE_W, ENCODE_TILE_H,
+                 tiles);
+  printf("%dx%d, %zu tiles, quality %d, compress %d, best of %d runs\n",
+         FRAME_W, FRAME_H, tiles.size(), quality, compress, runs);
+  printf("threads       ms  speedup  Mpixel/s      bytes\n");
+
+  std::vector<std::vector<uint8_t>> reference;
+  double baseMs = 0;
+  bool identical = true;
+  for (int threads : threadCounts) {
+    ThreadPool pool;
+    pool.Start(threads);
+    std::vector<std::vector<uint8_t>> out(tiles.size());
+    double bestMs = 1e9;
+    for (int run = 0; run < runs; run++) {
+      for (auto &o : out)
+        o.clear();
+      auto started = std::chrono::steady_clock::now();
+      pool.ParallelFor((int)tiles.size(), [&](int i) {
+        EncodeTightPngRect(fb.data(), FRAME_W, tiles[i], quality, compress,
+                           0, nullptr, out[i]);
+      });
+      bestMs = std::min(bestMs,
+                        std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - started)
+                            .count());
+    }
+    size_t bytes = 0;
+    for (const auto &o : out)
+      bytes += o.size();
+    if (reference.empty()) {
+      reference = out;
+      baseMs = bestMs;
+    } else if (out != reference) {
+      identical = false;
+    }
+    printf("%7d %8.1f %7.2fx %9.1f %10zu\n", pool.Size(), bestMs,
+           baseMs / bestMs, (double)FRAME_W * FRAME_H / bestMs / 1000, bytes);
+  }
+  if (!identical) {
+    printf("output differs between pool sizes\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Update rate over an emulated slow link: netem on loopback, then
+# bench/update_rate.js with FramebufferUpdateRequests and with continuous
+# updates plus fences. Needs root (tc), the built addon and a screen that
+# keeps changing.
+#
+#   sudo bench/netem.sh [delay-ms] [rate] [seconds]     e.g. 40 20mbit 10
+#
+# The delay applies in both directions on loopback: the round trip is
+# twice it. The qdisc is removed again on exit.
+set -e
+DELAY_MS=${1:-40}
+RATE=${2:-20mbit}
+SECONDS_RUN=${3:-10}
+DIR=$(dirname "$0")
+
+cleanup() {
+  tc qdisc del dev lo root 2>/dev/null || true
+}
+trap cleanup EXIT INT TERM
+
+echo "without netem"
+node "$DIR/update_rate.js" --seconds "$SECONDS_RUN"
+
+# A deep queue: the rate limit should delay packets, not drop them
+tc qdisc replace dev lo root netem delay "${DELAY_MS}ms" rate "$RATE" \
+  limit 100000
+echo "netem: ${DELAY_MS} ms each way, $RATE"
+node "$DIR/update_rate.js" --seconds "$SECONDS_RUN"
@@ -0,0 +1,86 @@
+// Updates per second one viewer gets, asking for each update with a
+// FramebufferUpdateRequest (one round trip per update) and with continuous
+// updates paced by fences. Only a changing screen produces updates, so
+// play a video or similar meanwhile. bench/netem.sh runs it over an
+// emulated slow link.
+//
+//   node bench/update_rate.js [--seconds 10] [--port 5900] [--connect]
+//
+// Without --connect it starts a server on the port itself.
+const { RfbClient, ENCODING_TIGHT_PNG, ENCODING_QUALITY_LEVEL_0,
+    ENCODING_COMPRESS_LEVEL_0, ENCODING_LAST_RECT, ENCODING_FENCE,
+    ENCODING_CONTINUOUS_UPDATES } = require('../test/rfb_client');
+
+const args = process.argv.slice(2);
+const option = (name, fallback) => {
+    const i = args.indexOf(name);
+    return i >= 0 && i + 1 < args.length ? Number(args[i + 1]) : fallback;
+};
+const PORT = option('--port', 5900);
+const SECONDS = option('--seconds', 10);
+const WARMUP_MS = 1000;
+
+const ENCODINGS = [
+    ENCODING_TIGHT_PNG,
+    ENCODING_QUALITY_LEVEL_0 + 5,
+    ENCODING_COMPRESS_LEVEL_0 + 1,
+    ENCODING_LAST_RECT,
+];
+
+async function measure(continuous) {
+    const client = await RfbClient.connect(PORT);
+    client.on('error', (error) => {
+        console.error(error.message);
+        process.exit(1);
+    });
+    client.setEncodings(continuous
+        ? [...ENCODINGS, ENCODING_FENCE, ENCODING_CONTINUOUS_UPDATES]
+        : ENCODINGS);
+
+    let counting = false;
+    let updates = 0;
+    let bytes = 0;
+    let last = client.socket.bytesRead;
+    client.on('update', () => {
+        if (counting) {
+            updates++;
+            bytes += client.socket.bytesRead - last;
+        }
+        last = client.socket.bytesRead;
+        if (!continuous) client.requestUpdate(true);
+    });
+    if (continuous) {
+        // The server announces the extension; then updates flow on their own
+        client.once('end-of-continuous-updates', () =>
+            client.enableContinuousUpdates(true));
+    }
+    client.requestUpdate(false);
+
+    await new Promise((resolve) => setTimeout(resolve, WARMUP_MS));
+    counting = true;
+    const fences = client.fences;
+    await new Promise((resolve) => setTimeout(resolve, SECONDS * 1000));
+    client.close();
+    return {
+        mode: continuous ? 'continuous + fence' : 'request/response',
+        updatesPerSecond: +(updates / SECONDS).toFixed(1),
+        kbPerSecond: +(bytes / 1024 / SECONDS).toFixed(1),
+        fences: client.fences - fences,
+    };
+}
+
+async function main() {
+    let server = null;
+    if (!args.includes('--connect')) {
+        const { VncServer } = require('bindings')('vnc_server');
+        server = new VncServer({ port: PORT });
+        server.start();
+        await new Promise((resolve) => setTimeout(resolve, 200));
+    }
+    const results = [await measure(false), await measure(true)];
+    console.table(results);
+    if (server) server.stop();
+    process.exit(0);
+}
+
+main();
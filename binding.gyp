@@ -1,11 +1,50 @@
 {
+  "variables": {
+    # libjpeg-turbo install prefix on Windows (include/ + lib/jpeg.lib),
+    # e.g. a vcpkg x64-windows-static tree
+    "jpeg_root%": "<!(node -p \"process.env.LIBJPEG_TURBO_ROOT || 'C:/libjpeg-turbo64'\")",
+    # Optional software H.264 (encoding 50): VNC_WITH_OPENH264=1 npm install.
+    # OPENH264_ROOT is the install prefix on Windows.
+    "with_openh264%": "<!(node -p \"process.env.VNC_WITH_OPENH264 === '1' ? 1 : 0\")",
+    "openh264_root%": "<!(node -p \"process.env.OPENH264_ROOT || 'C:/openh264'\")",
+    # Benchmarks (bench/): VNC_BUILD_BENCH=1 npx node-gyp rebuild. Outside
+    # node they need zlib themselves; ZLIB_ROOT is its prefix on Windows.
+    "with_bench%": "<!(node -p \"process.env.VNC_BUILD_BENCH === '1' ? 1 : 0\")",
+    "zlib_root%": "<!(node -p \"process.env.ZLIB_ROOT || 'C:/zlib'\")"
+  },
   "targets": [
     {
       "target_name": "vnc_server",
       "cflags!": [ "-fno-exceptions" ],
       "cflags_cc!": [ "-fno-exceptions" ],
       "sources": [
-        "native/vnc_server.cc"
+        "native/vnc_server.cc",
+        "native/content_cache.cc",
+        "native/content_classifier.cc",
+        "native/cursor.cc",
+        "native/damage_history.cc",
+        "native/downscale.cc",
+        "native/encode_cache.cc",
+        "native/fence_throttle.cc",
+        "native/frame_diff.cc",
+        "native/frame_pacer.cc",
+        "native/h264_encoder.cc",
+        "native/input_injector.cc",
+        "native/input_sink.cc",
+        "native/jpeg_encoder.cc",
+        "native/keyframe_cache.cc",
+        "native/keysym.cc",
+        "native/motion_detector.cc",
+        "native/png_encoder.cc",
+        "native/quality_controller.cc",
+        "native/rect_scheduler.cc",
+        "native/refinement_tracker.cc",
+        "native/roi_tracker.cc",
+        "native/rre_encoder.cc",
+        "native/solid_regions.cc",
+        "native/thread_pool.cc",
+        "native/tight_encoder.cc",
+        "native/tile_hasher.cc"
       ],
       "include_dirs": [
         "node_modules/node-addon-api"
@@ -13,18 +52,91 @@
       "defines": [ "NAPI_DISABLE_CPP_EXCEPTIONS" ],
       "conditions": [
         ['OS=="win"', {
-          "libraries": [ 
-            "-ld3d11.lib", 
-            "-ldxgi.lib", 
-            "-luser32.lib" 
+          "sources": [
+            "native/dxgi_capture.cc",
+            "native/sendinput_sink.cc"
+          ],
+          "include_dirs": [
+            "<(jpeg_root)/include"
+          ],
+          "libraries": [
+            "-ld3d11.lib",
+            "-ldxgi.lib",
+            "-luser32.lib",
+            "<(jpeg_root)/lib/jpeg.lib"
           ],
           "msvs_settings": {
             "VCCLCompilerTool": {
               "ExceptionHandling": 1
             }
           }
+        }, {
+          "libraries": [
+            "-ljpeg"
+          ]
+        }],
+        ['OS=="linux"', {
+          "sources": [
+            "native/uinput_sink.cc",
+            "native/x11_capture.cc",
+            "native/xtest_sink.cc"
+          ],
+          "libraries": [
+            "-ldl",
+            "-lX11",
+            "-lXext",
+            "-lXfixes"
+          ]
+        }],
+        ['with_openh264==1', {
+          "defines": [ "VNC_WITH_OPENH264" ],
+          "conditions": [
+            ['OS=="win"', {
+              "include_dirs": [ "<(openh264_root)/include" ],
+              "libraries": [ "<(openh264_root)/lib/openh264.lib" ]
+            }, {
+              "libraries": [ "-lopenh264" ]
+            }]
+          ]
         }]
       ]
     }
+  ],
+  "conditions": [
+    ['with_bench==1', {
+      "targets": [
+        {
+          # TightPNG encode time over ThreadPool sizes (encodeThreads)
+          "target_name": "encode_bench",
+          "type": "executable",
+          "sources": [
+            "bench/encode_threads.cc",
+            "native/content_classifier.cc",
+            "native/jpeg_encoder.cc",
+            "native/png_encoder.cc",
+            "native/solid_regions.cc",
+            "native/thread_pool.cc",
+            "native/tight_encoder.cc"
+          ],
+          "conditions": [
+            ['OS=="win"', {
+              "include_dirs": [
+                "<(jpeg_root)/include",
+                "<(zlib_root)/include"
+              ],
+              "libraries": [
+                "<(jpeg_root)/lib/jpeg.lib",
+                "<(zlib_root)/lib/zlib.lib"
+              ]
+            }, {
+              "libraries": [
+                "-ljpeg",
+                "-lz"
+              ]
+            }]
+          ]
+        }
+      ]
+    }]
   ]
 }
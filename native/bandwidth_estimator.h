@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+// Per-client link throughput from FramebufferUpdate turnaround. The time
+// from sending an update until the client asks for the next one is a fixed
+// part (RTT + client processing) plus the transfer itself; the smallest
+// turnaround seen stands in for the fixed part, so
+// bytes / (turnaround - minTurnaround) estimates the link rate.
+class BandwidthEstimator {
+public:
+  void UpdateSent(size_t bytes) {
+    pendingBytes = bytes;
+    sentAt = std::chrono::steady_clock::now();
+  }
+
+  // True when the request answered an update, i.e. a turnaround was taken
+  bool RequestReceived() {
+    if (pendingBytes == 0)
+      return false;
+    double turnaround = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - sentAt)
+                            .count();
+    lastTurnaround = turnaround;
+    minTurnaround = std::min(minTurnaround, turnaround);
+    double transfer = turnaround - minTurnaround;
+    // Only updates that measurably occupied the link say anything about it
+    if (transfer > 0.002 && pendingBytes >= 4096) {
+      double sample = pendingBytes / transfer;
+      bytesPerSecond =
+          bytesPerSecond > 0 ? bytesPerSecond * 0.8 + sample * 0.2 : sample;
+    }
+    pendingBytes = 0;
+    return true;
+  }
+
+  // 0 until the first usable sample
+  double BytesPerSecond() const { return bytesPerSecond; }
+
+  // Seconds from the last update to the request that followed it, and the
+  // smallest such gap (round trip plus client processing)
+  double LastTurnaround() const { return lastTurnaround; }
+  double MinTurnaround() const {
+    return minTurnaround < 1e9 ? minTurnaround : 0;
+  }
+
+private:
+  size_t pendingBytes = 0;
+  std::chrono::steady_clock::time_point sentAt;
+  double lastTurnaround = 0;
+  double minTurnaround = 1e9;
+  double bytesPerSecond = 0;
+};
@@ -0,0 +1,69 @@
+#include "content_cache.h"
+
+// Bookkeeping per entry on top of the encoded bytes (list node, map node,
+// shared_ptr control block)
+const size_t CONTENT_ENTRY_OVERHEAD = 160;
+
+static size_t EntrySize(const EncodedRectsPtr &value) {
+  return value->bytes.size() + CONTENT_ENTRY_OVERHEAD;
+}
+
+bool ContentKey::operator<(const ContentKey &o) const {
+  if (hash != o.hash)
+    return hash < o.hash;
+  return settings < o.settings;
+}
+
+void ContentCache::SetBudget(size_t newBudget) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->budget = newBudget;
+  Evict();
+}
+
+EncodedRectsPtr ContentCache::Find(const ContentKey &key) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto it = this->index.find(key);
+  if (it == this->index.end()) {
+    this->misses++;
+    return nullptr;
+  }
+  this->lru.splice(this->lru.begin(), this->lru, it->second);
+  this->hits++;
+  return it->second->value;
+}
+
+void ContentCache::Insert(const ContentKey &key, EncodedRectsPtr value) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (EntrySize(value) > this->budget)
+    return;
+  auto it = this->index.find(key);
+  if (it != this->index.end()) {
+    // Another client encoded the same content meanwhile
+    this->lru.splice(this->lru.begin(), this->lru, it->second);
+    return;
+  }
+  this->lru.push_front({key, value});
+  this->index[key] = this->lru.begin();
+  this->bytes += EntrySize(value);
+  Evict();
+}
+
+size_t ContentCache::Bytes() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->bytes;
+}
+
+size_t ContentCache::Entries() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->index.size();
+}
+
+// Caller holds the mutex
+void ContentCache::Evict() {
+  while (this->bytes > this->budget && !this->lru.empty()) {
+    const Entry &last = this->lru.back();
+    this->bytes -= EntrySize(last.value);
+    this->index.erase(last.key);
+    this->lru.pop_back();
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+
+#include "encode_cache.h"
+
+// --- Content-addressed tile cache ---
+//
+// UI content comes back: a toolbar repaints unchanged, the user flips
+// between two windows or two slides. EncodeCache only shares one frame's
+// work; this keeps encoded tiles across frames, keyed by a hash of their
+// pixels plus the settings, so a repeat costs a hash and a lookup. Entries
+// stay tied to their rect (the bytes carry rect headers), which is where
+// repeated UI content reappears anyway. Least recently used entries are
+// evicted to stay within the byte budget.
+
+struct ContentKey {
+  uint64_t hash;
+  EncodeKey settings; // frame unused (0)
+
+  bool operator<(const ContentKey &o) const;
+};
+
+class ContentCache {
+public:
+  // 0 disables the cache
+  void SetBudget(size_t bytes);
+  bool Enabled() const { return budget > 0; }
+
+  // Null on a miss
+  EncodedRectsPtr Find(const ContentKey &key);
+  void Insert(const ContentKey &key, EncodedRectsPtr value);
+
+  uint64_t Hits() const { return hits; }
+  uint64_t Misses() const { return misses; }
+  size_t Bytes();
+  size_t Entries();
+  size_t Budget() const { return budget; }
+
+private:
+  struct Entry {
+    ContentKey key;
+    EncodedRectsPtr value;
+  };
+
+  void Evict();
+
+  std::mutex mutex;
+  std::atomic<size_t> budget{0};
+  size_t bytes = 0;
+  std::list<Entry> lru; // Most recently used first
+  std::map<ContentKey, std::list<Entry>::iterator> index;
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+};
@@ -0,0 +1,160 @@
+#include "content_classifier.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "simd.h"
+
+// A step above this (largest channel difference) is an edge: glyph
+// strokes, borders. Anything smaller but non-zero is shading or noise.
+const int CLASS_EDGE_STEP = 48;
+
+// Below this area JPEG headers cost more than they save
+const int CLASS_MIN_LOSSY_AREA = 64 * 64;
+// Sampled distinct colors below which content is synthetic
+const int CLASS_MIN_LOSSY_COLORS = 64;
+const int CLASS_COLOR_LIMIT = 128;
+// Share of smooth steps that marks a photo, and the most edges per smooth
+// step it may have (anti-aliased text has both, but far more edges)
+const float CLASS_PHOTO_SMOOTH = 0.25f;
+const float CLASS_PHOTO_EDGES_PER_SMOOTH = 0.5f;
+// Damaged in this many of the last 16 frames: video, encode it as such
+const int CLASS_VIDEO_CHANGES = 8;
+
+// --- Helpers ---
+
+// Distinct colors over a ~32x32 sample grid, counted up to `limit`
+static int CountColorsSampled(const uint8_t *fb, int fbW, const Rect &r,
+                              int limit) {
+  const uint32_t EMPTY = 0; // RGBA pixels always carry alpha 255
+  uint32_t table[256] = {0};
+  int count = 0;
+  int stepX = std::max(1, r.w / 32);
+  int stepY = std::max(1, r.h / 32);
+  const uint32_t *px = (const uint32_t *)fb;
+
+  for (int y = r.y; y < r.y + r.h; y += stepY) {
+    for (int x = r.x; x < r.x + r.w; x += stepX) {
+      uint32_t c = px[(size_t)y * fbW + x] | 0xFF000000;
+      uint32_t slot = (c * 2654435761u) >> 24;
+      while (table[slot] != EMPTY && table[slot] != c)
+        slot = (slot + 1) & 0xFF;
+      if (table[slot] == EMPTY) {
+        table[slot] = c;
+        if (++count >= limit)
+          return count;
+      }
+    }
+  }
+  return count;
+}
+
+static int PixelStep(const uint8_t *a, const uint8_t *b) {
+  int d = 0;
+  for (int c = 0; c < 3; c++)
+    d = std::max(d, std::abs((int)a[c] - (int)b[c]));
+  return d;
+}
+
+#ifdef VNC_HAVE_SSE2
+static const int BITS4[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+// Largest channel step of 4 pixel pairs, one per 32-bit lane
+static inline __m128i PixelStep4(__m128i a, __m128i b) {
+  __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+  d = _mm_max_epu8(d, _mm_srli_epi32(d, 8));
+  d = _mm_max_epu8(d, _mm_srli_epi32(d, 16));
+  return _mm_and_si128(d, _mm_set1_epi32(0xFF));
+}
+#endif
+
+// Counts non-zero and edge steps between pixels a[i] and b[i]
+static void CountSteps(const uint8_t *a, const uint8_t *b, int n, int &steps,
+                       int &edges) {
+  int i = 0;
+#ifdef VNC_HAVE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i edge = _mm_set1_epi32(CLASS_EDGE_STEP);
+  for (; i + 4 <= n; i += 4) {
+    __m128i d = PixelStep4(_mm_loadu_si128((const __m128i *)(a + i * 4)),
+                           _mm_loadu_si128((const __m128i *)(b + i * 4)));
+    steps += BITS4[_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(d, zero)))];
+    edges += BITS4[_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(d, edge)))];
+  }
+#endif
+  for (; i < n; i++) {
+    int d = PixelStep(a + i * 4, b + i * 4);
+    steps += d > 0;
+    edges += d > CLASS_EDGE_STEP;
+  }
+}
+
+// --- Classifier ---
+
+void MeasureTile(const uint8_t *fb, int fbW, const Rect &r,
+                 TileFeatures &features) {
+  features.colors = CountColorsSampled(fb, fbW, r, CLASS_COLOR_LIMIT);
+
+  // Horizontal and vertical neighbours on every other row
+  int steps = 0, edges = 0, pairs = 0;
+  const size_t stride = (size_t)fbW * 4;
+  for (int y = 0; y < r.h; y += 2) {
+    const uint8_t *row = fb + ((size_t)(r.y + y) * fbW + r.x) * 4;
+    CountSteps(row, row + 4, r.w - 1, steps, edges);
+    pairs += r.w - 1;
+    if (y + 1 < r.h) {
+      CountSteps(row, row + stride, r.w, steps, edges);
+      pairs += r.w;
+    }
+  }
+  features.edgeRatio = pairs > 0 ? (float)edges / pairs : 0;
+  features.smoothRatio = pairs > 0 ? (float)(steps - edges) / pairs : 0;
+}
+
+TileClass ClassifyTile(const Rect &r, const TileFeatures &f) {
+  if (r.w * r.h < CLASS_MIN_LOSSY_AREA || f.colors < CLASS_MIN_LOSSY_COLORS)
+    return TILE_LOSSLESS;
+  if (f.changes >= CLASS_VIDEO_CHANGES)
+    return TILE_LOSSY;
+  if (f.smoothRatio >= CLASS_PHOTO_SMOOTH &&
+      f.edgeRatio <= f.smoothRatio * CLASS_PHOTO_EDGES_PER_SMOOTH)
+    return TILE_LOSSY;
+  return TILE_LOSSLESS;
+}
+
+const char *TileClassName(TileClass tileClass) {
+  switch (tileClass) {
+  case TILE_SOLID:
+    return "solid";
+  case TILE_LOSSY:
+    return "lossy";
+  default:
+    return "lossless";
+  }
+}
+
+// --- Stats ---
+
+void ClassifierStats::Record(const Sample &sample) {
+  this->tiles[sample.tileClass]++;
+  this->bytes[sample.tileClass] += sample.bytes;
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->recent.size() < RECENT_SAMPLES)
+    this->recent.push_back(sample);
+  else
+    this->recent[this->nextSample] = sample;
+  this->nextSample = (this->nextSample + 1) % RECENT_SAMPLES;
+}
+
+std::vector<ClassifierStats::Sample> ClassifierStats::Recent() const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->recent.size() < RECENT_SAMPLES)
+    return this->recent;
+  // Oldest first
+  std::vector<Sample> out(this->recent.begin() + this->nextSample,
+                          this->recent.end());
+  out.insert(out.end(), this->recent.begin(),
+             this->recent.begin() + this->nextSample);
+  return out;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "rfb.h"
+
+// --- Content classifier ---
+//
+// Picks lossless (PNG) or lossy (JPEG) output per tile. Text and UI are
+// mostly flat runs broken by hard steps and few colors; photos and video
+// are mostly small non-zero steps across many colors. One SIMD pass over
+// the tile counts neighbour steps; the damage history adds how often the
+// tile changes, since anything refreshed every frame is video whatever it
+// looks like.
+
+enum TileClass { TILE_SOLID, TILE_LOSSLESS, TILE_LOSSY, TILE_CLASS_COUNT };
+
+struct TileFeatures {
+  int colors = 0;         // Distinct colors in a sample (capped)
+  float edgeRatio = 0;    // Neighbour pairs with a hard step
+  float smoothRatio = 0;  // Neighbour pairs with a small non-zero step
+  int changes = 0;        // Frames damaged out of the last 16
+};
+
+// Fills colors/edgeRatio/smoothRatio; `changes` comes from the caller
+void MeasureTile(const uint8_t *fb, int fbW, const Rect &r,
+                 TileFeatures &features);
+
+// Lossless vs lossy for a non-solid tile
+TileClass ClassifyTile(const Rect &r, const TileFeatures &features);
+
+const char *TileClassName(TileClass tileClass);
+
+// Counters per class plus the last few decisions, for tuning thresholds
+// against real workloads. Safe to update from the encode pool.
+class ClassifierStats {
+public:
+  struct Sample {
+    Rect rect;
+    TileFeatures features;
+    TileClass tileClass;
+    size_t bytes;
+  };
+
+  void Record(const Sample &sample);
+
+  uint64_t Tiles(TileClass c) const { return tiles[c]; }
+  uint64_t Bytes(TileClass c) const { return bytes[c]; }
+  std::vector<Sample> Recent() const;
+
+private:
+  static const size_t RECENT_SAMPLES = 64;
+
+  std::atomic<uint64_t> tiles[TILE_CLASS_COUNT] = {};
+  std::atomic<uint64_t> bytes[TILE_CLASS_COUNT] = {};
+  mutable std::mutex mutex;
+  std::vector<Sample> recent;
+  size_t nextSample = 0;
+};
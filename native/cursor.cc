@@ -0,0 +1,112 @@
+#include "cursor.h"
+
+#include "rfb.h"
+
+// Pixels at least this opaque are part of the cursor mask
+const uint8_t CURSOR_ALPHA_THRESHOLD = 128;
+
+// --- Helpers ---
+
+static bool MaskBit(const uint8_t *row, int x) {
+  return (row[x / 8] >> (7 - x % 8)) & 1;
+}
+
+static void SetPixel(CursorImage &out, int x, int y, uint8_t r, uint8_t g,
+                     uint8_t b, uint8_t a) {
+  uint8_t *p = &out.rgba[((size_t)y * out.width + x) * 4];
+  p[0] = r;
+  p[1] = g;
+  p[2] = b;
+  p[3] = a;
+}
+
+// Row-padded 1-bit mask, most significant bit first, as both pseudo-
+// encodings expect
+static void PutBitmap(std::vector<uint8_t> &buf, const CursorImage &shape,
+                      bool (*bit)(const uint8_t *pixel)) {
+  int rowBytes = (shape.width + 7) / 8;
+  for (int y = 0; y < shape.height; y++) {
+    size_t at = buf.size();
+    buf.resize(at + rowBytes, 0);
+    for (int x = 0; x < shape.width; x++)
+      if (bit(&shape.rgba[((size_t)y * shape.width + x) * 4]))
+        buf[at + x / 8] |= 0x80 >> (x % 8);
+  }
+}
+
+static bool Opaque(const uint8_t *p) { return p[3] >= CURSOR_ALPHA_THRESHOLD; }
+
+static bool Dark(const uint8_t *p) {
+  return p[0] * 299 + p[1] * 587 + p[2] * 114 < 128 * 1000;
+}
+
+// --- Conversion ---
+
+bool ConvertDxgiPointerShape(int type, int width, int height, int pitch,
+                             int hotX, int hotY, const uint8_t *data,
+                             CursorImage &out) {
+  // Monochrome shapes stack the AND mask on top of the XOR mask
+  if (type == DXGI_POINTER_MONOCHROME)
+    height /= 2;
+  if (width <= 0 || height <= 0)
+    return false;
+  out.width = width;
+  out.height = height;
+  out.hotX = hotX;
+  out.hotY = hotY;
+  out.rgba.assign((size_t)width * height * 4, 0);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      if (type == DXGI_POINTER_MONOCHROME) {
+        bool andBit = MaskBit(data + (size_t)y * pitch, x);
+        bool xorBit = MaskBit(data + (size_t)(y + height) * pitch, x);
+        if (!andBit)
+          SetPixel(out, x, y, xorBit ? 255 : 0, xorBit ? 255 : 0,
+                   xorBit ? 255 : 0, 255);
+        else if (xorBit) // Inverts the screen
+          SetPixel(out, x, y, 0, 0, 0, 255);
+        continue;
+      }
+      const uint8_t *p = data + (size_t)y * pitch + x * 4; // BGRA
+      if (type == DXGI_POINTER_COLOR) {
+        SetPixel(out, x, y, p[2], p[1], p[0], p[3]);
+      } else if (type == DXGI_POINTER_MASKED_COLOR) {
+        // Alpha 0: replace the screen; 0xFF: XOR with it (visible unless
+        // the color is 0)
+        bool visible = p[3] == 0 || (p[0] | p[1] | p[2]) != 0;
+        if (visible)
+          SetPixel(out, x, y, p[3] ? 0 : p[2], p[3] ? 0 : p[1],
+                   p[3] ? 0 : p[0], 255);
+      } else {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// --- Pseudo-rects ---
+
+void PutCursorRect(std::vector<uint8_t> &buf, const CursorImage &shape) {
+  PutRectHeader(buf, {shape.hotX, shape.hotY, shape.width, shape.height},
+                ENCODING_CURSOR);
+  buf.insert(buf.end(), shape.rgba.begin(), shape.rgba.end());
+  PutBitmap(buf, shape, Opaque);
+}
+
+void PutXCursorRect(std::vector<uint8_t> &buf, const CursorImage &shape) {
+  PutRectHeader(buf, {shape.hotX, shape.hotY, shape.width, shape.height},
+                ENCODING_XCURSOR);
+  if (shape.width == 0 || shape.height == 0)
+    return;
+  // Primary (bitmap 1) black, secondary white
+  const uint8_t colors[6] = {0, 0, 0, 255, 255, 255};
+  buf.insert(buf.end(), colors, colors + 6);
+  PutBitmap(buf, shape, Dark);
+  PutBitmap(buf, shape, Opaque);
+}
+
+void PutPointerPosRect(std::vector<uint8_t> &buf, int x, int y) {
+  PutRectHeader(buf, {x, y, 0, 0}, ENCODING_POINTER_POS);
+}
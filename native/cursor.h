@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// --- Pointer shape and position ---
+//
+// Neither DXGI duplication nor an X11 grab puts the pointer into the
+// captured pixels; both report it separately. It is forwarded as
+// pseudo-encodings so clients draw it locally: a move costs a few bytes
+// (or nothing) instead of repainting tiles.
+
+// Pointer image in the server pixel format (RGBA, straight alpha)
+struct CursorImage {
+  int width = 0; // 0 = hidden
+  int height = 0;
+  int hotX = 0;
+  int hotY = 0;
+  std::vector<uint8_t> rgba;
+};
+
+// Pointer as captured; serials tell clients what they have not seen yet
+struct CursorState {
+  CursorImage shape;
+  uint64_t shapeSerial = 0; // Bumped when the shape or visibility changes
+  int x = 0;                // Hotspot position
+  int y = 0;
+  uint64_t moveSerial = 0; // Bumped when the position changes
+};
+
+// DXGI_OUTDUPL_POINTER_SHAPE_TYPE values
+const int DXGI_POINTER_MONOCHROME = 1;
+const int DXGI_POINTER_COLOR = 2;
+const int DXGI_POINTER_MASKED_COLOR = 4;
+
+// Converts a GetFramePointerShape buffer (BGRA or 1-bit AND/XOR masks).
+// Screen-inverting pixels cannot be drawn by clients and become black.
+bool ConvertDxgiPointerShape(int type, int width, int height, int pitch,
+                             int hotX, int hotY, const uint8_t *data,
+                             CursorImage &out);
+
+// Cursor (-239): pixels in the server format plus a 1-bit mask
+void PutCursorRect(std::vector<uint8_t> &buf, const CursorImage &shape);
+
+// XCursor (-240): black and white with a 1-bit mask, for clients that only
+// take two-color cursors
+void PutXCursorRect(std::vector<uint8_t> &buf, const CursorImage &shape);
+
+// PointerPos (-232): the pointer moved on the server
+void PutPointerPosRect(std::vector<uint8_t> &buf, int x, int y);
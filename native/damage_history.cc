@@ -0,0 +1,80 @@
+#include "damage_history.h"
+
+#include <algorithm>
+
+void DamageHistory::Add(uint64_t frame, const std::vector<Rect> &rects) {
+  frames.push_back({frame, rects});
+  if (frames.size() > (size_t)MAX_FRAMES)
+    frames.pop_front();
+}
+
+bool DamageHistory::Covers(uint64_t since) const {
+  if (frames.empty())
+    return false;
+  // Frame numbers only advance on damage, so the history is contiguous
+  return since + 1 >= frames.front().frame;
+}
+
+bool DamageHistory::Since(uint64_t since, int fbW, int fbH,
+                          std::vector<Rect> &out) const {
+  if (!Covers(since))
+    return false;
+  std::vector<const Frame *> newer;
+  for (const auto &f : frames)
+    if (f.frame > since)
+      newer.push_back(&f);
+  if (newer.empty())
+    return true;
+  if (newer.size() == 1) {
+    out.insert(out.end(), newer[0]->rects.begin(), newer[0]->rects.end());
+    return true;
+  }
+
+  // Several frames: rasterize onto cells so repeated damage of the same
+  // area is sent once
+  int gridW = (fbW + CELL_SIZE - 1) / CELL_SIZE;
+  int gridH = (fbH + CELL_SIZE - 1) / CELL_SIZE;
+  std::vector<uint8_t> cells((size_t)gridW * gridH, 0);
+  for (const Frame *f : newer) {
+    for (const auto &d : f->rects) {
+      Rect r = ClipRect(d, fbW, fbH);
+      if (r.w <= 0 || r.h <= 0)
+        continue;
+      for (int cy = r.y / CELL_SIZE; cy <= (r.y + r.h - 1) / CELL_SIZE; cy++)
+        for (int cx = r.x / CELL_SIZE; cx <= (r.x + r.w - 1) / CELL_SIZE;
+             cx++)
+          cells[(size_t)cy * gridW + cx] = 1;
+    }
+  }
+
+  // Runs along each cell row, grown downwards while the next rows repeat
+  // the same run
+  for (int cy = 0; cy < gridH; cy++) {
+    for (int cx = 0; cx < gridW;) {
+      if (!cells[(size_t)cy * gridW + cx]) {
+        cx++;
+        continue;
+      }
+      int end = cx;
+      while (end < gridW && cells[(size_t)cy * gridW + end])
+        end++;
+      int bottom = cy + 1;
+      while (bottom < gridH) {
+        const uint8_t *row = &cells[(size_t)bottom * gridW];
+        bool same = std::all_of(row + cx, row + end,
+                                [](uint8_t c) { return c != 0; }) &&
+                    (cx == 0 || !row[cx - 1]) && (end == gridW || !row[end]);
+        if (!same)
+          break;
+        std::fill(&cells[(size_t)bottom * gridW + cx],
+                  &cells[(size_t)bottom * gridW + end], 0);
+        bottom++;
+      }
+      Rect r = {cx * CELL_SIZE, cy * CELL_SIZE, (end - cx) * CELL_SIZE,
+                (bottom - cy) * CELL_SIZE};
+      out.push_back(ClipRect(r, fbW, fbH));
+      cx = end;
+    }
+  }
+  return true;
+}
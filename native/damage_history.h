@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "rfb.h"
+
+// Damage of the recent frames. Clients skip frames (frame pacing, slow
+// links, a keyframe taken a few frames ago), so an update has to cover
+// everything that changed since the frame the client last got, not just
+// the newest frame's rects.
+class DamageHistory {
+public:
+  void Add(uint64_t frame, const std::vector<Rect> &rects);
+  void Clear() { frames.clear(); }
+
+  // True when the damage after `since` is still known
+  bool Covers(uint64_t since) const;
+  // Oldest such frame (0 while empty)
+  uint64_t Horizon() const {
+    return frames.empty() ? 0 : frames.front().frame - 1;
+  }
+
+  // Appends the damage of the frames after `since`, overlapping rects of
+  // different frames merged on a 16-pixel grid. False when the history no
+  // longer reaches back that far (send everything instead).
+  bool Since(uint64_t since, int fbW, int fbH, std::vector<Rect> &out) const;
+
+private:
+  static constexpr int MAX_FRAMES = 64;
+  static constexpr int CELL_SIZE = 16;
+
+  struct Frame {
+    uint64_t frame;
+    std::vector<Rect> rects;
+  };
+  std::deque<Frame> frames; // Oldest first
+};
@@ -0,0 +1,125 @@
+#include "downscale.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd.h"
+
+// 65536 / (factor * factor), rounded up: the block sum times this, high
+// 16 bits, is the mean without a division (factor 1 is a plain copy)
+static const uint16_t BLOCK_RECIPROCAL[MAX_SCALE_FACTOR + 1] = {0, 0, 16384,
+                                                               7282, 4096};
+
+int ScaleFactorFor(double scale) {
+  if (!(scale > 0) || scale >= 1)
+    return 1;
+  return std::min(MAX_SCALE_FACTOR, std::max(1, (int)std::lround(1 / scale)));
+}
+
+// --- Area filter ---
+
+void DownscaleRect(const uint8_t *src, int srcW, int factor,
+                   const Rect &dstRect, uint8_t *dst, int dstW) {
+  if (dstRect.w <= 0 || dstRect.h <= 0)
+    return;
+  if (factor == 1) {
+    for (int y = dstRect.y; y < dstRect.y + dstRect.h; y++)
+      memcpy(dst + ((size_t)y * dstW + dstRect.x) * 4,
+             src + ((size_t)y * srcW + dstRect.x) * 4, (size_t)dstRect.w * 4);
+    return;
+  }
+  int half = factor * factor / 2; // Rounds the mean to nearest
+  uint16_t reciprocal = BLOCK_RECIPROCAL[factor];
+  // Column sums of one block row: 4 channels per source pixel, at most
+  // 4 * 255 each
+  int sumLen = dstRect.w * factor * 4;
+  std::vector<uint16_t> sums(sumLen);
+
+  for (int y = 0; y < dstRect.h; y++) {
+    std::fill(sums.begin(), sums.end(), 0);
+    for (int k = 0; k < factor; k++) {
+      const uint8_t *row =
+          src + (((size_t)(dstRect.y + y) * factor + k) * srcW +
+                 (size_t)dstRect.x * factor) *
+                    4;
+      int i = 0;
+#ifdef VNC_HAVE_SSE2
+      __m128i zero = _mm_setzero_si128();
+      for (; i + 16 <= sumLen; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i *lo = (__m128i *)&sums[i];
+        __m128i *hi = (__m128i *)&sums[i + 8];
+        _mm_storeu_si128(lo, _mm_add_epi16(_mm_loadu_si128(lo),
+                                           _mm_unpacklo_epi8(bytes, zero)));
+        _mm_storeu_si128(hi, _mm_add_epi16(_mm_loadu_si128(hi),
+                                           _mm_unpackhi_epi8(bytes, zero)));
+      }
+#endif
+      for (; i < sumLen; i++)
+        sums[i] += row[i];
+    }
+
+    uint8_t *out = dst + ((size_t)(dstRect.y + y) * dstW + dstRect.x) * 4;
+#ifdef VNC_HAVE_SSE2
+    // One output pixel per step: its block's column sums are `factor`
+    // groups of 4 x u16, one 64-bit load each
+    __m128i rounding = _mm_set1_epi16((short)half);
+    __m128i scale = _mm_set1_epi16((short)reciprocal);
+    for (int x = 0; x < dstRect.w; x++) {
+      const uint16_t *block = &sums[x * factor * 4];
+      __m128i total = rounding;
+      for (int k = 0; k < factor; k++)
+        total = _mm_add_epi16(
+            total, _mm_loadl_epi64((const __m128i *)(block + k * 4)));
+      __m128i mean = _mm_mulhi_epu16(total, scale);
+      int pixel = _mm_cvtsi128_si32(_mm_packus_epi16(mean, mean));
+      memcpy(out + x * 4, &pixel, 4);
+    }
+#else
+    for (int x = 0; x < dstRect.w; x++) {
+      const uint16_t *block = &sums[x * factor * 4];
+      for (int c = 0; c < 4; c++) {
+        uint32_t total = half;
+        for (int k = 0; k < factor; k++)
+          total += block[k * 4 + c];
+        out[x * 4 + c] = (uint8_t)((total * reciprocal) >> 16);
+      }
+    }
+#endif
+  }
+}
+
+// --- Scaled framebuffer ---
+
+bool ScaledFramebuffer::Configure(int factor, int srcW, int srcH) {
+  factor = std::max(1, std::min(factor, MAX_SCALE_FACTOR));
+  int w = srcW / factor;
+  int h = srcH / factor;
+  if (factor == this->factor && srcW == this->srcW && w == width &&
+      h == height)
+    return false;
+  this->factor = factor;
+  this->srcW = srcW;
+  width = w;
+  height = h;
+  pixels.assign((size_t)w * h * 4, 0);
+  return true;
+}
+
+void ScaledFramebuffer::Update(const uint8_t *src, std::vector<Rect> &rects) {
+  std::vector<Rect> scaled;
+  for (const auto &r : rects) {
+    // Every output pixel the rect touches, however little
+    int x0 = std::max(0, r.x / factor);
+    int y0 = std::max(0, r.y / factor);
+    int x1 = std::min(width, (r.x + r.w + factor - 1) / factor);
+    int y1 = std::min(height, (r.y + r.h + factor - 1) / factor);
+    if (x1 <= x0 || y1 <= y0)
+      continue;
+    Rect s = {x0, y0, x1 - x0, y1 - y0};
+    DownscaleRect(src, srcW, factor, s, pixels.data(), width);
+    scaled.push_back(s);
+  }
+  rects.swap(scaled);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "rfb.h"
+
+// --- Server-side downscaling ---
+//
+// Viewers on small screens can take the framebuffer at 1/2, 1/3 or 1/4
+// size instead of scaling a full one down in the browser: a quarter or
+// less of the pixels to encode and send. Integer factors keep it an exact
+// area filter (each output pixel is the mean of a factor x factor block)
+// and damage maps onto whole output pixels.
+
+const int MAX_SCALE_FACTOR = 4;
+
+// Factor for a client asking for `scale` (1 = full size, 0.5 = half...)
+int ScaleFactorFor(double scale);
+
+// Fills `dstRect` (in scaled coordinates) of `dst`, dstW pixels wide, with
+// the means of the factor x factor blocks of `src` it covers
+void DownscaleRect(const uint8_t *src, int srcW, int factor,
+                   const Rect &dstRect, uint8_t *dst, int dstW);
+
+// One client's scaled copy of the framebuffer, refreshed where damaged.
+// Edge rows and columns that do not fill a whole block are left out.
+class ScaledFramebuffer {
+public:
+  // True when the buffer was (re)allocated and holds nothing valid yet
+  bool Configure(int factor, int srcW, int srcH);
+
+  int Factor() const { return factor; }
+  int Width() const { return width; }
+  int Height() const { return height; }
+  const std::vector<uint8_t> &Pixels() const { return pixels; }
+
+  // Maps `rects` from source to scaled coordinates, in place, and
+  // refreshes the pixels under them from `src`
+  void Update(const uint8_t *src, std::vector<Rect> &rects);
+
+private:
+  int factor = 1;
+  int srcW = 0;
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels;
+};
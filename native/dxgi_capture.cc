@@ -0,0 +1,241 @@
+#include "dxgi_capture.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include <windows.h>
+
+struct DxgiCapture::State {
+  ID3D11Device *device = nullptr;
+  ID3D11DeviceContext *context = nullptr;
+  IDXGIOutputDuplication *duplication = nullptr;
+  ID3D11Texture2D *staging = nullptr;
+};
+
+// --- Helpers ---
+
+// Adapter `index` of a fresh factory; null past the last one
+static IDXGIAdapter1 *OpenAdapter(int index) {
+  IDXGIFactory1 *factory = nullptr;
+  if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void **)&factory)))
+    return nullptr;
+  IDXGIAdapter1 *adapter = nullptr;
+  if (FAILED(factory->EnumAdapters1(index, &adapter)))
+    adapter = nullptr;
+  factory->Release();
+  return adapter;
+}
+
+// --- Capture ---
+
+DxgiCapture::~DxgiCapture() { Cleanup(); }
+
+std::vector<DxgiCapture::OutputId> DxgiCapture::ListOutputs() {
+  std::vector<OutputId> outputs;
+  for (int a = 0;; a++) {
+    IDXGIAdapter1 *adapter = OpenAdapter(a);
+    if (!adapter)
+      break;
+    IDXGIOutput *output = nullptr;
+    for (int o = 0; SUCCEEDED(adapter->EnumOutputs(o, &output)); o++) {
+      DXGI_OUTPUT_DESC desc;
+      if (SUCCEEDED(output->GetDesc(&desc)) && desc.AttachedToDesktop)
+        outputs.push_back({a, o,
+                           desc.DesktopCoordinates.left == 0 &&
+                               desc.DesktopCoordinates.top == 0});
+      output->Release();
+    }
+    adapter->Release();
+  }
+  return outputs;
+}
+
+bool DxgiCapture::Initialize(const OutputId &id) {
+  Cleanup();
+  IDXGIAdapter1 *adapter = OpenAdapter(id.adapter);
+  if (!adapter)
+    return false;
+  IDXGIOutput *output = nullptr;
+  HRESULT hr = adapter->EnumOutputs(id.output, &output);
+  if (FAILED(hr)) {
+    adapter->Release();
+    return false;
+  }
+  DXGI_OUTPUT_DESC outputDesc;
+  output->GetDesc(&outputDesc);
+  IDXGIOutput1 *output1 = nullptr;
+  hr = output->QueryInterface(__uuidof(IDXGIOutput1), (void **)&output1);
+  output->Release();
+  if (FAILED(hr)) {
+    adapter->Release();
+    return false;
+  }
+
+  state = new State();
+  // A device on the output's own adapter: duplication fails across GPUs
+  D3D_FEATURE_LEVEL featureLevels[] = {D3D_FEATURE_LEVEL_11_0};
+  D3D_FEATURE_LEVEL featureLevel;
+  hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr,
+                         D3D11_CREATE_DEVICE_BGRA_SUPPORT, featureLevels, 1,
+                         D3D11_SDK_VERSION, &state->device, &featureLevel,
+                         &state->context);
+  adapter->Release();
+  // Fails while a mode switch or secure desktop is in progress
+  if (SUCCEEDED(hr))
+    hr = output1->DuplicateOutput(state->device, &state->duplication);
+  output1->Release();
+  if (FAILED(hr)) {
+    state->duplication = nullptr;
+    Cleanup();
+    return false;
+  }
+
+  DXGI_OUTDUPL_DESC duplDesc;
+  state->duplication->GetDesc(&duplDesc);
+  left = outputDesc.DesktopCoordinates.left;
+  top = outputDesc.DesktopCoordinates.top;
+  width = duplDesc.ModeDesc.Width;
+  height = duplDesc.ModeDesc.Height;
+  return true;
+}
+
+void DxgiCapture::Cleanup() {
+  if (!state)
+    return;
+  if (state->staging)
+    state->staging->Release();
+  if (state->duplication)
+    state->duplication->Release();
+  if (state->context)
+    state->context->Release();
+  if (state->device)
+    state->device->Release();
+  delete state;
+  state = nullptr;
+}
+
+DxgiCapture::GrabResult DxgiCapture::Grab(uint8_t *rgba, size_t stride,
+                                          int timeoutMs,
+                                          std::vector<Rect> &dirtyRects,
+                                          bool &needsHash) {
+  if (!state)
+    return GRAB_LOST;
+
+  DXGI_OUTDUPL_FRAME_INFO frameInfo;
+  IDXGIResource *desktopResource = nullptr;
+  HRESULT hr = state->duplication->AcquireNextFrame(timeoutMs, &frameInfo,
+                                                    &desktopResource);
+  if (hr == DXGI_ERROR_ACCESS_LOST)
+    return GRAB_LOST;
+  if (FAILED(hr))
+    return GRAB_TIMEOUT;
+
+  // Get Dirty Rects from DXGI metadata
+  bool haveMetadata = false;
+  if (frameInfo.TotalMetadataBufferSize > 0) {
+    UINT bufSize = frameInfo.TotalMetadataBufferSize;
+    std::vector<BYTE> metaBuf(bufSize);
+    // Both calls report sizes in bytes. Dirty rects leave out the
+    // destinations of moved areas, which changed all the same.
+    UINT moveBytes = 0;
+    hr = state->duplication->GetFrameMoveRects(
+        bufSize, (DXGI_OUTDUPL_MOVE_RECT *)metaBuf.data(), &moveBytes);
+    if (FAILED(hr))
+      moveBytes = 0;
+    DXGI_OUTDUPL_MOVE_RECT *moves = (DXGI_OUTDUPL_MOVE_RECT *)metaBuf.data();
+    for (UINT i = 0; i < moveBytes / sizeof(DXGI_OUTDUPL_MOVE_RECT); i++) {
+      const RECT &d = moves[i].DestinationRect;
+      dirtyRects.push_back({(int)d.left, (int)d.top, (int)(d.right - d.left),
+                            (int)(d.bottom - d.top)});
+    }
+    UINT dirtyBytes = 0;
+    hr = state->duplication->GetFrameDirtyRects(
+        bufSize - moveBytes, (RECT *)(metaBuf.data() + moveBytes),
+        &dirtyBytes);
+    if (SUCCEEDED(hr)) {
+      haveMetadata = true;
+      RECT *rects = (RECT *)(metaBuf.data() + moveBytes);
+      for (UINT i = 0; i < dirtyBytes / sizeof(RECT); i++) {
+        dirtyRects.push_back({(int)rects[i].left, (int)rects[i].top,
+                              (int)(rects[i].right - rects[i].left),
+                              (int)(rects[i].bottom - rects[i].top)});
+      }
+    }
+  }
+
+  // Pointer: not part of the image. Shape only when it changed, position
+  // with every mouse update.
+  if (frameInfo.PointerShapeBufferSize > 0) {
+    std::vector<uint8_t> shapeBuf(frameInfo.PointerShapeBufferSize);
+    UINT shapeSize = 0;
+    DXGI_OUTDUPL_POINTER_SHAPE_INFO shapeInfo;
+    hr = state->duplication->GetFramePointerShape(
+        (UINT)shapeBuf.size(), shapeBuf.data(), &shapeSize, &shapeInfo);
+    if (SUCCEEDED(hr) &&
+        ConvertDxgiPointerShape(shapeInfo.Type, shapeInfo.Width,
+                                shapeInfo.Height, shapeInfo.Pitch,
+                                shapeInfo.HotSpot.x, shapeInfo.HotSpot.y,
+                                shapeBuf.data(), shape))
+      shapeChanged = true;
+  }
+  if (frameInfo.LastMouseUpdateTime.QuadPart != 0) {
+    pointerVisible = frameInfo.PointerPosition.Visible != 0;
+    pointerX = frameInfo.PointerPosition.Position.x;
+    pointerY = frameInfo.PointerPosition.Position.y;
+  }
+
+  // Pointer-only frames carry no new image
+  if (frameInfo.LastPresentTime.QuadPart == 0) {
+    desktopResource->Release();
+    state->duplication->ReleaseFrame();
+    return GRAB_FRAME;
+  }
+  // No metadata (first frame): the caller hashes the frame
+  needsHash = needsHash || !haveMetadata;
+
+  ID3D11Texture2D *desktopImage = nullptr;
+  desktopResource->QueryInterface(__uuidof(ID3D11Texture2D),
+                                  (void **)&desktopImage);
+  desktopResource->Release();
+
+  if (!state->staging) {
+    D3D11_TEXTURE2D_DESC desc;
+    desktopImage->GetDesc(&desc);
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    desc.BindFlags = 0;
+    desc.MiscFlags = 0;
+    state->device->CreateTexture2D(&desc, nullptr, &state->staging);
+  }
+
+  state->context->CopyResource(state->staging, desktopImage);
+  desktopImage->Release();
+
+  D3D11_MAPPED_SUBRESOURCE map;
+  if (SUCCEEDED(
+          state->context->Map(state->staging, 0, D3D11_MAP_READ, 0, &map))) {
+    // Convert BGRA -> RGBA; rows are padded for widths like 1366
+    for (int y = 0; y < height; y++) {
+      const uint8_t *src = (const uint8_t *)map.pData + (size_t)y * map.RowPitch;
+      uint8_t *out = rgba + y * stride;
+      for (int x = 0; x < width; x++) {
+        out[x * 4 + 0] = src[x * 4 + 2]; // R
+        out[x * 4 + 1] = src[x * 4 + 1]; // G
+        out[x * 4 + 2] = src[x * 4 + 0]; // B
+        out[x * 4 + 3] = 255;            // A
+      }
+    }
+    state->context->Unmap(state->staging, 0);
+  }
+
+  state->duplication->ReleaseFrame();
+  return GRAB_FRAME;
+}
+
+bool DxgiCapture::TakeShape(CursorImage &out) {
+  if (!shapeChanged)
+    return false;
+  out = shape;
+  shapeChanged = false;
+  return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cursor.h"
+#include "rfb.h"
+
+// Windows screen capture from one monitor via DXGI desktop duplication.
+// Each instance has its own D3D11 device: an immediate context is
+// single-threaded, and this way outputs can be grabbed in parallel. The
+// frame metadata gives damage per output. Windows headers stay in the .cc.
+class DxgiCapture {
+public:
+  // A monitor attached to the desktop
+  struct OutputId {
+    int adapter;
+    int output;
+    bool primary; // At the desktop origin
+  };
+
+  ~DxgiCapture();
+
+  // Attached outputs of all adapters, in enumeration order
+  static std::vector<OutputId> ListOutputs();
+
+  bool Initialize(const OutputId &id);
+  void Cleanup();
+
+  // Place on the Windows desktop; the primary monitor starts at 0,0
+  int Left() const { return left; }
+  int Top() const { return top; }
+  int Width() const { return width; }
+  int Height() const { return height; }
+
+  enum GrabResult { GRAB_TIMEOUT, GRAB_FRAME, GRAB_LOST };
+
+  // Waits up to `timeoutMs` for a frame. New pixels are copied into `rgba`
+  // (Height() rows `stride` bytes apart) and their damage, in output
+  // coordinates, appended to `dirtyRects`; `needsHash` is set when pixels
+  // came without metadata. GRAB_LOST after a mode or desktop switch:
+  // Initialize() again.
+  GrabResult Grab(uint8_t *rgba, size_t stride, int timeoutMs,
+                  std::vector<Rect> &dirtyRects, bool &needsHash);
+
+  // Pointer as of the last Grab. The shape is reported by whichever output
+  // the pointer is on when it changes; TakeShape() hands it over once.
+  bool TakeShape(CursorImage &shape);
+  bool PointerVisible() const { return pointerVisible; }
+  // Top-left corner of the shape, in output coordinates
+  int PointerX() const { return pointerX; }
+  int PointerY() const { return pointerY; }
+
+private:
+  struct State;
+  State *state = nullptr;
+  int left = 0;
+  int top = 0;
+  int width = 0;
+  int height = 0;
+
+  CursorImage shape;
+  bool shapeChanged = false;
+  bool pointerVisible = false;
+  int pointerX = 0;
+  int pointerY = 0;
+};
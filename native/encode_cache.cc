@@ -0,0 +1,44 @@
+#include "encode_cache.h"
+
+#include <tuple>
+
+bool EncodeKey::operator<(const EncodeKey &o) const {
+  return std::tie(frame, rect.x, rect.y, rect.w, rect.h, encoding,
+                  qualityLevel, compressLevel, solidEncoding, scale) <
+         std::tie(o.frame, o.rect.x, o.rect.y, o.rect.w, o.rect.h, o.encoding,
+                  o.qualityLevel, o.compressLevel, o.solidEncoding, o.scale);
+}
+
+EncodedRectsPtr
+EncodeCache::Get(const EncodeKey &key,
+                 const std::function<void(EncodedRects &)> &encode) {
+  std::shared_ptr<Slot> slot;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (key.frame > this->frame) {
+      this->frame = key.frame;
+      // Keys sort by frame first
+      while (!this->slots.empty() &&
+             this->slots.begin()->first.frame < key.frame)
+        this->slots.erase(this->slots.begin());
+    }
+    std::shared_ptr<Slot> &entry = this->slots[key];
+    if (!entry)
+      entry = std::make_shared<Slot>();
+    slot = entry;
+  }
+
+  // Encode outside the cache lock: other keys proceed in parallel
+  bool encoded = false;
+  std::call_once(slot->once, [&] {
+    auto value = std::make_shared<EncodedRects>();
+    encode(*value);
+    slot->value = value;
+    encoded = true;
+  });
+  if (encoded)
+    this->misses++;
+  else
+    this->hits++;
+  return slot->value;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "rfb.h"
+
+// --- Encode-once fan-out ---
+//
+// Every viewer of the same frame asks for the same rects with, usually, the
+// same settings. Stateless encodings (Raw, TightPNG) produce identical bytes
+// for identical input, so each (frame, rect, settings) is encoded once and
+// the result is shared read-only between clients. Stateful streams (H.264)
+// stay per client.
+
+// Ready-to-send rect data: one or more rects including their headers
+struct EncodedRects {
+  std::vector<uint8_t> bytes;
+  int count = 0;
+  bool lossy = false; // Some of it is JPEG
+};
+typedef std::shared_ptr<const EncodedRects> EncodedRectsPtr;
+
+// SetPixelFormat is not honoured, so every client receives the server pixel
+// format and it is implied by the frame. Settings an encoding ignores must
+// be normalized by the caller (e.g. quality for Raw) to share entries.
+struct EncodeKey {
+  uint64_t frame;
+  Rect rect;
+  int32_t encoding;
+  int qualityLevel;
+  int compressLevel;
+  int32_t solidEncoding; // How solid areas are sent, ENCODING_RAW = as is
+  int scale;             // Downscale factor of the pixels, 1 = full size
+
+  bool operator<(const EncodeKey &o) const;
+};
+
+class EncodeCache {
+public:
+  // Returns the cached result for `key`, calling `encode` to produce it on
+  // the first request. Concurrent requests for the same key wait for that
+  // single encode instead of repeating it. A newer frame drops older
+  // entries; buffers still being sent stay alive through their refcount.
+  EncodedRectsPtr Get(const EncodeKey &key,
+                      const std::function<void(EncodedRects &)> &encode);
+
+  uint64_t Hits() const { return hits; }
+  uint64_t Misses() const { return misses; }
+
+private:
+  struct Slot {
+    std::once_flag once;
+    EncodedRectsPtr value;
+  };
+
+  std::mutex mutex;
+  uint64_t frame = 0;
+  std::map<EncodeKey, std::shared_ptr<Slot>> slots;
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+};
@@ -0,0 +1,67 @@
+#include "fence_throttle.h"
+
+#include <algorithm>
+
+// Window before the first rate sample, and the smallest one after
+const size_t FENCE_INITIAL_WINDOW = 1024 * 1024;
+const size_t FENCE_MIN_WINDOW = 128 * 1024;
+// Queueing allowed on top of the round trip, so the link never idles
+// while a fence is on its way back
+const double FENCE_QUEUE_SECONDS = 0.05;
+// A fence unanswered this long means a stuck client, not a slow link;
+// stop holding updates back for it
+const double FENCE_TIMEOUT_SECONDS = 2.0;
+// Fences kept waiting for an answer. A client that never answers would
+// otherwise collect one per update; the oldest are given up on.
+const size_t FENCE_MAX_PENDING = 256;
+
+uint32_t FenceThrottle::Sent(size_t bytes) {
+  sentBytes += bytes;
+  uint32_t id = nextId++;
+  pending.push_back({id, sentBytes, std::chrono::steady_clock::now()});
+  if (pending.size() > FENCE_MAX_PENDING)
+    pending.pop_front();
+  return id;
+}
+
+bool FenceThrottle::Acknowledged(uint32_t id) {
+  auto it = std::find_if(pending.begin(), pending.end(),
+                         [id](const Pending &p) { return p.id == id; });
+  if (it == pending.end())
+    return false;
+
+  double turnaround = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - it->sentAt)
+                          .count();
+  lastTurnaround = turnaround;
+  minRtt = std::min(minRtt, turnaround);
+
+  // As with request turnarounds: the part above the round trip is the
+  // time the link spent delivering what was queued before the fence
+  uint64_t delivered = it->position - ackedBytes;
+  double transfer = turnaround - minRtt;
+  if (transfer > 0.002 && delivered >= 4096) {
+    double sample = delivered / transfer;
+    bytesPerSecond =
+        bytesPerSecond > 0 ? bytesPerSecond * 0.8 + sample * 0.2 : sample;
+  }
+  ackedBytes = it->position;
+  pending.erase(pending.begin(), it + 1);
+  return true;
+}
+
+size_t FenceThrottle::Window() const {
+  if (bytesPerSecond <= 0)
+    return FENCE_INITIAL_WINDOW;
+  return std::max(FENCE_MIN_WINDOW,
+                  (size_t)(bytesPerSecond * (MinRtt() + FENCE_QUEUE_SECONDS)));
+}
+
+bool FenceThrottle::CanSend() const {
+  if (pending.empty())
+    return true;
+  double oldest = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - pending.front().sentAt)
+                      .count();
+  return InFlight() < Window() || oldest > FENCE_TIMEOUT_SECONDS;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// Flow control for continuous updates. Without FramebufferUpdateRequests
+// nothing limits how far the server runs ahead of a slow client, so a
+// Fence goes out after every update; the client answers it once it has
+// processed everything before it. That gives the data still in flight,
+// the round trip and the delivery rate, and updates pause while more than
+// about one bandwidth-delay product is unacknowledged.
+class FenceThrottle {
+public:
+  // Records an update of `bytes` just sent; returns the id to put in the
+  // fence that follows it
+  uint32_t Sent(size_t bytes);
+
+  // The client answered fence `id`. False if it is not one of ours.
+  bool Acknowledged(uint32_t id);
+
+  bool CanSend() const;
+
+  size_t InFlight() const { return (size_t)(sentBytes - ackedBytes); }
+  size_t Window() const;
+
+  // Seconds from an update to its fence coming back, and the smallest such
+  // time (the round trip); 0 until the first answer
+  double LastTurnaround() const { return lastTurnaround; }
+  double MinRtt() const { return minRtt < 1e9 ? minRtt : 0; }
+  // 0 until the first usable sample
+  double BytesPerSecond() const { return bytesPerSecond; }
+
+private:
+  struct Pending {
+    uint32_t id;
+    uint64_t position; // sentBytes after the update
+    std::chrono::steady_clock::time_point sentAt;
+  };
+
+  std::deque<Pending> pending;
+  uint32_t nextId = 1;
+  uint64_t sentBytes = 0;
+  uint64_t ackedBytes = 0;
+  double lastTurnaround = 0;
+  double minRtt = 1e9;
+  double bytesPerSecond = 0;
+};
@@ -0,0 +1,151 @@
+#include "frame_diff.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "simd.h"
+
+// Below this many pixels a rect is cheap to encode whatever it contains
+const int TRIM_MIN_PIXELS = 64 * 64;
+// Unchanged rows that split a rect in two (one rect header is cheaper than
+// a few rows of pixels)
+const int TRIM_SPLIT_ROWS = 8;
+// Encoding a pixel costs at least this many times comparing it
+const double TRIM_ENCODE_COST = 8.0;
+// Trim every Nth frame regardless, to notice when it starts paying off
+const int TRIM_PROBE_INTERVAL = 30;
+
+// --- Helpers ---
+
+bool RectUnchanged(const uint8_t *prev, const uint8_t *cur, int fbW,
+                   const Rect &r) {
+  size_t rowBytes = (size_t)r.w * 4;
+  for (int y = r.y; y < r.y + r.h; y++) {
+    size_t offset = ((size_t)y * fbW + r.x) * 4;
+    if (memcmp(prev + offset, cur + offset, rowBytes) != 0)
+      return false;
+  }
+  return true;
+}
+
+void CopyRect(uint8_t *dst, const uint8_t *src, int fbW, const Rect &r) {
+  size_t rowBytes = (size_t)r.w * 4;
+  for (int y = r.y; y < r.y + r.h; y++) {
+    size_t offset = ((size_t)y * fbW + r.x) * 4;
+    memcpy(dst + offset, src + offset, rowBytes);
+  }
+}
+
+// First differing pixel from the left, n if none
+static int FirstDiff(const uint32_t *a, const uint32_t *b, int n) {
+  int i = 0;
+#ifdef VNC_HAVE_SSE2
+  for (; i + 4 <= n; i += 4) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(a + i)),
+                                 _mm_loadu_si128((const __m128i *)(b + i)));
+    if (_mm_movemask_epi8(eq) != 0xFFFF)
+      break;
+  }
+#endif
+  while (i < n && a[i] == b[i])
+    i++;
+  return i;
+}
+
+// One past the last differing pixel, counting from the right
+static int LastDiff(const uint32_t *a, const uint32_t *b, int n) {
+  int i = n;
+#ifdef VNC_HAVE_SSE2
+  for (; i >= 4; i -= 4) {
+    __m128i eq =
+        _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(a + i - 4)),
+                        _mm_loadu_si128((const __m128i *)(b + i - 4)));
+    if (_mm_movemask_epi8(eq) != 0xFFFF)
+      break;
+  }
+#endif
+  while (i > 0 && a[i - 1] == b[i - 1])
+    i--;
+  return i;
+}
+
+void TrimToChanges(const uint8_t *prev, const uint8_t *cur, int fbW,
+                   const Rect &r, std::vector<Rect> &out) {
+  const uint32_t *a = (const uint32_t *)prev;
+  const uint32_t *b = (const uint32_t *)cur;
+  int bandTop = -1, bandBottom = 0, bandX0 = 0, bandX1 = 0;
+
+  auto flush = [&] {
+    if (bandTop >= 0)
+      out.push_back({r.x + bandX0, bandTop, bandX1 - bandX0,
+                     bandBottom - bandTop});
+    bandTop = -1;
+  };
+
+  for (int y = r.y; y < r.y + r.h; y++) {
+    size_t offset = (size_t)y * fbW + r.x;
+    int x0 = FirstDiff(a + offset, b + offset, r.w);
+    if (x0 == r.w)
+      continue;
+    int x1 = LastDiff(a + offset + x0, b + offset + x0, r.w - x0) + x0;
+
+    if (bandTop >= 0 && y - bandBottom >= TRIM_SPLIT_ROWS)
+      flush();
+    if (bandTop < 0) {
+      bandTop = y;
+      bandX0 = x0;
+      bandX1 = x1;
+    } else {
+      bandX0 = std::min(bandX0, x0);
+      bandX1 = std::max(bandX1, x1);
+    }
+    bandBottom = y + 1;
+  }
+  flush();
+}
+
+// --- Trimmer ---
+
+void DamageTrimmer::Process(uint8_t *prev, const uint8_t *cur, int fbW,
+                            int fbH, const std::vector<Rect> &damage,
+                            int clients, std::vector<Rect> &out) {
+  bool probe = frames++ % TRIM_PROBE_INTERVAL == 0;
+  bool trim = enabled &&
+              (probe || savedShare * std::max(1, clients) * TRIM_ENCODE_COST >=
+                            1.0);
+  if (trim)
+    trimmedFrames++;
+  else
+    skippedFrames++;
+
+  uint64_t trimIn = 0, trimOut = 0;
+  std::vector<Rect> parts;
+  for (const auto &d : damage) {
+    Rect r = ClipRect(d, fbW, fbH);
+    uint64_t area = (uint64_t)r.w * r.h;
+    if (area == 0)
+      continue;
+    reportedPixels += area;
+
+    parts.clear();
+    if (trim && area >= (uint64_t)TRIM_MIN_PIXELS) {
+      TrimToChanges(prev, cur, fbW, r, parts);
+      trimIn += area;
+      for (const auto &p : parts)
+        trimOut += (uint64_t)p.w * p.h;
+    } else if (!RectUnchanged(prev, cur, fbW, r)) {
+      parts.push_back(r);
+    }
+    if (parts.empty())
+      unchangedRects++;
+
+    for (const auto &p : parts) {
+      CopyRect(prev, cur, fbW, p);
+      changedPixels += (uint64_t)p.w * p.h;
+      out.push_back(p);
+    }
+  }
+
+  if (trimIn > 0)
+    savedShare = savedShare * 0.8 + 0.2 * (double)(trimIn - trimOut) / trimIn;
+}
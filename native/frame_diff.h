@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "rfb.h"
+
+// --- Frame comparison ---
+//
+// Capture APIs over-report damage (DXGI repaints whole windows, a caret
+// blink can mark a whole line, X11 has no damage at all), so reported rects
+// are checked against the previous frame before anyone encodes them.
+
+// True when `r` holds the same pixels in both framebuffers
+bool RectUnchanged(const uint8_t *prev, const uint8_t *cur, int fbW,
+                   const Rect &r);
+
+// Copies the pixels of `r` from `src` to `dst`
+void CopyRect(uint8_t *dst, const uint8_t *src, int fbW, const Rect &r);
+
+// Appends the parts of `r` that differ: the bounding box of the changed
+// pixels, split where enough unchanged rows separate them. Appends nothing
+// if `r` is unchanged.
+void TrimToChanges(const uint8_t *prev, const uint8_t *cur, int fbW,
+                   const Rect &r, std::vector<Rect> &out);
+
+// Verifies reported damage against the previous frame and keeps that frame
+// up to date. Exact trimming reads every damaged pixel twice, so it only
+// runs while it has been paying off: the share of pixels it recently
+// removed, times the clients that would encode them, has to outweigh the
+// extra memory traffic. Otherwise rects are only checked for being
+// unchanged as a whole (a compare that stops at the first difference).
+class DamageTrimmer {
+public:
+  void SetEnabled(bool on) { enabled = on; }
+
+  // `prev` holds the last frame and is updated with the changes
+  void Process(uint8_t *prev, const uint8_t *cur, int fbW, int fbH,
+               const std::vector<Rect> &damage, int clients,
+               std::vector<Rect> &out);
+
+  // Counters (pixels; raw bytes = 4 per pixel)
+  uint64_t ReportedPixels() const { return reportedPixels; }
+  uint64_t ChangedPixels() const { return changedPixels; }
+  uint64_t UnchangedRects() const { return unchangedRects; }
+  uint64_t TrimmedFrames() const { return trimmedFrames; }
+  uint64_t SkippedFrames() const { return skippedFrames; }
+  uint64_t SavedBytes() const { return (reportedPixels - changedPixels) * 4; }
+
+private:
+  bool enabled = true;
+  uint64_t frames = 0;
+  double savedShare = 1; // Recent share of trimmed-away pixels, optimistic
+
+  std::atomic<uint64_t> reportedPixels{0};
+  std::atomic<uint64_t> changedPixels{0};
+  std::atomic<uint64_t> unchangedRects{0};
+  std::atomic<uint64_t> trimmedFrames{0};
+  std::atomic<uint64_t> skippedFrames{0};
+};
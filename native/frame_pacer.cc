@@ -0,0 +1,92 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+FramePacer::FramePacer() {
+#ifdef __linux__
+  timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+#endif
+}
+
+FramePacer::~FramePacer() {
+#ifdef __linux__
+  if (timerFd >= 0)
+    close(timerFd);
+#endif
+}
+
+void FramePacer::SetMaxFps(int fps) { intervalUs = 1000000 / std::max(1, fps); }
+
+void FramePacer::Demand() {
+  Clock::time_point now = Clock::now();
+  std::lock_guard<std::mutex> lock(mutex);
+  bool idle = now >= demandUntil;
+  demandUntil = now + std::chrono::milliseconds(DEMAND_HOLD_MS);
+  if (waitingSince == Clock::time_point())
+    waitingSince = now;
+  if (idle)
+    cv.notify_one();
+}
+
+void FramePacer::Interrupt() {
+  std::lock_guard<std::mutex> lock(mutex);
+  interrupted = true;
+  cv.notify_one();
+}
+
+bool FramePacer::WaitForCapture(Clock::duration timeout) {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    bool woken = cv.wait_for(lock, timeout, [this] {
+      return interrupted || Clock::now() < demandUntil;
+    });
+    if (!woken || interrupted) {
+      interrupted = false;
+      return false;
+    }
+  }
+
+  Clock::time_point slot =
+      lastCapture + std::chrono::microseconds(intervalUs.load());
+  if (slot > Clock::now())
+    SleepUntil(slot);
+  lastCapture = Clock::now();
+  captures++;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (waitingSince != Clock::time_point()) {
+    double sample =
+        std::chrono::duration<double, std::milli>(lastCapture - waitingSince)
+            .count();
+    delayMs = delayMs * 0.9 + sample * 0.1;
+    waitingSince = Clock::time_point();
+  }
+  return true;
+}
+
+void FramePacer::SleepUntil(Clock::time_point deadline) {
+#ifdef __linux__
+  // steady_clock is CLOCK_MONOTONIC, so the deadline can be armed as is
+  if (timerFd >= 0) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  deadline.time_since_epoch())
+                  .count();
+    itimerspec spec = {};
+    spec.it_value.tv_sec = (time_t)(ns / 1000000000);
+    spec.it_value.tv_nsec = (long)(ns % 1000000000);
+    uint64_t expirations;
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0 &&
+        read(timerFd, &expirations, sizeof(expirations)) ==
+            sizeof(expirations))
+      return;
+  }
+#endif
+  std::this_thread::sleep_until(deadline);
+}
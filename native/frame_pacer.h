@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// --- Frame pacing ---
+//
+// Decides when the capture thread grabs the next frame. Captures only run
+// while some client wants frames (an update request, a continuous-updates
+// slot, input that is about to change the screen), and are spaced at least
+// 1 / maxFps apart counted from the start of the previous one, not slept
+// after it: a client asking after a quiet spell gets a frame at once, and
+// a busy one at the full rate. Waiting for the next slot uses a timerfd on
+// Linux for an exact wakeup.
+class FramePacer {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  FramePacer();
+  ~FramePacer();
+
+  void SetMaxFps(int fps);
+
+  // A client wants a frame; keeps captures going for DEMAND_HOLD_MS
+  void Demand();
+
+  // Blocks until the next capture may start: demand is pending and the
+  // previous capture is 1 / maxFps ago. False after `timeout` without
+  // demand, or once Interrupt() was called.
+  bool WaitForCapture(Clock::duration timeout);
+  void Interrupt();
+
+  uint64_t Captures() const { return captures; }
+  // Smoothed time from the first demand after a capture to the next one
+  double DelayMs() const { return delayMs; }
+
+private:
+  static constexpr int DEMAND_HOLD_MS = 250;
+
+  void SleepUntil(Clock::time_point deadline);
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  Clock::time_point demandUntil;
+  Clock::time_point waitingSince; // First demand not yet served; epoch = none
+  bool interrupted = false;
+
+  std::atomic<int> intervalUs{1000000 / 30};
+  Clock::time_point lastCapture;
+  std::atomic<uint64_t> captures{0};
+  std::atomic<double> delayMs{0};
+  int timerFd = -1;
+};
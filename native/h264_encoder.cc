@@ -0,0 +1,206 @@
+#include "h264_encoder.h"
+
+#include <cstring>
+
+// H.264 rect flags (noVNC)
+const uint32_t H264_FLAG_RESET_CONTEXT = 1;
+const uint32_t H264_FLAG_RESET_ALL_CONTEXTS = 2;
+
+#ifdef VNC_WITH_OPENH264
+#include <wels/codec_api.h>
+
+// --- Color Conversion ---
+
+// RGBA -> I420, BT.601 limited range (what decoders assume without VUI)
+static void RgbaToI420(const uint8_t *src, int stride, int w, int h,
+                       uint8_t *yPlane, uint8_t *uPlane, uint8_t *vPlane) {
+  for (int y = 0; y < h; y += 2) {
+    const uint8_t *row0 = src + (size_t)y * stride;
+    const uint8_t *row1 = row0 + stride;
+    uint8_t *y0 = yPlane + (size_t)y * w;
+    uint8_t *y1 = y0 + w;
+    uint8_t *u = uPlane + (size_t)(y / 2) * (w / 2);
+    uint8_t *v = vPlane + (size_t)(y / 2) * (w / 2);
+
+    for (int x = 0; x < w; x += 2) {
+      int sumR = 0, sumG = 0, sumB = 0;
+      const uint8_t *px[4] = {row0 + x * 4, row0 + x * 4 + 4, row1 + x * 4,
+                              row1 + x * 4 + 4};
+      uint8_t *dst[4] = {y0 + x, y0 + x + 1, y1 + x, y1 + x + 1};
+      for (int i = 0; i < 4; i++) {
+        int r = px[i][0], g = px[i][1], b = px[i][2];
+        *dst[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        sumR += r;
+        sumG += g;
+        sumB += b;
+      }
+      int r = sumR >> 2, g = sumG >> 2, b = sumB >> 2;
+      u[x / 2] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+      v[x / 2] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+  }
+}
+#endif
+
+// --- Encoder ---
+
+H264Encoder::H264Encoder() {}
+
+H264Encoder::~H264Encoder() { Reset(); }
+
+bool H264Encoder::Available() {
+#ifdef VNC_WITH_OPENH264
+  return true;
+#else
+  return false;
+#endif
+}
+
+void H264Encoder::Reset() {
+#ifdef VNC_WITH_OPENH264
+  if (encoder) {
+    encoder->Uninitialize();
+    WelsDestroySVCEncoder(encoder);
+  }
+#endif
+  encoder = nullptr;
+  region = {0, 0, 0, 0};
+}
+
+bool H264Encoder::Configure(const Rect &r, int kbps, int fps) {
+#ifdef VNC_WITH_OPENH264
+  if (encoder && r.x == region.x && r.y == region.y && r.w == region.w &&
+      r.h == region.h)
+    return true;
+  Reset();
+  if (r.w < 16 || r.h < 16 || (r.w & 1) || (r.h & 1))
+    return false;
+  if (WelsCreateSVCEncoder(&encoder) != 0 || !encoder)
+    return false;
+
+  SEncParamExt param;
+  encoder->GetDefaultParams(&param);
+  param.iUsageType = SCREEN_CONTENT_REAL_TIME;
+  param.iPicWidth = r.w;
+  param.iPicHeight = r.h;
+  param.iRCMode = RC_BITRATE_MODE;
+  param.iTargetBitrate = kbps * 1000;
+  param.iMaxBitrate = kbps * 1000 * 3 / 2;
+  param.fMaxFrameRate = (float)fps;
+  param.bEnableFrameSkip = true; // Drop frames rather than overshoot the link
+  param.uiIntraPeriod = 0;       // IDR only on demand
+  param.iNumRefFrame = 1;
+  param.iSpatialLayerNum = 1;
+  param.iTemporalLayerNum = 1;
+  param.iEntropyCodingModeFlag = 0; // CAVLC: constrained baseline
+  param.iMultipleThreadIdc = 1;     // One encode thread per client
+  param.eSpsPpsIdStrategy = CONSTANT_ID;
+  param.sSpatialLayers[0].iVideoWidth = r.w;
+  param.sSpatialLayers[0].iVideoHeight = r.h;
+  param.sSpatialLayers[0].fFrameRate = (float)fps;
+  param.sSpatialLayers[0].iSpatialBitrate = param.iTargetBitrate;
+  param.sSpatialLayers[0].iMaxSpatialBitrate = param.iMaxBitrate;
+  param.sSpatialLayers[0].sSliceArgument.uiSliceMode = SM_SINGLE_SLICE;
+
+  if (encoder->InitializeExt(&param) != cmResultSuccess) {
+    WelsDestroySVCEncoder(encoder);
+    encoder = nullptr;
+    return false;
+  }
+  int format = videoFormatI420;
+  encoder->SetOption(ENCODER_OPTION_DATAFORMAT, &format);
+
+  region = r;
+  bitrateKbps = kbps;
+  maxFps = fps;
+  frameIndex = 0;
+  resetContexts = true;
+  yuv.resize((size_t)r.w * r.h * 3 / 2);
+  return true;
+#else
+  (void)r;
+  (void)kbps;
+  (void)fps;
+  return false;
+#endif
+}
+
+void H264Encoder::SetBitrate(int kbps) {
+#ifdef VNC_WITH_OPENH264
+  if (!encoder || kbps == bitrateKbps)
+    return;
+  SBitrateInfo info;
+  info.iLayer = SPATIAL_LAYER_ALL;
+  info.iBitrate = kbps * 1000 * 3 / 2;
+  encoder->SetOption(ENCODER_OPTION_MAX_BITRATE, &info);
+  info.iBitrate = kbps * 1000;
+  encoder->SetOption(ENCODER_OPTION_BITRATE, &info);
+#endif
+  bitrateKbps = kbps;
+}
+
+bool H264Encoder::EncodeRect(const uint8_t *fb, int fbW,
+                             std::vector<uint8_t> &out) {
+#ifdef VNC_WITH_OPENH264
+  if (!encoder)
+    return false;
+
+  const int w = region.w, h = region.h;
+  uint8_t *yPlane = yuv.data();
+  uint8_t *uPlane = yPlane + (size_t)w * h;
+  uint8_t *vPlane = uPlane + (size_t)w * h / 4;
+  RgbaToI420(fb + ((size_t)region.y * fbW + region.x) * 4, fbW * 4, w, h,
+             yPlane, uPlane, vPlane);
+
+  SSourcePicture pic;
+  memset(&pic, 0, sizeof(pic));
+  pic.iColorFormat = videoFormatI420;
+  pic.iPicWidth = w;
+  pic.iPicHeight = h;
+  pic.iStride[0] = w;
+  pic.iStride[1] = w / 2;
+  pic.iStride[2] = w / 2;
+  pic.pData[0] = yPlane;
+  pic.pData[1] = uPlane;
+  pic.pData[2] = vPlane;
+  pic.uiTimeStamp = (long long)(frameIndex++ * 1000 / maxFps);
+
+  // A fresh client context must start from an IDR frame
+  if (resetContexts)
+    encoder->ForceIntraFrame(true);
+
+  SFrameBSInfo info;
+  memset(&info, 0, sizeof(info));
+  if (encoder->EncodeFrame(&pic, &info) != cmResultSuccess ||
+      info.eFrameType == videoFrameTypeSkip ||
+      info.eFrameType == videoFrameTypeInvalid)
+    return false;
+
+  // Rect header, then length (4), flags (4) and the Annex B stream
+  PutRectHeader(out, region, ENCODING_H264);
+  size_t lengthPos = out.size();
+  PutU32(out, 0);
+  PutU32(out, resetContexts ? H264_FLAG_RESET_ALL_CONTEXTS : 0);
+  size_t start = out.size();
+  for (int l = 0; l < info.iLayerNum; l++) {
+    const SLayerBSInfo &layer = info.sLayerInfo[l];
+    size_t size = 0;
+    for (int n = 0; n < layer.iNalCount; n++)
+      size += layer.pNalLengthInByte[n];
+    out.insert(out.end(), layer.pBsBuf, layer.pBsBuf + size);
+  }
+  uint32_t length = (uint32_t)(out.size() - start);
+  out[lengthPos + 0] = (length >> 24) & 0xFF;
+  out[lengthPos + 1] = (length >> 16) & 0xFF;
+  out[lengthPos + 2] = (length >> 8) & 0xFF;
+  out[lengthPos + 3] = length & 0xFF;
+
+  resetContexts = false;
+  return true;
+#else
+  (void)fb;
+  (void)fbW;
+  (void)out;
+  return false;
+#endif
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "rfb.h"
+
+class ISVCEncoder;
+
+// --- H.264 (50) ---
+//
+// Software H.264 via openh264 (CPU only, no frame delay) for full-motion
+// content. Each encoder owns exactly one decoder context on the client,
+// keyed by the rect it covers. Without VNC_WITH_OPENH264 the class compiles
+// to a stub and Available() reports false.
+class H264Encoder {
+public:
+  H264Encoder();
+  ~H264Encoder();
+
+  static bool Available();
+
+  // (Re)creates the encoder for `region` (even-sized, inside the
+  // framebuffer). No-op if the region is unchanged.
+  bool Configure(const Rect &region, int bitrateKbps, int maxFps);
+  void SetBitrate(int bitrateKbps);
+  void Reset();
+
+  bool Active() const { return encoder != nullptr; }
+  const Rect &Region() const { return region; }
+  int Bitrate() const { return bitrateKbps; }
+
+  // Appends one H.264 rect covering Region(). Returns false (and appends
+  // nothing) when the encoder fails or rate control drops the frame.
+  bool EncodeRect(const uint8_t *fb, int fbW, std::vector<uint8_t> &out);
+
+private:
+  ISVCEncoder *encoder = nullptr;
+  Rect region = {0, 0, 0, 0};
+  int bitrateKbps = 0;
+  int maxFps = 30;
+  uint64_t frameIndex = 0;
+  bool resetContexts = true; // Tell the client to drop stale decoders
+  std::vector<uint8_t> yuv;  // I420 staging buffer
+};
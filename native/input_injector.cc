@@ -0,0 +1,74 @@
+#include "input_injector.h"
+
+#include <algorithm>
+#include <chrono>
+
+InputInjector::~InputInjector() { Stop(); }
+
+void InputInjector::Start() {
+  if (this->running || !this->sink)
+    return;
+  this->running = true;
+  this->thread = std::thread(&InputInjector::Run, this);
+}
+
+void InputInjector::Stop() {
+  this->running = false;
+  this->pushed.Ring();
+  if (this->thread.joinable())
+    this->thread.join();
+}
+
+void InputInjector::SetDesktopSize(int width, int height) {
+  this->desktopSize = (uint64_t)(uint32_t)width << 32 | (uint32_t)height;
+}
+
+bool InputInjector::Push(const InputEvent &event) {
+  InputEvent item = event;
+  this->events++;
+  if (!this->queue.TryPush(item)) {
+    // Only when injection is wedged; reading the socket must go on
+    this->dropped++;
+    return false;
+  }
+  this->pushed.Ring();
+  return true;
+}
+
+void InputInjector::Coalesce(std::vector<InputEvent> &batch) {
+  size_t kept = 0;
+  for (size_t i = 0; i < batch.size(); i++) {
+    const InputEvent &e = batch[i];
+    bool moveOnly = e.type == InputEvent::POINTER &&
+                    e.buttons == e.previousButtons;
+    if (moveOnly && i + 1 < batch.size() &&
+        batch[i + 1].type == InputEvent::POINTER &&
+        batch[i + 1].client == e.client)
+      continue;
+    batch[kept++] = e;
+  }
+  batch.resize(kept);
+}
+
+void InputInjector::Run() {
+  std::vector<InputEvent> batch;
+  uint64_t size = 0;
+  while (this->running) {
+    InputEvent event;
+    while ((int)batch.size() < MAX_BATCH && this->queue.TryPop(event))
+      batch.push_back(event);
+    if (batch.empty()) {
+      this->pushed.Wait(std::chrono::milliseconds(100));
+      continue;
+    }
+    if (this->desktopSize != size) {
+      size = this->desktopSize;
+      this->sink->SetDesktopSize((int)(size >> 32), (int)(uint32_t)size);
+    }
+    Coalesce(batch);
+    this->sink->Deliver(batch);
+    this->injected += batch.size();
+    this->batches++;
+    batch.clear();
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "input_sink.h"
+#include "pipeline.h"
+
+// --- Input injection ---
+//
+// Client threads queue their input and go straight back to reading the
+// socket; one thread injects it, in the order it was queued across all
+// clients. Whatever has piled up goes to the InputSink as one batch, with
+// runs of pointer moves from one client collapsed
+// into the last: a high-rate mouse over a bursty link delivers dozens of
+// positions at once, and only where the pointer ended up matters.
+class InputInjector {
+public:
+  ~InputInjector();
+
+  // The sink is set before Start; it is only touched by the injection
+  // thread after that
+  void SetSink(std::unique_ptr<InputSink> sink) {
+    this->sink = std::move(sink);
+  }
+  bool HasSink() const { return this->sink != nullptr; }
+  const char *SinkName() const {
+    return this->sink ? this->sink->Name() : "none";
+  }
+
+  void Start();
+  void Stop();
+
+  // Framebuffer size, passed on to the sink before its next batch
+  void SetDesktopSize(int width, int height);
+
+  // False when the queue is full and the event was dropped
+  bool Push(const InputEvent &event);
+
+  // Counters for getStats()
+  size_t Queued() const { return this->queue.Size(); }
+  uint64_t Events() const { return this->events; }
+  uint64_t Injected() const { return this->injected; }
+  uint64_t Batches() const { return this->batches; }
+  uint64_t Dropped() const { return this->dropped; }
+
+  // Leaves out pointer moves that a later position from the same client,
+  // next in `batch`, makes pointless
+  static void Coalesce(std::vector<InputEvent> &batch);
+
+private:
+  static constexpr int QUEUE_SLOTS = 1024;
+  static constexpr int MAX_BATCH = 256;
+
+  void Run();
+
+  std::unique_ptr<InputSink> sink;
+  std::atomic<uint64_t> desktopSize{0}; // width << 32 | height
+  MpscQueue<InputEvent> queue{QUEUE_SLOTS};
+  Doorbell pushed;
+  std::atomic<bool> running{false};
+  std::thread thread;
+  std::atomic<uint64_t> events{0};
+  std::atomic<uint64_t> injected{0};
+  std::atomic<uint64_t> batches{0};
+  std::atomic<uint64_t> dropped{0};
+};
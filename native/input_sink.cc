@@ -0,0 +1,37 @@
+#include "input_sink.h"
+
+#include <algorithm>
+
+void RecordingInputSink::Deliver(const std::vector<InputEvent> &batch) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  size_t room = RECORD_MAX_EVENTS - std::min(RECORD_MAX_EVENTS,
+                                             this->events.size());
+  this->events.insert(this->events.end(), batch.begin(),
+                      batch.begin() + std::min(room, batch.size()));
+}
+
+void RecordingInputSink::Take(std::vector<InputEvent> &events) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  events.swap(this->events);
+  this->events.clear();
+}
+
+std::unique_ptr<InputSink> CreateInputSink(const std::string &kind) {
+  if (kind == "record")
+    return std::make_unique<RecordingInputSink>();
+  if (kind == "none")
+    return std::make_unique<NullInputSink>();
+  bool any = kind == "auto";
+#ifdef _WIN32
+  if (any || kind == "sendinput")
+    return CreateSendInputSink();
+#elif defined(__linux__)
+  if (any || kind == "xtest") {
+    if (auto sink = CreateXTestSink())
+      return sink;
+  }
+  if (any || kind == "uinput")
+    return CreateUinputSink();
+#endif
+  return nullptr;
+}
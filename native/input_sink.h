@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A KeyEvent or PointerEvent as a client sent it
+struct InputEvent {
+  enum Type { KEY, POINTER };
+  Type type = KEY;
+  int client = 0;
+  // KEY
+  uint32_t keysym = 0;
+  bool down = false;
+  // POINTER, in desktop coordinates
+  int x = 0;
+  int y = 0;
+  uint8_t buttons = 0;
+  uint8_t previousButtons = 0; // The client's mask before this event
+};
+
+// RFB pointer buttons (mask bits 0-6): 1-3 left, middle, right; 4-7 wheel
+// up, down, left, right (one step per press)
+const int INPUT_BUTTONS = 7;
+
+// --- Input backends ---
+//
+// Where injected input goes: the OS (SendInput on Windows, XTest or a
+// uinput device on Linux), or a recorder for tests and benchmarks. The
+// injection thread hands over whole batches, so a backend can deliver them
+// with one call or one flush; only that thread calls a sink.
+class InputSink {
+public:
+  virtual ~InputSink() {}
+
+  virtual const char *Name() const = 0;
+
+  // Framebuffer size, for backends with an absolute pointer range
+  virtual void SetDesktopSize(int width, int height) {
+    (void)width;
+    (void)height;
+  }
+
+  // In order. Keys that the backend cannot type are skipped.
+  virtual void Deliver(const std::vector<InputEvent> &batch) = 0;
+};
+
+// Keeps what it is given, up to RECORD_MAX_EVENTS, until taken
+class RecordingInputSink : public InputSink {
+public:
+  const char *Name() const override { return "record"; }
+  void Deliver(const std::vector<InputEvent> &batch) override;
+
+  // Moves out everything recorded so far; any thread
+  void Take(std::vector<InputEvent> &events);
+
+private:
+  static constexpr size_t RECORD_MAX_EVENTS = 65536;
+
+  std::mutex mutex;
+  std::vector<InputEvent> events;
+};
+
+// View-only
+class NullInputSink : public InputSink {
+public:
+  const char *Name() const override { return "none"; }
+  void Deliver(const std::vector<InputEvent> &batch) override {
+    (void)batch;
+  }
+};
+
+// `kind` is "auto", "sendinput", "xtest", "uinput", "record" or "none";
+// "auto" takes the first backend that works here (SendInput on Windows,
+// XTest then uinput on Linux). Null when the backend is not available.
+std::unique_ptr<InputSink> CreateInputSink(const std::string &kind);
+
+// Platform backends; null when they cannot start
+#ifdef _WIN32
+std::unique_ptr<InputSink> CreateSendInputSink();
+#elif defined(__linux__)
+std::unique_ptr<InputSink> CreateXTestSink();
+std::unique_ptr<InputSink> CreateUinputSink();
+#endif
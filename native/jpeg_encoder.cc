@@ -0,0 +1,119 @@
+#include "jpeg_encoder.h"
+
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+
+#include <jpeglib.h>
+
+// --- libjpeg plumbing ---
+
+// libjpeg's default error handler calls exit(); jump back instead
+struct JpegErrorMgr {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+static void JpegErrorExit(j_common_ptr cinfo) {
+  JpegErrorMgr *err = (JpegErrorMgr *)cinfo->err;
+  longjmp(err->jump, 1);
+}
+
+static void JpegOutputMessage(j_common_ptr) {}
+
+// Destination manager that appends straight into the caller's vector
+struct JpegVectorDest {
+  jpeg_destination_mgr pub;
+  std::vector<uint8_t> *out;
+  size_t start;
+};
+
+const size_t JPEG_DEST_CHUNK = 64 * 1024;
+
+static void JpegInitDest(j_compress_ptr cinfo) {
+  JpegVectorDest *dest = (JpegVectorDest *)cinfo->dest;
+  dest->out->resize(dest->start + JPEG_DEST_CHUNK);
+  dest->pub.next_output_byte = dest->out->data() + dest->start;
+  dest->pub.free_in_buffer = JPEG_DEST_CHUNK;
+}
+
+static boolean JpegEmptyOutput(j_compress_ptr cinfo) {
+  JpegVectorDest *dest = (JpegVectorDest *)cinfo->dest;
+  // libjpeg only calls this when the whole buffer is full
+  size_t used = dest->out->size();
+  dest->out->resize(used + JPEG_DEST_CHUNK);
+  dest->pub.next_output_byte = dest->out->data() + used;
+  dest->pub.free_in_buffer = JPEG_DEST_CHUNK;
+  return TRUE;
+}
+
+static void JpegTermDest(j_compress_ptr cinfo) {
+  JpegVectorDest *dest = (JpegVectorDest *)cinfo->dest;
+  dest->out->resize(dest->out->size() - dest->pub.free_in_buffer);
+}
+
+// --- Encoder ---
+
+bool EncodeJPEG(const uint8_t *rgba, int stride, int w, int h, int quality,
+                std::vector<uint8_t> &out) {
+  if (w <= 0 || h <= 0)
+    return false;
+
+  jpeg_compress_struct cinfo;
+  JpegErrorMgr jerr;
+  JpegVectorDest dest;
+  const size_t start = out.size();
+#ifndef JCS_EXTENSIONS
+  // Only needed without libjpeg-turbo's RGBX input extension
+  std::vector<uint8_t> rgbRow(w * 3);
+#endif
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = JpegErrorExit;
+  jerr.pub.output_message = JpegOutputMessage;
+  if (setjmp(jerr.jump)) {
+    jpeg_destroy_compress(&cinfo);
+    out.resize(start);
+    return false;
+  }
+
+  jpeg_create_compress(&cinfo);
+  dest.pub.init_destination = JpegInitDest;
+  dest.pub.empty_output_buffer = JpegEmptyOutput;
+  dest.pub.term_destination = JpegTermDest;
+  dest.out = &out;
+  dest.start = start;
+  cinfo.dest = &dest.pub;
+
+  cinfo.image_width = w;
+  cinfo.image_height = h;
+#ifdef JCS_EXTENSIONS
+  cinfo.input_components = 4;
+  cinfo.in_color_space = JCS_EXT_RGBX;
+#else
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+#endif
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, quality, TRUE);
+  cinfo.dct_method = JDCT_IFAST;
+
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    const uint8_t *src = rgba + (size_t)cinfo.next_scanline * stride;
+#ifdef JCS_EXTENSIONS
+    JSAMPROW row = (JSAMPROW)src;
+#else
+    for (int x = 0; x < w; x++) {
+      rgbRow[x * 3 + 0] = src[x * 4 + 0];
+      rgbRow[x * 3 + 1] = src[x * 4 + 1];
+      rgbRow[x * 3 + 2] = src[x * 4 + 2];
+    }
+    JSAMPROW row = rgbRow.data();
+#endif
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  return true;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Encodes an RGBA (alpha ignored) region as a baseline 4:2:0 JPEG with
+// libjpeg-turbo, appending the file to `out`. `quality` is 1-100.
+bool EncodeJPEG(const uint8_t *rgba, int stride, int w, int h, int quality,
+                std::vector<uint8_t> &out);
@@ -0,0 +1,51 @@
+#include "keyframe_cache.h"
+
+static EncodeKey SettingsOnly(EncodeKey key) {
+  key.frame = 0;
+  key.rect = {0, 0, 0, 0};
+  return key;
+}
+
+KeyframePtr KeyframeCache::Find(const EncodeKey &settings,
+                                uint64_t minFrame) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto it = this->slots.find(SettingsOnly(settings));
+  if (it == this->slots.end() || it->second.keyframe->frame < minFrame) {
+    this->misses++;
+    return nullptr;
+  }
+  it->second.lastUsed = ++this->uses;
+  this->hits++;
+  return it->second.keyframe;
+}
+
+void KeyframeCache::Store(const EncodeKey &settings, KeyframePtr keyframe) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  Slot &slot = this->slots[SettingsOnly(settings)];
+  if (slot.keyframe && slot.keyframe->frame > keyframe->frame)
+    return;
+  slot.keyframe = keyframe;
+  slot.lastUsed = ++this->uses;
+
+  // Drop the least recently used settings
+  while (this->slots.size() > MAX_KEYFRAMES) {
+    auto oldest = this->slots.begin();
+    for (auto it = this->slots.begin(); it != this->slots.end(); ++it)
+      if (it->second.lastUsed < oldest->second.lastUsed)
+        oldest = it;
+    this->slots.erase(oldest);
+  }
+}
+
+void KeyframeCache::Stale(uint64_t minFrame,
+                          std::vector<EncodeKey> &settings) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (const auto &slot : this->slots)
+    if (slot.second.keyframe->frame < minFrame)
+      settings.push_back(slot.first);
+}
+
+void KeyframeCache::Clear() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->slots.clear();
+}
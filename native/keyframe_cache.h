@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "encode_cache.h"
+
+// --- Keyframes for joining clients ---
+//
+// A client that connects (or asks for a non-incremental update) needs the
+// whole screen. Instead of encoding it for every joiner, the last full
+// update per encoding settings is kept as ready-to-send parts; a joiner
+// gets it at once and then the damage since the keyframe's frame. The
+// caller replaces a keyframe once it is too old for that damage to stay
+// small, ahead of the joiners that would otherwise have to.
+
+struct Keyframe {
+  uint64_t frame = 0;
+  std::vector<Rect> rects; // What each part covers
+  std::vector<EncodedRectsPtr> parts;
+};
+typedef std::shared_ptr<const Keyframe> KeyframePtr;
+
+class KeyframeCache {
+public:
+  // The keyframe for `settings` (frame and rect ignored) if it is from
+  // `minFrame` or later, null otherwise
+  KeyframePtr Find(const EncodeKey &settings, uint64_t minFrame);
+  // Keeps the newer of `keyframe` and the stored one
+  void Store(const EncodeKey &settings, KeyframePtr keyframe);
+  // Appends the settings whose keyframe is older than `minFrame`
+  void Stale(uint64_t minFrame, std::vector<EncodeKey> &settings);
+  void Clear();
+
+  uint64_t Hits() const { return hits; }
+  uint64_t Misses() const { return misses; }
+
+private:
+  // Settings in use by few clients are not worth keeping many of
+  static constexpr size_t MAX_KEYFRAMES = 4;
+
+  struct Slot {
+    KeyframePtr keyframe;
+    uint64_t lastUsed = 0;
+  };
+
+  std::mutex mutex;
+  std::map<EncodeKey, Slot> slots;
+  uint64_t uses = 0;
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// --- Keysyms ---
+//
+// RFB KeyEvents carry X keysyms. Most of the keysym space is text: Latin-1
+// (0x20-0xFF, equal to Unicode), the legacy blocks 0x100-0x20FF (Greek,
+// Cyrillic, Kana, ...) and Unicode keysyms (0x01000000 + code point). The
+// rest, 0xFE00-0xFFFF, are function, keypad and modifier keys, which each
+// input backend maps to its own key codes.
+
+const uint32_t KEYSYM_FUNCTION_FIRST = 0xFE00;
+const uint32_t KEYSYM_FUNCTION_COUNT = 0x200; // Through 0xFFFF
+const uint32_t KEYSYM_UNICODE_OFFSET = 0x01000000;
+
+// The code point a text keysym types; 0 for function keys and unassigned
+// keysyms
+uint32_t KeysymToUnicode(uint32_t keysym);
+
+// True for the 0xFE00-0xFFFF block, which backends look up in tables of
+// KEYSYM_FUNCTION_COUNT entries
+inline bool IsFunctionKeysym(uint32_t keysym) {
+  return keysym >= KEYSYM_FUNCTION_FIRST &&
+         keysym < KEYSYM_FUNCTION_FIRST + KEYSYM_FUNCTION_COUNT;
+}
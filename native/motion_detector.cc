@@ -0,0 +1,170 @@
+#include "motion_detector.h"
+
+#include <algorithm>
+
+// Fewer hot tiles than this is a cursor blink or a spinner, not video
+const int MOTION_MIN_HOT_TILES = 4;
+
+static int PopCount16(uint16_t v) {
+  int n = 0;
+  while (v) {
+    v &= v - 1;
+    n++;
+  }
+  return n;
+}
+
+static bool RectContains(const Rect &outer, const Rect &inner) {
+  return inner.x >= outer.x && inner.y >= outer.y &&
+         inner.x + inner.w <= outer.x + outer.w &&
+         inner.y + inner.h <= outer.y + outer.h;
+}
+
+void MotionDetector::Clear() {
+  std::fill(history.begin(), history.end(), 0);
+  region = {0, 0, 0, 0};
+  candidates.clear();
+  regions.clear();
+}
+
+int MotionDetector::Changes(const Rect &r) const {
+  if (history.empty() || r.w <= 0 || r.h <= 0)
+    return 0;
+  int x0 = std::max(0, r.x / TILE_SIZE);
+  int y0 = std::max(0, r.y / TILE_SIZE);
+  int x1 = std::min(gridW - 1, (r.x + r.w - 1) / TILE_SIZE);
+  int y1 = std::min(gridH - 1, (r.y + r.h - 1) / TILE_SIZE);
+  int most = 0;
+  for (int ty = y0; ty <= y1; ty++)
+    for (int tx = x0; tx <= x1; tx++)
+      most = std::max(most, PopCount16(history[(size_t)ty * gridW + tx]));
+  return most;
+}
+
+void MotionDetector::Update(const std::vector<Rect> &dirtyRects, int fbW,
+                            int fbH) {
+  int gw = (fbW + TILE_SIZE - 1) / TILE_SIZE;
+  int gh = (fbH + TILE_SIZE - 1) / TILE_SIZE;
+  if (gw != gridW || gh != gridH) {
+    gridW = gw;
+    gridH = gh;
+    history.assign((size_t)gw * gh, 0);
+    region = {0, 0, 0, 0};
+    candidates.clear();
+    regions.clear();
+  }
+
+  std::vector<uint8_t> damaged((size_t)gw * gh, 0);
+  for (const auto &r : dirtyRects) {
+    int x0 = std::max(0, r.x) / TILE_SIZE;
+    int y0 = std::max(0, r.y) / TILE_SIZE;
+    int x1 = (std::min(fbW, r.x + r.w) - 1) / TILE_SIZE;
+    int y1 = (std::min(fbH, r.y + r.h) - 1) / TILE_SIZE;
+    for (int ty = y0; ty <= y1; ty++)
+      for (int tx = x0; tx <= x1; tx++)
+        damaged[(size_t)ty * gw + tx] = 1;
+  }
+
+  int minX = gw, minY = gh, maxX = -1, maxY = -1, hot = 0;
+  std::vector<uint8_t> hotTiles((size_t)gw * gh, 0);
+  for (int ty = 0; ty < gh; ty++) {
+    for (int tx = 0; tx < gw; tx++) {
+      size_t i = (size_t)ty * gw + tx;
+      history[i] = (uint16_t)((history[i] << 1) | damaged[i]);
+      if (PopCount16(history[i]) >= HOT_FRAMES) {
+        hotTiles[i] = 1;
+        hot++;
+        minX = std::min(minX, tx);
+        minY = std::min(minY, ty);
+        maxX = std::max(maxX, tx);
+        maxY = std::max(maxY, ty);
+      }
+    }
+  }
+
+  UpdateRegions(hotTiles, fbW, fbH);
+
+  // Scattered hot tiles are busy UI rather than one moving picture
+  int boxTiles = (maxX - minX + 1) * (maxY - minY + 1);
+  if (hot < MOTION_MIN_HOT_TILES || hot * 2 < boxTiles) {
+    region = {0, 0, 0, 0};
+    return;
+  }
+
+  // Tile edges are macroblock aligned; only the screen edge may be ragged
+  Rect r;
+  r.x = minX * TILE_SIZE;
+  r.y = minY * TILE_SIZE;
+  r.w = (std::min((maxX + 1) * TILE_SIZE, fbW) - r.x) & ~1;
+  r.h = (std::min((maxY + 1) * TILE_SIZE, fbH) - r.y) & ~1;
+
+  // Hysteresis: keep the current region (and the client's decoder) while
+  // the motion still fits inside it and fills a good part of it
+  if (region.w > 0 && RectContains(region, r) &&
+      (int64_t)r.w * r.h * 2 >= (int64_t)region.w * region.h)
+    return;
+  region = r;
+}
+
+void MotionDetector::UpdateRegions(const std::vector<uint8_t> &hot, int fbW,
+                                   int fbH) {
+  // Clusters of touching (also diagonally) hot tiles, each held to the same
+  // size and density bar as the single motion region
+  std::vector<Candidate> found;
+  std::vector<uint8_t> visited(hot.size(), 0);
+  std::vector<int> stack;
+  for (size_t start = 0; start < hot.size(); start++) {
+    if (!hot[start] || visited[start])
+      continue;
+    int minX = gridW, minY = gridH, maxX = -1, maxY = -1, tiles = 0;
+    visited[start] = 1;
+    stack.push_back((int)start);
+    while (!stack.empty()) {
+      int i = stack.back();
+      stack.pop_back();
+      int tx = i % gridW;
+      int ty = i / gridW;
+      tiles++;
+      minX = std::min(minX, tx);
+      minY = std::min(minY, ty);
+      maxX = std::max(maxX, tx);
+      maxY = std::max(maxY, ty);
+      for (int ny = std::max(0, ty - 1); ny <= std::min(gridH - 1, ty + 1);
+           ny++) {
+        for (int nx = std::max(0, tx - 1); nx <= std::min(gridW - 1, tx + 1);
+             nx++) {
+          size_t n = (size_t)ny * gridW + nx;
+          if (hot[n] && !visited[n]) {
+            visited[n] = 1;
+            stack.push_back((int)n);
+          }
+        }
+      }
+    }
+    int boxTiles = (maxX - minX + 1) * (maxY - minY + 1);
+    if (tiles < MOTION_MIN_HOT_TILES || tiles * 2 < boxTiles)
+      continue;
+    Rect r = {minX * TILE_SIZE, minY * TILE_SIZE, 0, 0};
+    r.w = std::min((maxX + 1) * TILE_SIZE, fbW) - r.x;
+    r.h = std::min((maxY + 1) * TILE_SIZE, fbH) - r.y;
+    found.push_back({r, 1});
+  }
+
+  // A cluster overlapping one from the last update continues it; while it
+  // fits in its old box and fills half of it, the box stays put
+  for (auto &f : found) {
+    for (const auto &c : candidates) {
+      if (!RectsIntersect(f.rect, c.rect))
+        continue;
+      f.age = std::max(f.age, std::min(c.age + 1, REGION_STABLE_FRAMES));
+      if (RectContains(c.rect, f.rect) &&
+          (int64_t)f.rect.w * f.rect.h * 2 >= (int64_t)c.rect.w * c.rect.h)
+        f.rect = c.rect;
+    }
+  }
+  candidates.swap(found);
+  regions.clear();
+  for (const auto &c : candidates)
+    if (c.age >= REGION_STABLE_FRAMES)
+      regions.push_back(c.rect);
+}
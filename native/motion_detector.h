@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "rfb.h"
+
+// Finds the part of the screen that keeps changing frame after frame
+// (video playback, 3D viewports) from the damage stream alone. Each 64x64
+// tile keeps a bitmask of the last 16 frames it was damaged in; tiles
+// damaged in most of them are "hot" and their bounding box becomes the
+// motion region. Separate clusters of hot tiles that persist are also
+// reported one by one as video regions.
+class MotionDetector {
+public:
+  void Update(const std::vector<Rect> &dirtyRects, int fbW, int fbH);
+  void Clear();
+
+  // Macroblock-aligned, even-sized region; w == 0 when nothing qualifies
+  Rect Region() const { return region; }
+
+  // Most frames (out of the last 16) any tile under `r` was damaged in
+  int Changes(const Rect &r) const;
+
+  // Tile-aligned bounding boxes of the hot clusters seen for at least
+  // REGION_STABLE_FRAMES updates in a row, e.g. two players side by side
+  const std::vector<Rect> &Regions() const { return regions; }
+
+private:
+  static const int TILE_SIZE = 64;
+  static const int HOT_FRAMES = 10; // out of the last 16
+  static constexpr int REGION_STABLE_FRAMES = 8;
+
+  struct Candidate {
+    Rect rect;
+    int age; // Consecutive updates a cluster was found here
+  };
+
+  void UpdateRegions(const std::vector<uint8_t> &hot, int fbW, int fbH);
+
+  int gridW = 0;
+  int gridH = 0;
+  std::vector<uint16_t> history;
+  Rect region = {0, 0, 0, 0};
+  std::vector<Candidate> candidates;
+  std::vector<Rect> regions;
+};
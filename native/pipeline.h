@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// --- Pipeline plumbing ---
+//
+// Frames move from capture to processing, and encoded updates from each
+// client's encoder to its sender, through bounded single-producer
+// single-consumer rings, and input from all clients to the injection
+// thread through a multi-producer one. Pushing and popping take no lock; a
+// stage that finds its ring empty (or full) sleeps on a Doorbell that the
+// other side rings after every push (or pop).
+
+template <typename T> class SpscQueue {
+public:
+  explicit SpscQueue(size_t capacity) : slots(capacity + 1) {}
+
+  // Moves `item` in; false (and `item` untouched) when full
+  bool TryPush(T &item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t next = t + 1 == slots.size() ? 0 : t + 1;
+    if (next == head.load(std::memory_order_acquire))
+      return false;
+    slots[t] = std::move(item);
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPop(T &item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+    item = std::move(slots[h]);
+    head.store(h + 1 == slots.size() ? 0 : h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate while the other side is active
+  size_t Size() const {
+    size_t h = head.load(std::memory_order_acquire);
+    size_t t = tail.load(std::memory_order_acquire);
+    return t >= h ? t - h : t + slots.size() - h;
+  }
+  size_t Capacity() const { return slots.size() - 1; }
+
+private:
+  std::vector<T> slots; // One always empty: full and empty differ
+  alignas(64) std::atomic<size_t> head{0}; // Next to pop
+  alignas(64) std::atomic<size_t> tail{0}; // Next to push
+};
+
+// Many producers, one consumer (Vyukov's bounded queue). Each slot carries
+// a sequence number saying whose turn it is; producers claim slots with a
+// compare-and-swap on the tail, so items come out in the order they were
+// claimed, whichever thread pushed them.
+template <typename T> class MpscQueue {
+public:
+  // Capacity is rounded up to a power of two
+  explicit MpscQueue(size_t capacity) : cells(RoundUp(capacity)) {
+    mask = cells.size() - 1;
+    for (size_t i = 0; i < cells.size(); i++)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  // Moves `item` in; false (and `item` untouched) when full
+  bool TryPush(T &item) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[pos & mask];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+          cell.value = std::move(item);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Consumer only
+  bool TryPop(T &item) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    Cell &cell = cells[pos & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+      return false;
+    item = std::move(cell.value);
+    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+    head.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate while producers are active
+  size_t Size() const {
+    size_t h = head.load(std::memory_order_acquire);
+    size_t t = tail.load(std::memory_order_acquire);
+    return t > h ? t - h : 0;
+  }
+  size_t Capacity() const { return cells.size(); }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence{0};
+    T value;
+  };
+
+  static size_t RoundUp(size_t n) {
+    size_t size = 2;
+    while (size < n)
+      size *= 2;
+    return size;
+  }
+
+  std::vector<Cell> cells;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head{0}; // Next to pop
+  alignas(64) std::atomic<size_t> tail{0}; // Next to claim
+};
+
+// Wakes a thread sleeping on a queue. A ring that comes before the wait is
+// kept, so checking the queue and then waiting loses nothing.
+class Doorbell {
+public:
+  void Ring() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      rung = true;
+    }
+    cv.notify_one();
+  }
+
+  void Wait(std::chrono::steady_clock::duration timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait_for(lock, timeout, [this] { return rung; });
+    rung = false;
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool rung = false;
+};
+
+// One stage's numbers for getStats(). Several threads may record into
+// one stage (every client thread encodes); readers only load.
+struct StageStats {
+  std::atomic<uint64_t> items{0};
+  std::atomic<double> busyMs{0};    // Smoothed work per item
+  std::atomic<double> latencyMs{0}; // Smoothed time from capture to done
+
+  void Record(double busy, double latency) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool first = items++ == 0;
+    busyMs = first ? busy : busyMs * 0.9 + busy * 0.1;
+    latencyMs = first ? latency : latencyMs * 0.9 + latency * 0.1;
+  }
+
+private:
+  std::mutex mutex; // Orders the read-modify-writes of concurrent samples
+};
@@ -0,0 +1,178 @@
+#include "png_encoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+#include "simd.h"
+
+// --- Helpers ---
+
+static void WriteU32BE(uint8_t *p, uint32_t v) {
+  p[0] = (v >> 24) & 0xFF;
+  p[1] = (v >> 16) & 0xFF;
+  p[2] = (v >> 8) & 0xFF;
+  p[3] = v & 0xFF;
+}
+
+static void AppendChunk(std::vector<uint8_t> &out, const char *type,
+                        const uint8_t *data, uint32_t len) {
+  size_t start = out.size();
+  out.resize(start + 12 + len);
+  uint8_t *p = &out[start];
+  WriteU32BE(p, len);
+  memcpy(p + 4, type, 4);
+  if (len > 0)
+    memcpy(p + 8, data, len);
+  WriteU32BE(p + 8 + len, crc32(0, p + 4, len + 4));
+}
+
+// Sum of |filtered byte| (as signed), the classic libpng filter heuristic
+static uint32_t RowCost(const uint8_t *row, int len) {
+  uint32_t sum = 0;
+  int i = 0;
+#ifdef VNC_HAVE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+    // |v| for signed bytes == min(v, -v) as unsigned bytes
+    __m128i a = _mm_min_epu8(v, _mm_sub_epi8(zero, v));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(a, zero));
+  }
+  sum = (uint32_t)_mm_cvtsi128_si32(acc) +
+        (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+  for (; i < len; i++) {
+    uint8_t v = row[i];
+    sum += v < 128 ? v : 256 - v;
+  }
+  return sum;
+}
+
+// Sub: dst[i] = cur[i] - cur[i - bpp]
+static void FilterSub(const uint8_t *cur, uint8_t *dst, int len, int bpp) {
+  memcpy(dst, cur, bpp);
+  int i = bpp;
+#ifdef VNC_HAVE_SSE2
+  for (; i + 16 <= len; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(cur + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(cur + i - bpp));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_sub_epi8(a, b));
+  }
+#endif
+  for (; i < len; i++)
+    dst[i] = cur[i] - cur[i - bpp];
+}
+
+// Up: dst[i] = cur[i] - prev[i]
+static void FilterUp(const uint8_t *cur, const uint8_t *prev, uint8_t *dst,
+                     int len) {
+  int i = 0;
+#ifdef VNC_HAVE_SSE2
+  for (; i + 16 <= len; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(cur + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(prev + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_sub_epi8(a, b));
+  }
+#endif
+  for (; i < len; i++)
+    dst[i] = cur[i] - prev[i];
+}
+
+// --- Encoder ---
+
+bool EncodePNG(const uint8_t *rgba, int stride, int w, int h, int zlibLevel,
+               std::vector<uint8_t> &out) {
+  if (w <= 0 || h <= 0)
+    return false;
+
+  const int bpp = 3;
+  const int rowLen = w * bpp;
+  const size_t start = out.size();
+
+  static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  out.insert(out.end(), signature, signature + 8);
+
+  // IHDR: width, height, bit depth 8, color type 2 (RGB), no interlace
+  uint8_t ihdr[13];
+  WriteU32BE(ihdr, w);
+  WriteU32BE(ihdr + 4, h);
+  ihdr[8] = 8;
+  ihdr[9] = 2;
+  ihdr[10] = 0;
+  ihdr[11] = 0;
+  ihdr[12] = 0;
+  AppendChunk(out, "IHDR", ihdr, 13);
+
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  int level = std::max(1, std::min(zlibLevel, 9));
+  int strategy = zlibLevel <= 1 ? Z_RLE : Z_DEFAULT_STRATEGY;
+  if (deflateInit2(&zs, level, Z_DEFLATED, 15, 8, strategy) != Z_OK) {
+    out.resize(start);
+    return false;
+  }
+
+  // Single IDAT chunk sized by deflateBound; length + CRC patched at the end
+  size_t idatStart = out.size();
+  uLong bound = deflateBound(&zs, (uLong)(rowLen + 1) * h);
+  out.resize(idatStart + 8 + bound);
+  zs.next_out = &out[idatStart + 8];
+  zs.avail_out = (uInt)bound;
+
+  // Each candidate row carries its filter-type byte up front
+  std::vector<uint8_t> curBuf(rowLen + 1), prevBuf(rowLen + 1, 0);
+  std::vector<uint8_t> subBuf(rowLen + 1), upBuf(rowLen + 1);
+  curBuf[0] = 0;
+  subBuf[0] = 1;
+  upBuf[0] = 2;
+
+  bool ok = true;
+  for (int y = 0; y < h && ok; y++) {
+    const uint8_t *src = rgba + (size_t)y * stride;
+    uint8_t *cur = curBuf.data() + 1;
+    for (int x = 0; x < w; x++) {
+      cur[x * 3 + 0] = src[x * 4 + 0];
+      cur[x * 3 + 1] = src[x * 4 + 1];
+      cur[x * 3 + 2] = src[x * 4 + 2];
+    }
+
+    FilterSub(cur, subBuf.data() + 1, rowLen, bpp);
+    uint8_t *best = curBuf.data();
+    uint32_t bestCost = RowCost(cur, rowLen);
+    uint32_t cost = RowCost(subBuf.data() + 1, rowLen);
+    if (cost < bestCost) {
+      best = subBuf.data();
+      bestCost = cost;
+    }
+    if (y > 0) {
+      FilterUp(cur, prevBuf.data() + 1, upBuf.data() + 1, rowLen);
+      cost = RowCost(upBuf.data() + 1, rowLen);
+      if (cost < bestCost)
+        best = upBuf.data();
+    }
+
+    zs.next_in = best;
+    zs.avail_in = rowLen + 1;
+    ok = deflate(&zs, Z_NO_FLUSH) == Z_OK && zs.avail_in == 0;
+    curBuf.swap(prevBuf);
+    curBuf[0] = 0;
+  }
+  ok = ok && deflate(&zs, Z_FINISH) == Z_STREAM_END;
+  uint32_t idatLen = (uint32_t)zs.total_out;
+  deflateEnd(&zs);
+  if (!ok) {
+    out.resize(start);
+    return false;
+  }
+
+  out.resize(idatStart + 8 + idatLen + 4);
+  uint8_t *idat = &out[idatStart];
+  WriteU32BE(idat, idatLen);
+  memcpy(idat + 4, "IDAT", 4);
+  WriteU32BE(idat + 8 + idatLen, crc32(0, idat + 4, idatLen + 4));
+
+  AppendChunk(out, "IEND", nullptr, 0);
+  return true;
+}
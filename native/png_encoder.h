@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Encodes an RGBA (alpha ignored) region as an 8-bit RGB PNG, appending the
+// file to `out`. Rows are filtered one at a time (None/Sub/Up, chosen per row
+// by the minimum-sum-of-absolute-differences heuristic) and streamed straight
+// into deflate, so no full-size intermediate image is ever built.
+// `zlibLevel` 0-1 selects the fast run-length strategy.
+bool EncodePNG(const uint8_t *rgba, int stride, int w, int h, int zlibLevel,
+               std::vector<uint8_t> &out);
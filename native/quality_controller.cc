@@ -0,0 +1,163 @@
+#include "quality_controller.h"
+
+#include <algorithm>
+
+// Default latency budgets per mode
+const int QUALITY_LATENCY_BUDGET_MS = 80;
+const int QUALITY_QUALITY_BUDGET_MS = 250;
+
+// Agreeing samples needed before a step: quick to back off, slow to push
+const int QUALITY_STEP_DOWN_SAMPLES = 2;
+const int QUALITY_STEP_UP_SAMPLES = 8;
+
+// Frame-rate rungs
+const int QUALITY_FPS_STEPS[] = {5, 10, 15, 20, 30, 45, 60};
+const int QUALITY_FPS_STEP_COUNT =
+    sizeof(QUALITY_FPS_STEPS) / sizeof(QUALITY_FPS_STEPS[0]);
+
+QualityController::QualityController() { SetBounds(QualityBounds()); }
+
+void QualityController::SetBounds(const QualityBounds &b) {
+  bounds = b;
+  bounds.minQualityLevel = std::max(0, std::min(bounds.minQualityLevel, 9));
+  bounds.maxQualityLevel =
+      std::max(bounds.minQualityLevel, std::min(bounds.maxQualityLevel, 9));
+  bounds.minCompressLevel = std::max(0, std::min(bounds.minCompressLevel, 9));
+  bounds.maxCompressLevel =
+      std::max(bounds.minCompressLevel, std::min(bounds.maxCompressLevel, 9));
+  bounds.minFps = std::max(1, bounds.minFps);
+  bounds.maxFps = std::max(bounds.minFps, bounds.maxFps);
+
+  // Start at the best the bounds allow and let the loop find the level
+  qualityLevel = bounds.maxQualityLevel;
+  compressLevel = -1;
+  fps = bounds.maxFps;
+  overCount = 0;
+  underCount = 0;
+}
+
+int QualityController::BudgetMs() const {
+  if (bounds.latencyMs > 0)
+    return bounds.latencyMs;
+  return bounds.mode == QUALITY_MODE_LATENCY ? QUALITY_LATENCY_BUDGET_MS
+                                             : QUALITY_QUALITY_BUDGET_MS;
+}
+
+int QualityController::QualityLevel(int client) const {
+  if (client < 0)
+    return -1;
+  return std::max(bounds.minQualityLevel,
+                  std::min(std::min(client, qualityLevel),
+                           bounds.maxQualityLevel));
+}
+
+int QualityController::CompressLevel(int client) const {
+  int level = compressLevel >= 0 ? compressLevel : client;
+  return std::max(bounds.minCompressLevel,
+                  std::min(level, bounds.maxCompressLevel));
+}
+
+// --- Rungs ---
+
+bool QualityController::StepQuality(int delta) {
+  if (clientQuality < 0)
+    return false; // Lossless client: no JPEG to trade
+  // Step from what the client actually gets, not from an unused ceiling
+  int current = QualityLevel(clientQuality);
+  int ceiling = std::min(clientQuality, bounds.maxQualityLevel);
+  int next = std::max(bounds.minQualityLevel,
+                      std::min(current + delta, ceiling));
+  if (next == current)
+    return false;
+  qualityLevel = next;
+  return true;
+}
+
+bool QualityController::StepCompress(int delta) {
+  int current = CompressLevel(clientCompress);
+  int next = std::max(bounds.minCompressLevel,
+                      std::min(current + delta, bounds.maxCompressLevel));
+  if (next == current)
+    return false;
+  compressLevel = next;
+  return true;
+}
+
+bool QualityController::StepFps(int delta) {
+  int i = 0;
+  while (i < QUALITY_FPS_STEP_COUNT - 1 && QUALITY_FPS_STEPS[i] < fps)
+    i++;
+  int next = QUALITY_FPS_STEPS[std::max(
+      0, std::min(i + delta, QUALITY_FPS_STEP_COUNT - 1))];
+  next = std::max(bounds.minFps, std::min(next, bounds.maxFps));
+  if (next == fps)
+    return false;
+  fps = next;
+  return true;
+}
+
+void QualityController::StepDown(bool encodeBound) {
+  // Encoder can't keep up: cheaper compression before anything visible
+  if (encodeBound && StepCompress(-1))
+    return;
+  if (bounds.mode == QUALITY_MODE_LATENCY) {
+    if (StepQuality(-1) || StepFps(-1))
+      return;
+  } else {
+    if (StepFps(-1) || StepQuality(-1))
+      return;
+  }
+  // Link-bound with nothing left to give: spend CPU on smaller output
+  if (!encodeBound)
+    StepCompress(1);
+}
+
+void QualityController::StepUp(bool encodeBound) {
+  // Undo in the reverse order of StepDown: what the mode values comes first
+  if (bounds.mode == QUALITY_MODE_LATENCY) {
+    if (StepFps(1) || StepQuality(1))
+      return;
+  } else {
+    if (StepQuality(1) || StepFps(1))
+      return;
+  }
+  // Give back compression taken from a slow encoder, up to the client's
+  // own choice
+  if (!encodeBound && CompressLevel(clientCompress) < clientCompress)
+    StepCompress(1);
+}
+
+// --- Loop ---
+
+void QualityController::Update(double encodeSeconds, double sendSeconds,
+                               double turnaroundSeconds, double rttSeconds,
+                               int quality, int compress) {
+  clientQuality = quality;
+  clientCompress = compress;
+
+  double sample = encodeSeconds + sendSeconds + turnaroundSeconds;
+  latency = latency > 0 ? latency * 0.7 + sample * 0.3 : sample;
+
+  // Time on the wire beyond the round trip vs time spent encoding
+  double transfer =
+      sendSeconds + std::max(0.0, turnaroundSeconds - rttSeconds);
+  bool encodeBound = encodeSeconds > transfer;
+
+  double budget = BudgetMs() / 1000.0;
+  if (latency > budget) {
+    underCount = 0;
+    if (++overCount >= QUALITY_STEP_DOWN_SAMPLES) {
+      StepDown(encodeBound);
+      overCount = 0;
+    }
+  } else if (latency < budget / 2) {
+    overCount = 0;
+    if (++underCount >= QUALITY_STEP_UP_SAMPLES) {
+      StepUp(encodeBound);
+      underCount = 0;
+    }
+  } else {
+    overCount = 0;
+    underCount = 0;
+  }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "rfb.h"
+
+// --- Adaptive quality ---
+//
+// Per-client closed loop around a latency budget. Latency is what one
+// update costs end to end: encode time, the time send() blocks while the
+// socket buffer drains, and the turnaround until the client asks again
+// (RTT + client decode). Over budget
+// steps down one rung, well under budget steps back up; the dead band
+// between half the budget and the budget, and needing several agreeing
+// samples (more to go up than down), keep it from oscillating.
+//
+// Which knob moves depends on where the time goes: encode-bound lowers the
+// zlib level, link-bound trades JPEG quality and frame rate in the order
+// the mode prefers. Pixel depth is the client's choice (SetPixelFormat)
+// and is not one of the knobs.
+
+enum QualityMode { QUALITY_MODE_QUALITY, QUALITY_MODE_LATENCY };
+
+struct QualityBounds {
+  QualityMode mode = QUALITY_MODE_QUALITY;
+  int minQualityLevel = 0; // Tight levels 0-9
+  int maxQualityLevel = 9;
+  int minCompressLevel = 0;
+  int maxCompressLevel = 9;
+  int minFps = 5;
+  int maxFps = 30;
+  int latencyMs = 0; // 0 = the mode's default
+};
+
+class QualityController {
+public:
+  QualityController();
+
+  void SetBounds(const QualityBounds &bounds);
+
+  // One sample per update. `turnaround` is from the end of the send until
+  // the next FramebufferUpdateRequest, `rtt` the smallest turnaround seen.
+  // The client's levels anchor the first adjustment.
+  void Update(double encodeSeconds, double sendSeconds,
+              double turnaroundSeconds, double rttSeconds, int clientQuality,
+              int clientCompress);
+
+  // The client's settings capped by the controller. Lossless-only clients
+  // (quality -1) stay lossless; quality never exceeds what the client
+  // asked for.
+  int QualityLevel(int clientLevel) const;
+  int CompressLevel(int clientLevel) const;
+
+  int Fps() const { return fps; }
+  double LatencyMs() const { return latency * 1000; }
+  int BudgetMs() const;
+
+private:
+  bool StepQuality(int delta);
+  bool StepCompress(int delta);
+  bool StepFps(int delta);
+  void StepDown(bool encodeBound);
+  void StepUp(bool encodeBound);
+
+  QualityBounds bounds;
+  int qualityLevel = 9;
+  int compressLevel = -1; // -1 = the client's own until first adjusted
+  int clientQuality = -1;
+  int clientCompress = 1;
+  int fps = 30;
+  double latency = 0; // Smoothed, seconds
+  int overCount = 0;
+  int underCount = 0;
+};
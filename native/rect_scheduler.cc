@@ -0,0 +1,77 @@
+#include "rect_scheduler.h"
+
+#include <algorithm>
+#include <set>
+#include <tuple>
+
+void RectScheduler::Sent(size_t bytes, long long pixels) {
+  // Tiny updates are mostly headers and say little about the content
+  if (pixels < 4096 || bytes == 0)
+    return;
+  double sample = (double)bytes / pixels;
+  bytesPerPixel =
+      bytesPerPixel > 0 ? bytesPerPixel * 0.7 + sample * 0.3 : sample;
+}
+
+void RectScheduler::Schedule(std::vector<Rect> &rects,
+                             const std::vector<Rect> &focus,
+                             const std::vector<Rect> &busy,
+                             size_t budgetBytes, int tileW, int tileH,
+                             std::vector<Rect> &deferred) const {
+  struct Entry {
+    Rect rect;
+    int priority;
+    long long area; // Of the damage the piece came from
+  };
+  auto inFocus = [&](const Rect &r) {
+    for (const auto &f : focus)
+      if (RectsIntersect(r, f))
+        return true;
+    return false;
+  };
+  std::vector<Entry> entries;
+  for (const auto &r : rects) {
+    long long area = (long long)r.w * r.h;
+    long long busyArea = 0;
+    for (const auto &b : busy) {
+      Rect overlap = IntersectRect(r, b);
+      busyArea += (long long)overlap.w * overlap.h;
+    }
+    int priority = area <= SMALL_RECT_PIXELS ? SMALL
+                   : busyArea * 2 > area     ? BUSY
+                                             : LARGE;
+    // Large rects are cut along the encoder's tile grid: the tiles near
+    // the focus go first, and whole tiles can be left for later
+    std::vector<Rect> pieces;
+    if (priority == SMALL)
+      pieces.push_back(r);
+    else
+      SplitIntoTiles(r, tileW, tileH, pieces);
+    for (const auto &p : pieces)
+      entries.push_back({p, inFocus(p) ? (int)FOCUS : priority, area});
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const Entry &a, const Entry &b) {
+                     if (a.priority != b.priority)
+                       return a.priority < b.priority;
+                     return a.area < b.area;
+                   });
+
+  rects.clear();
+  double budget = budgetBytes > 0 && bytesPerPixel > 0
+                      ? budgetBytes / bytesPerPixel
+                      : -1; // In pixels
+  double pixels = 0;
+  // Damage left over from earlier updates can repeat newer damage
+  std::set<std::tuple<int, int, int, int>> seen;
+  for (const auto &e : entries) {
+    if (!seen.insert(std::make_tuple(e.rect.x, e.rect.y, e.rect.w, e.rect.h))
+             .second)
+      continue;
+    pixels += (double)e.rect.w * e.rect.h;
+    if (budget >= 0 && pixels > budget && !rects.empty())
+      deferred.push_back(e.rect);
+    else
+      rects.push_back(e.rect);
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "rfb.h"
+
+// --- Update scheduling ---
+//
+// Per-client ordering of an update's rects by what the viewer notices
+// first: the area they work in, then small changes (text, controls), then
+// large ones, with areas that change constantly (video, animations) last.
+// On a link that cannot carry the whole update within a couple of frames
+// the tail is cut off and handed back, to go out with the next update once
+// the more important parts have arrived.
+class RectScheduler {
+public:
+  // Learns what a pixel costs from an update that went out
+  void Sent(size_t bytes, long long pixels);
+
+  // Sorts `rects` (large ones cut along the tileW x tileH grid) and moves
+  // whatever exceeds about `budgetBytes` into `deferred`. 0 = no budget;
+  // the first rect always stays. `busy` are disjoint regions that change
+  // constantly.
+  void Schedule(std::vector<Rect> &rects, const std::vector<Rect> &focus,
+                const std::vector<Rect> &busy, size_t budgetBytes, int tileW,
+                int tileH, std::vector<Rect> &deferred) const;
+
+  double BytesPerPixel() const { return bytesPerPixel; }
+
+private:
+  static constexpr int SMALL_RECT_PIXELS = 128 * 128;
+
+  enum Priority { FOCUS, SMALL, LARGE, BUSY };
+
+  double bytesPerPixel = 0; // 0 until the first update
+};
@@ -0,0 +1,78 @@
+#include "refinement_tracker.h"
+
+#include <algorithm>
+
+void RefinementTracker::Resize(int w, int h) {
+  if (w == fbW && h == fbH)
+    return;
+  fbW = w;
+  fbH = h;
+  gridW = (w + TILE_SIZE - 1) / TILE_SIZE;
+  gridH = (h + TILE_SIZE - 1) / TILE_SIZE;
+  lossySince.assign((size_t)gridW * gridH, Clock::time_point());
+  pending = 0;
+}
+
+void RefinementTracker::MarkSent(const Rect &r, bool lossy) {
+  if (r.w <= 0 || r.h <= 0 || lossySince.empty())
+    return;
+  int x0 = std::max(0, r.x) / TILE_SIZE;
+  int y0 = std::max(0, r.y) / TILE_SIZE;
+  int x1 = (std::min(fbW, r.x + r.w) - 1) / TILE_SIZE;
+  int y1 = (std::min(fbH, r.y + r.h) - 1) / TILE_SIZE;
+  Clock::time_point now = Clock::now();
+
+  for (int ty = y0; ty <= y1; ty++) {
+    for (int tx = x0; tx <= x1; tx++) {
+      Clock::time_point &since = lossySince[(size_t)ty * gridW + tx];
+      bool wasLossy = since != Clock::time_point();
+      if (lossy) {
+        since = now;
+        pending += !wasLossy;
+        continue;
+      }
+      // Partly repainted tiles still hold lossy pixels elsewhere
+      Rect tile = {tx * TILE_SIZE, ty * TILE_SIZE,
+                   std::min(TILE_SIZE, fbW - tx * TILE_SIZE),
+                   std::min(TILE_SIZE, fbH - ty * TILE_SIZE)};
+      bool covered = r.x <= tile.x && r.y <= tile.y &&
+                     r.x + r.w >= tile.x + tile.w &&
+                     r.y + r.h >= tile.y + tile.h;
+      if (covered && wasLossy) {
+        since = Clock::time_point();
+        pending--;
+      }
+    }
+  }
+}
+
+void RefinementTracker::TakeDue(Clock::duration delay, int maxPixels,
+                                std::vector<Rect> &out) {
+  if (pending == 0)
+    return;
+  Clock::time_point now = Clock::now();
+  int pixels = 0;
+
+  for (int ty = 0; ty < gridH && pixels < maxPixels; ty++) {
+    int runStart = -1;
+    for (int tx = 0; tx <= gridW; tx++) {
+      bool due = false;
+      if (tx < gridW) {
+        Clock::time_point since = lossySince[(size_t)ty * gridW + tx];
+        due = since != Clock::time_point() && now - since >= delay;
+      }
+      if (due && runStart < 0)
+        runStart = tx;
+      if (!due && runStart >= 0) {
+        Rect r = {runStart * TILE_SIZE, ty * TILE_SIZE, 0,
+                  std::min(TILE_SIZE, fbH - ty * TILE_SIZE)};
+        r.w = std::min(tx * TILE_SIZE, fbW) - r.x;
+        out.push_back(r);
+        pixels += r.w * r.h;
+        runStart = -1;
+        if (pixels >= maxPixels)
+          break;
+      }
+    }
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "rfb.h"
+
+// --- Lossy-then-lossless refinement ---
+//
+// Per-client record of which parts of the client's framebuffer were last
+// sent lossy (JPEG, H.264). Once such a tile has not been resent for a
+// while it is static, and an idle link can afford to replace it with a
+// lossless copy: fast updates while content moves, exact pixels once it
+// settles.
+class RefinementTracker {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  // Drops all state when the framebuffer size changes
+  void Resize(int fbW, int fbH);
+
+  // A lossy send marks every tile `r` touches; a lossless one only clears
+  // the tiles it covers completely
+  void MarkSent(const Rect &r, bool lossy);
+
+  // Lossy tiles untouched for at least `delay`, merged into row runs, up to
+  // about `maxPixels` in total
+  void TakeDue(Clock::duration delay, int maxPixels, std::vector<Rect> &out);
+
+  bool Pending() const { return pending > 0; }
+
+private:
+  static constexpr int TILE_SIZE = 64;
+
+  int fbW = 0;
+  int fbH = 0;
+  int gridW = 0;
+  int gridH = 0;
+  std::vector<Clock::time_point> lossySince; // epoch = sent lossless
+  int pending = 0;
+};
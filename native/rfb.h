@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// --- RFB Protocol Definitions ---
+
+struct Rect {
+  int x, y, w, h;
+};
+
+// --- Rect Helpers ---
+
+inline bool RectsIntersect(const Rect &a, const Rect &b) {
+  return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h &&
+         b.y < a.y + a.h;
+}
+
+inline bool SameRect(const Rect &a, const Rect &b) {
+  return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+inline Rect ClipRect(const Rect &r, int fbW, int fbH) {
+  int x0 = std::max(r.x, 0), y0 = std::max(r.y, 0);
+  int x1 = std::min(r.x + r.w, fbW), y1 = std::min(r.y + r.h, fbH);
+  return {x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)};
+}
+
+// Appends the parts of `r` outside `cut` (at most 4 rects) to `out`
+inline void SubtractRect(const Rect &r, const Rect &cut,
+                         std::vector<Rect> &out) {
+  if (!RectsIntersect(r, cut)) {
+    out.push_back(r);
+    return;
+  }
+  int top = std::max(r.y, cut.y);
+  int bottom = std::min(r.y + r.h, cut.y + cut.h);
+  if (cut.y > r.y)
+    out.push_back({r.x, r.y, r.w, cut.y - r.y});
+  if (cut.y + cut.h < r.y + r.h)
+    out.push_back({r.x, bottom, r.w, r.y + r.h - bottom});
+  if (cut.x > r.x)
+    out.push_back({r.x, top, cut.x - r.x, bottom - top});
+  if (cut.x + cut.w < r.x + r.w)
+    out.push_back({cut.x + cut.w, top, r.x + r.w - (cut.x + cut.w),
+                   bottom - top});
+}
+
+inline Rect IntersectRect(const Rect &a, const Rect &b) {
+  int x0 = std::max(a.x, b.x), y0 = std::max(a.y, b.y);
+  int x1 = std::min(a.x + a.w, b.x + b.w), y1 = std::min(a.y + a.h, b.y + b.h);
+  return {x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)};
+}
+
+// Smallest rect covering both
+inline Rect UnionRect(const Rect &a, const Rect &b) {
+  int x0 = std::min(a.x, b.x), y0 = std::min(a.y, b.y);
+  int x1 = std::max(a.x + a.w, b.x + b.w), y1 = std::max(a.y + a.h, b.y + b.h);
+  return {x0, y0, x1 - x0, y1 - y0};
+}
+
+// Cuts `r` along a tileW x tileH grid anchored at the framebuffer origin,
+// so overlapping damage from different frames yields the same tiles
+inline void SplitIntoTiles(const Rect &r, int tileW, int tileH,
+                           std::vector<Rect> &out) {
+  for (int y = r.y; y < r.y + r.h;) {
+    int y1 = std::min((y / tileH + 1) * tileH, r.y + r.h);
+    for (int x = r.x; x < r.x + r.w;) {
+      int x1 = std::min((x / tileW + 1) * tileW, r.x + r.w);
+      out.push_back({x, y, x1 - x, y1 - y});
+      x = x1;
+    }
+    y = y1;
+  }
+}
+
+// Encodings
+const int32_t ENCODING_RAW = 0;
+const int32_t ENCODING_RRE = 2;
+const int32_t ENCODING_H264 = 50;
+const int32_t ENCODING_TIGHT_PNG = -260;
+
+// Pseudo-encodings
+const int32_t ENCODING_COMPRESS_LEVEL_0 = -256; // -256..-247 => level 0..9
+const int32_t ENCODING_COMPRESS_LEVEL_9 = -247;
+const int32_t ENCODING_QUALITY_LEVEL_0 = -32; // -32..-23 => level 0..9
+const int32_t ENCODING_QUALITY_LEVEL_9 = -23;
+const int32_t ENCODING_DESKTOP_SIZE = -223;
+const int32_t ENCODING_LAST_RECT = -224;
+const int32_t ENCODING_POINTER_POS = -232;
+const int32_t ENCODING_CURSOR = -239;
+const int32_t ENCODING_XCURSOR = -240;
+const int32_t ENCODING_EXTENDED_DESKTOP_SIZE = -308;
+const int32_t ENCODING_FENCE = -312;
+const int32_t ENCODING_CONTINUOUS_UPDATES = -313;
+
+// Message types of the extensions above
+const uint8_t MSG_END_OF_CONTINUOUS_UPDATES = 150; // Server -> client
+const uint8_t MSG_ENABLE_CONTINUOUS_UPDATES = 150; // Client -> server
+const uint8_t MSG_FENCE = 248;                     // Both directions
+const uint8_t MSG_SET_DESKTOP_SIZE = 251;          // Client -> server
+
+// Fence flags
+const uint32_t FENCE_BLOCK_BEFORE = 1u << 0;
+const uint32_t FENCE_BLOCK_AFTER = 1u << 1;
+const uint32_t FENCE_SYNC_NEXT = 1u << 2;
+const uint32_t FENCE_REQUEST = 1u << 31;
+const int FENCE_MAX_PAYLOAD = 64;
+
+// ExtendedDesktopSize: why the size changed (rect x) and, for a client's
+// SetDesktopSize, how it went (rect y)
+const uint16_t EDS_REASON_SERVER = 0;
+const uint16_t EDS_REASON_CLIENT = 1;
+const uint16_t EDS_STATUS_OK = 0;
+const uint16_t EDS_STATUS_PROHIBITED = 1;
+const uint16_t EDS_STATUS_OUT_OF_RESOURCES = 2;
+const uint16_t EDS_STATUS_INVALID_LAYOUT = 3;
+
+// Big-endian writers for building server messages
+inline void PutU8(std::vector<uint8_t> &buf, uint8_t v) { buf.push_back(v); }
+
+inline void PutU16(std::vector<uint8_t> &buf, uint16_t v) {
+  buf.push_back((v >> 8) & 0xFF);
+  buf.push_back(v & 0xFF);
+}
+
+inline void PutU32(std::vector<uint8_t> &buf, uint32_t v) {
+  buf.push_back((v >> 24) & 0xFF);
+  buf.push_back((v >> 16) & 0xFF);
+  buf.push_back((v >> 8) & 0xFF);
+  buf.push_back(v & 0xFF);
+}
+
+// Fence: [type][padding:3][flags:4][length][payload]
+inline void PutFence(std::vector<uint8_t> &buf, uint32_t flags,
+                     const uint8_t *payload, uint8_t length) {
+  PutU8(buf, MSG_FENCE);
+  PutU8(buf, 0);
+  PutU16(buf, 0);
+  PutU32(buf, flags);
+  PutU8(buf, length);
+  buf.insert(buf.end(), payload, payload + length);
+}
+
+// Rect Header (12 bytes): X, Y, W, H, Encoding
+inline void PutRectHeader(std::vector<uint8_t> &buf, const Rect &r,
+                          int32_t encoding) {
+  PutU16(buf, r.x);
+  PutU16(buf, r.y);
+  PutU16(buf, r.w);
+  PutU16(buf, r.h);
+  PutU32(buf, (uint32_t)encoding);
+}
+
+// DesktopSize (-223): the new size in the header, no payload
+inline void PutDesktopSizeRect(std::vector<uint8_t> &buf, int w, int h) {
+  PutRectHeader(buf, Rect{0, 0, w, h}, ENCODING_DESKTOP_SIZE);
+}
+
+// ExtendedDesktopSize (-308): [screens][padding:3] then per screen
+// [id:4][x:2][y:2][w:2][h:2][flags:4]; ids are indices into `screens`,
+// and no screens means the whole framebuffer is one
+inline void PutExtendedDesktopSizeRect(std::vector<uint8_t> &buf,
+                                       uint16_t reason, uint16_t status,
+                                       int w, int h,
+                                       const std::vector<Rect> &screens) {
+  PutRectHeader(buf, Rect{reason, status, w, h},
+                ENCODING_EXTENDED_DESKTOP_SIZE);
+  std::vector<Rect> layout = screens;
+  if (layout.empty())
+    layout.push_back(Rect{0, 0, w, h});
+  PutU8(buf, (uint8_t)layout.size());
+  PutU8(buf, 0);
+  PutU16(buf, 0);
+  for (size_t i = 0; i < layout.size(); i++) {
+    PutU32(buf, (uint32_t)i);
+    PutU16(buf, layout[i].x);
+    PutU16(buf, layout[i].y);
+    PutU16(buf, layout[i].w);
+    PutU16(buf, layout[i].h);
+    PutU32(buf, 0);
+  }
+}
+
+// Raw (0) rect: header followed by the pixels row by row
+inline void PutRawRect(std::vector<uint8_t> &buf, const uint8_t *fb, int fbW,
+                       const Rect &r) {
+  PutRectHeader(buf, r, ENCODING_RAW);
+  size_t rowBytes = (size_t)r.w * 4;
+  size_t at = buf.size();
+  buf.resize(at + rowBytes * r.h);
+  for (int y = 0; y < r.h; y++)
+    memcpy(&buf[at + y * rowBytes], fb + ((size_t)(r.y + y) * fbW + r.x) * 4,
+           rowBytes);
+}
@@ -0,0 +1,60 @@
+#include "roi_tracker.h"
+
+#include <climits>
+
+void RoiTracker::PointerMoved(int x, int y) {
+  pointerX = x;
+  pointerY = y;
+  pointerAt = Clock::now();
+}
+
+void RoiTracker::KeyPressed() { keyAt = Clock::now(); }
+
+void RoiTracker::Damage(const std::vector<Rect> &rects) {
+  Clock::time_point now = Clock::now();
+  if (now - keyAt > std::chrono::milliseconds(TYPING_ECHO_MS))
+    return;
+  // Other small changes (a clock, a status line) can come along: the caret
+  // moves little per key, so prefer the one closest to the last typing
+  // area, else the smallest
+  bool haveTyping = typing.w > 0;
+  int cx = typing.x + typing.w / 2;
+  int cy = typing.y + typing.h / 2;
+  const Rect *best = nullptr;
+  long long bestScore = LLONG_MAX;
+  for (const auto &r : rects) {
+    long long area = (long long)r.w * r.h;
+    if (area <= 0 || area > TYPING_MAX_PIXELS)
+      continue;
+    long long dx = r.x + r.w / 2 - cx;
+    long long dy = r.y + r.h / 2 - cy;
+    long long score = haveTyping ? dx * dx + dy * dy : area;
+    if (score < bestScore) {
+      bestScore = score;
+      best = &r;
+    }
+  }
+  if (!best)
+    return;
+  typing = {best->x - TYPING_MARGIN, best->y - TYPING_MARGIN,
+            best->w + 2 * TYPING_MARGIN, best->h + 2 * TYPING_MARGIN};
+  typingAt = now;
+}
+
+void RoiTracker::Regions(int fbW, int fbH, std::vector<Rect> &out) const {
+  Clock::time_point now = Clock::now();
+  if (pointerX >= 0 &&
+      now - pointerAt <= std::chrono::milliseconds(POINTER_TTL_MS)) {
+    Rect r = ClipRect(Rect{pointerX - POINTER_RADIUS, pointerY - POINTER_RADIUS,
+                           2 * POINTER_RADIUS, 2 * POINTER_RADIUS},
+                      fbW, fbH);
+    if (r.w > 0 && r.h > 0)
+      out.push_back(r);
+  }
+  if (typing.w > 0 &&
+      now - typingAt <= std::chrono::milliseconds(TYPING_TTL_MS)) {
+    Rect r = ClipRect(typing, fbW, fbH);
+    if (r.w > 0 && r.h > 0)
+      out.push_back(r);
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "rfb.h"
+
+// --- Region of interest ---
+//
+// Per-client guess at where the user is looking: around the pointer they
+// last moved, and where their last keystrokes showed up on screen. Tiles
+// there are sent first, and at a higher quality when the rest of the
+// screen goes out lossy. All coordinates are the client's.
+class RoiTracker {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  void PointerMoved(int x, int y);
+  void KeyPressed();
+
+  // Damage of an update about to be sent. Right after a key press, a small
+  // change is taken for the typed text and caret.
+  void Damage(const std::vector<Rect> &rects);
+
+  // Regions still current, clipped to the framebuffer
+  void Regions(int fbW, int fbH, std::vector<Rect> &out) const;
+
+private:
+  static constexpr int POINTER_RADIUS = 128;
+  static constexpr int TYPING_MARGIN = 48;
+  static constexpr int TYPING_MAX_PIXELS = 256 * 64; // A line of glyphs
+  static constexpr int POINTER_TTL_MS = 5000;
+  static constexpr int TYPING_TTL_MS = 5000;
+  static constexpr int TYPING_ECHO_MS = 300; // Key press to screen change
+
+  int pointerX = -1;
+  int pointerY = -1;
+  Clock::time_point pointerAt;
+  Clock::time_point keyAt;
+  Rect typing = {0, 0, 0, 0};
+  Clock::time_point typingAt;
+};
@@ -0,0 +1,106 @@
+#include "rre_encoder.h"
+
+#include "solid_regions.h"
+
+// --- Helpers ---
+
+// Pixels go out in framebuffer byte order, the same as Raw
+static void PutPixel(std::vector<uint8_t> &out, uint32_t color) {
+  const uint8_t *c = (const uint8_t *)&color;
+  out.insert(out.end(), c, c + 4);
+}
+
+// Most frequent color among a sample of the rect
+static uint32_t GuessBackground(const uint32_t *px, int fbW, const Rect &r) {
+  const int SLOTS = 64;
+  uint32_t colors[SLOTS];
+  int counts[SLOTS] = {0};
+  int used = 0;
+  int stepX = r.w / 16 > 1 ? r.w / 16 : 1;
+  int stepY = r.h / 16 > 1 ? r.h / 16 : 1;
+  for (int y = r.y; y < r.y + r.h; y += stepY) {
+    for (int x = r.x; x < r.x + r.w; x += stepX) {
+      uint32_t c = px[(size_t)y * fbW + x];
+      int i = 0;
+      while (i < used && colors[i] != c)
+        i++;
+      if (i == used) {
+        if (used == SLOTS)
+          continue;
+        colors[used++] = c;
+      }
+      counts[i]++;
+    }
+  }
+  int best = 0;
+  for (int i = 1; i < used; i++)
+    if (counts[i] > counts[best])
+      best = i;
+  return colors[best];
+}
+
+// --- Encoder ---
+
+void PutRreSolidRect(std::vector<uint8_t> &out, const Rect &r,
+                     uint32_t color) {
+  PutRectHeader(out, r, ENCODING_RRE);
+  PutU32(out, 0);
+  PutPixel(out, color);
+}
+
+bool EncodeRreRect(const uint8_t *fb, int fbW, const Rect &r,
+                   std::vector<uint8_t> &out) {
+  const uint32_t *px = (const uint32_t *)fb;
+  uint32_t background = GuessBackground(px, fbW, r);
+
+  // Runs of one non-background color per row; a run identical to one in
+  // the row above extends that subrect downwards
+  struct Subrect {
+    int x, y, w, h;
+    uint32_t color;
+  };
+  std::vector<Subrect> subrects;
+  std::vector<int> open, nextOpen; // Subrects touching the previous row
+  const size_t limit = (size_t)r.w * r.h * 4 / 12; // Raw size in subrects
+
+  for (int y = 0; y < r.h; y++) {
+    const uint32_t *row = px + (size_t)(r.y + y) * fbW + r.x;
+    nextOpen.clear();
+    size_t scan = 0;
+    int x = 0;
+    while (x < r.w) {
+      x += LeadingRun(row + x, r.w - x, background);
+      if (x >= r.w)
+        break;
+      uint32_t color = row[x];
+      int w = LeadingRun(row + x, r.w - x, color);
+
+      while (scan < open.size() && subrects[open[scan]].x < x)
+        scan++;
+      if (scan < open.size() && subrects[open[scan]].x == x &&
+          subrects[open[scan]].w == w && subrects[open[scan]].color == color) {
+        subrects[open[scan]].h++;
+        nextOpen.push_back(open[scan]);
+      } else {
+        if (subrects.size() >= limit)
+          return false;
+        nextOpen.push_back((int)subrects.size());
+        subrects.push_back({x, y, w, 1, color});
+      }
+      x += w;
+    }
+    open.swap(nextOpen);
+  }
+
+  PutRectHeader(out, r, ENCODING_RRE);
+  PutU32(out, (uint32_t)subrects.size());
+  PutPixel(out, background);
+  for (const auto &s : subrects) {
+    PutPixel(out, s.color);
+    PutU16(out, s.x);
+    PutU16(out, s.y);
+    PutU16(out, s.w);
+    PutU16(out, s.h);
+  }
+  return true;
+}
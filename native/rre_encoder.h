@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "rfb.h"
+
+// --- RRE (2) ---
+//
+// A background pixel plus solid subrects. Every RFB viewer implements it,
+// which makes it the baseline way to send solid areas to clients that
+// don't speak Tight; for anything busier than a few flat shapes it loses
+// to Raw, and the encoder declines.
+
+// One solid rect: RRE with no subrects (20 bytes)
+void PutRreSolidRect(std::vector<uint8_t> &out, const Rect &r, uint32_t color);
+
+// Appends `r` as RRE, or returns false (appending nothing) when the
+// subrects would take more room than Raw
+bool EncodeRreRect(const uint8_t *fb, int fbW, const Rect &r,
+                   std::vector<uint8_t> &out);
@@ -0,0 +1,202 @@
+#include "input_sink.h"
+#include "keysym.h"
+
+#include <algorithm>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// --- Key tables ---
+
+struct VkKey {
+  uint32_t keysym;
+  WORD vk;
+  bool extended; // Not the keypad key of the same VK
+};
+
+static const VkKey FUNCTION_KEYS[] = {
+    {0xFE03, VK_RMENU, true}, // ISO_Level3_Shift (AltGr)
+    {0xFF08, VK_BACK, false},
+    {0xFF09, VK_TAB, false},
+    {0xFF0B, VK_CLEAR, false},
+    {0xFF0D, VK_RETURN, false},
+    {0xFF13, VK_PAUSE, false},
+    {0xFF14, VK_SCROLL, false},
+    {0xFF1B, VK_ESCAPE, false},
+    {0xFF50, VK_HOME, true},
+    {0xFF51, VK_LEFT, true},
+    {0xFF52, VK_UP, true},
+    {0xFF53, VK_RIGHT, true},
+    {0xFF54, VK_DOWN, true},
+    {0xFF55, VK_PRIOR, true}, // Page Up
+    {0xFF56, VK_NEXT, true},  // Page Down
+    {0xFF57, VK_END, true},
+    {0xFF60, VK_SELECT, false},
+    {0xFF61, VK_SNAPSHOT, true}, // Print
+    {0xFF62, VK_EXECUTE, false},
+    {0xFF63, VK_INSERT, true},
+    {0xFF67, VK_APPS, true}, // Menu
+    {0xFF6A, VK_HELP, false},
+    {0xFF6B, VK_CANCEL, true}, // Break
+    {0xFF7F, VK_NUMLOCK, true},
+    {0xFF80, VK_SPACE, false}, // Keypad
+    {0xFF89, VK_TAB, false},
+    {0xFF8D, VK_RETURN, true},
+    {0xFF95, VK_HOME, false},
+    {0xFF96, VK_LEFT, false},
+    {0xFF97, VK_UP, false},
+    {0xFF98, VK_RIGHT, false},
+    {0xFF99, VK_DOWN, false},
+    {0xFF9A, VK_PRIOR, false},
+    {0xFF9B, VK_NEXT, false},
+    {0xFF9C, VK_END, false},
+    {0xFF9D, VK_CLEAR, false}, // KP_Begin
+    {0xFF9E, VK_INSERT, false},
+    {0xFF9F, VK_DELETE, false},
+    {0xFFAA, VK_MULTIPLY, false},
+    {0xFFAB, VK_ADD, false},
+    {0xFFAC, VK_SEPARATOR, false},
+    {0xFFAD, VK_SUBTRACT, false},
+    {0xFFAE, VK_DECIMAL, false},
+    {0xFFAF, VK_DIVIDE, true},
+    {0xFFE1, VK_LSHIFT, false},
+    {0xFFE2, VK_RSHIFT, false},
+    {0xFFE3, VK_LCONTROL, false},
+    {0xFFE4, VK_RCONTROL, true},
+    {0xFFE5, VK_CAPITAL, false},
+    {0xFFE7, VK_LWIN, true}, // Meta
+    {0xFFE8, VK_RWIN, true},
+    {0xFFE9, VK_LMENU, false}, // Alt
+    {0xFFEA, VK_RMENU, true},
+    {0xFFEB, VK_LWIN, true}, // Super
+    {0xFFEC, VK_RWIN, true},
+    {0xFFFF, VK_DELETE, true},
+};
+
+// The function block by keysym - KEYSYM_FUNCTION_FIRST; vk 0 = no key
+static const VkKey &FunctionKey(uint32_t keysym) {
+  static const std::vector<VkKey> table = [] {
+    std::vector<VkKey> t(KEYSYM_FUNCTION_COUNT, VkKey{0, 0, false});
+    for (const auto &k : FUNCTION_KEYS)
+      t[k.keysym - KEYSYM_FUNCTION_FIRST] = k;
+    for (int i = 0; i < 10; i++) // KP_0 - KP_9
+      t[0xFFB0 + i - KEYSYM_FUNCTION_FIRST] = {0, (WORD)(VK_NUMPAD0 + i),
+                                               false};
+    for (int i = 0; i < 24; i++) // F1 - F24
+      t[0xFFBE + i - KEYSYM_FUNCTION_FIRST] = {0, (WORD)(VK_F1 + i), false};
+    return t;
+  }();
+  return table[keysym - KEYSYM_FUNCTION_FIRST];
+}
+
+// --- Sink ---
+
+// SendInput: a whole batch in one call. Coordinates are normalized to
+// 0-65535 over the virtual desktop, which spans all monitors.
+class SendInputSink : public InputSink {
+public:
+  const char *Name() const override { return "sendinput"; }
+  void Deliver(const std::vector<InputEvent> &batch) override;
+
+private:
+  void AddKey(const InputEvent &e);
+  void AddPointer(const InputEvent &e, int vsX, int vsY, int vsW, int vsH);
+
+  std::vector<INPUT> inputs;
+};
+
+void SendInputSink::AddKey(const InputEvent &e) {
+  INPUT input = {0};
+  input.type = INPUT_KEYBOARD;
+  input.ki.dwFlags = e.down ? 0 : KEYEVENTF_KEYUP;
+  if (IsFunctionKeysym(e.keysym)) {
+    const VkKey &key = FunctionKey(e.keysym);
+    if (key.vk == 0)
+      return;
+    input.ki.wVk = key.vk;
+    if (key.extended)
+      input.ki.dwFlags |= KEYEVENTF_EXTENDEDKEY;
+    this->inputs.push_back(input);
+    return;
+  }
+  uint32_t ucs = KeysymToUnicode(e.keysym);
+  if (ucs == 0)
+    return;
+  // ASCII as the key that types it (the client sends Shift itself), so
+  // shortcuts like Ctrl+C work; everything else as text
+  SHORT scan = ucs < 0x80 ? VkKeyScanA((char)ucs) : -1;
+  if (scan != -1) {
+    input.ki.wVk = scan & 0xFF;
+    this->inputs.push_back(input);
+    return;
+  }
+  input.ki.dwFlags |= KEYEVENTF_UNICODE;
+  if (ucs > 0xFFFF) {
+    // Surrogate pair
+    ucs -= 0x10000;
+    input.ki.wScan = (WORD)(0xD800 + (ucs >> 10));
+    this->inputs.push_back(input);
+    ucs = 0xDC00 + (ucs & 0x3FF);
+  }
+  input.ki.wScan = (WORD)ucs;
+  this->inputs.push_back(input);
+}
+
+void SendInputSink::AddPointer(const InputEvent &e, int vsX, int vsY,
+                               int vsW, int vsH) {
+  // Left, middle, right
+  static const DWORD BUTTON_DOWN[3] = {MOUSEEVENTF_LEFTDOWN,
+                                       MOUSEEVENTF_MIDDLEDOWN,
+                                       MOUSEEVENTF_RIGHTDOWN};
+  static const DWORD BUTTON_UP[3] = {MOUSEEVENTF_LEFTUP, MOUSEEVENTF_MIDDLEUP,
+                                     MOUSEEVENTF_RIGHTUP};
+
+  // The move always goes first, so a click lands where it was made
+  INPUT move = {0};
+  move.type = INPUT_MOUSE;
+  move.mi.dx = (long)(e.x - vsX) * 65535 / (vsW - 1);
+  move.mi.dy = (long)(e.y - vsY) * 65535 / (vsH - 1);
+  move.mi.dwFlags =
+      MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK | MOUSEEVENTF_MOVE;
+  this->inputs.push_back(move);
+  for (int b = 0; b < INPUT_BUTTONS; b++) {
+    uint8_t bit = 1 << b;
+    bool down = (e.buttons & bit) != 0;
+    if (down == ((e.previousButtons & bit) != 0))
+      continue;
+    INPUT button = {0};
+    button.type = INPUT_MOUSE;
+    if (b < 3) {
+      button.mi.dwFlags = down ? BUTTON_DOWN[b] : BUTTON_UP[b];
+    } else if (down) {
+      // Wheel: one notch per press, up/down then left/right
+      button.mi.dwFlags = b < 5 ? MOUSEEVENTF_WHEEL : MOUSEEVENTF_HWHEEL;
+      button.mi.mouseData =
+          (DWORD)(b == 3 || b == 6 ? WHEEL_DELTA : -WHEEL_DELTA);
+    } else {
+      continue;
+    }
+    this->inputs.push_back(button);
+  }
+}
+
+void SendInputSink::Deliver(const std::vector<InputEvent> &batch) {
+  int vsX = GetSystemMetrics(SM_XVIRTUALSCREEN);
+  int vsY = GetSystemMetrics(SM_YVIRTUALSCREEN);
+  int vsW = std::max(2, GetSystemMetrics(SM_CXVIRTUALSCREEN));
+  int vsH = std::max(2, GetSystemMetrics(SM_CYVIRTUALSCREEN));
+  this->inputs.clear();
+  for (const auto &e : batch) {
+    if (e.type == InputEvent::KEY)
+      AddKey(e);
+    else
+      AddPointer(e, vsX, vsY, vsW, vsH);
+  }
+  if (!this->inputs.empty())
+    ::SendInput((UINT)this->inputs.size(), this->inputs.data(),
+                sizeof(INPUT));
+}
+
+std::unique_ptr<InputSink> CreateSendInputSink() {
+  return std::make_unique<SendInputSink>();
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// SIMD feature detection shared by the pixel-processing modules.
+// SSE2 is baseline on every x64 target we build for (MSVC x64, GCC/Clang
+// x86_64); everything else falls back to the scalar paths.
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VNC_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
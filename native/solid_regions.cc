@@ -0,0 +1,109 @@
+#include "solid_regions.h"
+
+#include <algorithm>
+
+#include "simd.h"
+
+// Smaller solid areas are cheaper left inside the surrounding encode than
+// sent as a separate rect (12-byte header each)
+const int SOLID_MIN_PIXELS = 1024;
+
+int LeadingRun(const uint32_t *row, int n, uint32_t color) {
+  int i = 0;
+#ifdef VNC_HAVE_SSE2
+  const __m128i c = _mm_set1_epi32((int)color);
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, c)));
+    if (mask != 0xF)
+      break;
+  }
+#endif
+  while (i < n && row[i] == color)
+    i++;
+  return i;
+}
+
+int TrailingRun(const uint32_t *row, int n, uint32_t color) {
+  int i = n;
+#ifdef VNC_HAVE_SSE2
+  const __m128i c = _mm_set1_epi32((int)color);
+  for (; i >= 4; i -= 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(row + i - 4));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, c)));
+    if (mask != 0xF)
+      break;
+  }
+#endif
+  while (i > 0 && row[i - 1] == color)
+    i--;
+  return n - i;
+}
+
+// Trims uniform margins off a band of mixed rows
+static void SplitBand(const uint32_t *px, int fbW, const Rect &band,
+                      std::vector<SolidRect> &solids,
+                      std::vector<Rect> &rest) {
+  const uint32_t *first = px + (size_t)band.y * fbW + band.x;
+  uint32_t leftColor = first[0];
+  uint32_t rightColor = first[band.w - 1];
+  int left = band.w, right = band.w;
+  for (int y = 0; y < band.h && (left > 0 || right > 0); y++) {
+    const uint32_t *row = first + (size_t)y * fbW;
+    if (left > 0)
+      left = LeadingRun(row, left, leftColor);
+    if (right > 0)
+      right = TrailingRun(row + band.w - right, right, rightColor);
+  }
+  // Mixed rows can't be uniform end to end
+  if (left + right > band.w)
+    right = band.w - left;
+
+  if (left * band.h < SOLID_MIN_PIXELS)
+    left = 0;
+  if (right * band.h < SOLID_MIN_PIXELS)
+    right = 0;
+  if (left > 0)
+    solids.push_back({{band.x, band.y, left, band.h}, leftColor});
+  if (band.w - left - right > 0)
+    rest.push_back({band.x + left, band.y, band.w - left - right, band.h});
+  if (right > 0)
+    solids.push_back(
+        {{band.x + band.w - right, band.y, right, band.h}, rightColor});
+}
+
+void FindSolidRegions(const uint8_t *fb, int fbW, const Rect &r,
+                      std::vector<SolidRect> &solids,
+                      std::vector<Rect> &rest) {
+  if (r.w <= 0 || r.h <= 0)
+    return;
+  const uint32_t *px = (const uint32_t *)fb;
+
+  // Row bands: runs of single-color rows in one color, and everything else
+  int mixedStart = -1;
+  int y = r.y;
+  while (y < r.y + r.h) {
+    const uint32_t *row = px + (size_t)y * fbW + r.x;
+    uint32_t color = row[0];
+    int runEnd = y;
+    while (runEnd < r.y + r.h &&
+           LeadingRun(px + (size_t)runEnd * fbW + r.x, r.w, color) == r.w)
+      runEnd++;
+
+    if ((runEnd - y) * r.w >= SOLID_MIN_PIXELS) {
+      if (mixedStart >= 0)
+        SplitBand(px, fbW, {r.x, mixedStart, r.w, y - mixedStart}, solids,
+                  rest);
+      mixedStart = -1;
+      solids.push_back({{r.x, y, r.w, runEnd - y}, color});
+      y = runEnd;
+    } else {
+      if (mixedStart < 0)
+        mixedStart = y;
+      y = std::max(runEnd, y + 1);
+    }
+  }
+  if (mixedStart >= 0)
+    SplitBand(px, fbW, {r.x, mixedStart, r.w, r.y + r.h - mixedStart}, solids,
+              rest);
+}
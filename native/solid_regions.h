@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "rfb.h"
+
+// --- Solid-region pre-pass ---
+//
+// Flat backgrounds dominate desktops, and a solid area costs a handful of
+// bytes in any encoding that can describe it (Tight fill, RRE background).
+// One SIMD pass finds the rows of a rect that are a single color and, in
+// the bands between them, uniform margins on the left and right: exactly
+// the shape of a window or text block on a plain background.
+
+struct SolidRect {
+  Rect rect;
+  uint32_t color; // RGBA as stored in the framebuffer
+};
+
+// Splits `r` into solid areas worth sending on their own and the rects
+// (at most three per band) that still need a real encoder
+void FindSolidRegions(const uint8_t *fb, int fbW, const Rect &r,
+                      std::vector<SolidRect> &solids, std::vector<Rect> &rest);
+
+// Pixels at the start / end of `row` equal to `color`
+int LeadingRun(const uint32_t *row, int n, uint32_t color);
+int TrailingRun(const uint32_t *row, int n, uint32_t color);
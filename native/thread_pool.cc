@@ -0,0 +1,182 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::~ThreadPool() { Stop(); }
+
+void ThreadPool::Start(int threads) {
+  Stop();
+  if (threads <= 0)
+    threads = (int)std::max(1u, std::thread::hardware_concurrency());
+  this->stopping = false;
+  for (int i = 0; i < threads - 1; i++)
+    this->workers.push_back(std::make_unique<Worker>());
+  for (int i = 0; i < threads - 1; i++)
+    this->threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+void ThreadPool::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(this->sleepMutex);
+    this->stopping = true;
+  }
+  this->wake.notify_all();
+  for (auto &t : this->threads)
+    t.join();
+  this->threads.clear();
+  this->workers.clear();
+}
+
+// Own deque from the back, everyone else's from the front. `self` -1 is a
+// thread outside the pool: it only steals.
+bool ThreadPool::TakeTask(int self, Task &task) {
+  int n = (int)this->workers.size();
+  if (self >= 0) {
+    Worker &own = *this->workers[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      this->queued--;
+      return true;
+    }
+  }
+  for (int k = 1; k <= n; k++) {
+    int victim = (self + k + n) % n;
+    if (victim == self)
+      continue;
+    Worker &w = *this->workers[victim];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (!w.tasks.empty()) {
+      task = std::move(w.tasks.front());
+      w.tasks.pop_front();
+      this->queued--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(int index) {
+  Task task;
+  while (true) {
+    if (TakeTask(index, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(this->sleepMutex);
+    this->wake.wait(lock,
+                    [this] { return this->stopping || this->queued > 0; });
+    if (this->stopping)
+      return;
+  }
+}
+
+void ThreadPool::Spread(int count, bool lowFirst,
+                        const std::function<void(int)> &fn) {
+  // Spread the batch round-robin; idle workers steal to even it out
+  int n = (int)this->workers.size();
+  unsigned first = this->nextWorker.fetch_add(1);
+  for (int i = 0; i < count; i++) {
+    Worker &w = *this->workers[(first + i) % n];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (lowFirst)
+      w.tasks.push_front([fn, i] { fn(i); });
+    else
+      w.tasks.push_back([fn, i] { fn(i); });
+    this->queued++;
+  }
+  {
+    // Orders the pushes against a worker between its empty check and wait
+    std::lock_guard<std::mutex> lock(this->sleepMutex);
+  }
+  this->wake.notify_all();
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)> &fn) {
+  if (count <= 0)
+    return;
+  if (this->workers.empty() || count == 1) {
+    for (int i = 0; i < count; i++)
+      fn(i);
+    return;
+  }
+
+  struct Batch {
+    std::atomic<int> remaining;
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+  auto batch = std::make_shared<Batch>();
+  batch->remaining = count;
+
+  Spread(count, false, [batch, &fn](int i) {
+    fn(i);
+    if (--batch->remaining == 0) {
+      std::lock_guard<std::mutex> lock(batch->mutex);
+      batch->done.notify_all();
+    }
+  });
+
+  // Help out (possibly with other clients' tiles) until our batch is done
+  Task task;
+  while (batch->remaining > 0) {
+    if (TakeTask(-1, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->done.wait(lock, [&batch] { return batch->remaining == 0; });
+  }
+}
+
+void ThreadPool::ParallelForOrdered(int count,
+                                    const std::function<void(int)> &fn,
+                                    const std::function<void(int)> &ready) {
+  if (count <= 0)
+    return;
+  if (this->workers.empty() || count == 1) {
+    for (int i = 0; i < count; i++) {
+      fn(i);
+      ready(i);
+    }
+    return;
+  }
+
+  struct Batch {
+    std::unique_ptr<std::atomic<bool>[]> finished;
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+  auto batch = std::make_shared<Batch>();
+  batch->finished.reset(new std::atomic<bool>[count]);
+  for (int i = 0; i < count; i++)
+    batch->finished[i] = false;
+
+  Spread(count, true, [batch, &fn](int i) {
+    fn(i);
+    std::lock_guard<std::mutex> lock(batch->mutex);
+    batch->finished[i] = true;
+    batch->done.notify_all();
+  });
+
+  // Hand out results in order; help with queued work while the next one
+  // is still being computed
+  Task task;
+  for (int next = 0; next < count;) {
+    if (batch->finished[next]) {
+      ready(next++);
+      continue;
+    }
+    if (TakeTask(-1, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->done.wait(lock,
+                     [&batch, next] { return batch->finished[next].load(); });
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --- Work-stealing pool ---
+//
+// Shared by all client threads for tile encoding. Each worker owns a deque:
+// it takes its newest task first (warm caches) and, when empty, steals the
+// oldest task of another worker. The thread that calls ParallelFor works
+// through the batch too instead of sleeping, so a pool of N threads has
+// N - 1 workers and a 1-thread pool runs everything inline.
+class ThreadPool {
+public:
+  ~ThreadPool();
+
+  // `threads` 0 = one per hardware thread
+  void Start(int threads);
+  void Stop();
+  int Size() const { return (int)this->threads.size() + 1; }
+
+  // Runs fn(0) .. fn(count - 1) and returns once all of them finished
+  void ParallelFor(int count, const std::function<void(int)> &fn);
+
+  // Same, but calls ready(i) on the calling thread in index order as soon
+  // as fn(0) .. fn(i) are done, so results can be consumed (sent) while
+  // later ones are still being computed
+  void ParallelForOrdered(int count, const std::function<void(int)> &fn,
+                          const std::function<void(int)> &ready);
+
+private:
+  typedef std::function<void()> Task;
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // Queues fn(0) .. fn(count - 1) round-robin; `lowFirst` makes workers
+  // start with the lowest indices instead of their newest tasks
+  void Spread(int count, bool lowFirst, const std::function<void(int)> &fn);
+  bool TakeTask(int self, Task &task);
+  void WorkerLoop(int index);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::atomic<int> queued{0};
+  std::atomic<unsigned> nextWorker{0};
+  bool stopping = false;
+};
@@ -0,0 +1,149 @@
+#include "tight_encoder.h"
+
+#include <algorithm>
+
+#include "content_classifier.h"
+#include "jpeg_encoder.h"
+#include "png_encoder.h"
+#include "solid_regions.h"
+
+// Tight's compact length field tops out at 22 bits (4 MB); bands of this
+// many pixels keep even incompressible PNG payloads well below it.
+const int TIGHT_MAX_RECT_WIDTH = 2048;
+const int TIGHT_MAX_RECT_PIXELS = 2048 * 256;
+
+// JPEG quality per Tight quality level (same curve as TigerVNC)
+static const int TIGHT_JPEG_QUALITY[10] = {15, 29, 41, 42, 62,
+                                           77, 79, 86, 92, 100};
+
+int TightJpegQuality(int qualityLevel) {
+  return TIGHT_JPEG_QUALITY[std::max(0, std::min(qualityLevel, 9))];
+}
+
+// --- Helpers ---
+
+static void PutCompactLength(std::vector<uint8_t> &out, size_t len) {
+  out.push_back((len & 0x7F) | (len > 0x7F ? 0x80 : 0));
+  if (len > 0x7F) {
+    out.push_back(((len >> 7) & 0x7F) | (len > 0x3FFF ? 0x80 : 0));
+    if (len > 0x3FFF)
+      out.push_back((len >> 14) & 0xFF);
+  }
+}
+
+static bool IsSolid(const uint8_t *fb, int fbW, const Rect &r,
+                    uint32_t &color) {
+  const uint32_t *px = (const uint32_t *)fb;
+  color = px[(size_t)r.y * fbW + r.x];
+  for (int y = 0; y < r.h; y++) {
+    const uint32_t *row = px + (size_t)(r.y + y) * fbW + r.x;
+    for (int x = 0; x < r.w; x++) {
+      if (row[x] != color)
+        return false;
+    }
+  }
+  return true;
+}
+
+static void PutFill(std::vector<uint8_t> &out, const Rect &r, uint32_t color) {
+  PutRectHeader(out, r, ENCODING_TIGHT_PNG);
+  const uint8_t *c = (const uint8_t *)&color;
+  PutU8(out, TIGHT_FILL);
+  PutU8(out, c[0]); // TPIXEL: R, G, B
+  PutU8(out, c[1]);
+  PutU8(out, c[2]);
+}
+
+static TileClass EncodeTightPngTile(const uint8_t *fb, int fbW, const Rect &r,
+                                    int qualityLevel, int compressLevel,
+                                    int changes, ClassifierStats *stats,
+                                    std::vector<uint8_t> &out) {
+  size_t start = out.size();
+  TileFeatures features;
+  features.changes = changes;
+  TileClass tileClass = TILE_SOLID;
+
+  uint32_t color;
+  if (IsSolid(fb, fbW, r, color)) {
+    PutFill(out, r, color);
+  } else {
+    const uint8_t *src = fb + ((size_t)r.y * fbW + r.x) * 4;
+    const int stride = fbW * 4;
+    std::vector<uint8_t> data;
+    uint8_t ctl = TIGHT_PNG;
+
+    // Lossy is only an option once the client sent a quality level
+    tileClass = TILE_LOSSLESS;
+    if (qualityLevel >= 0) {
+      MeasureTile(fb, fbW, r, features);
+      tileClass = ClassifyTile(r, features);
+    }
+    if (tileClass == TILE_LOSSY &&
+        EncodeJPEG(src, stride, r.w, r.h, TightJpegQuality(qualityLevel),
+                   data)) {
+      ctl = TIGHT_JPEG;
+    } else if (EncodePNG(src, stride, r.w, r.h, compressLevel, data)) {
+      tileClass = TILE_LOSSLESS;
+    } else {
+      // Raw fallback so a failed image encode never desyncs the rect count
+      tileClass = TILE_LOSSLESS;
+      data.clear();
+      PutRawRect(out, fb, fbW, r);
+    }
+
+    if (!data.empty()) {
+      PutRectHeader(out, r, ENCODING_TIGHT_PNG);
+      PutU8(out, ctl);
+      PutCompactLength(out, data.size());
+      out.insert(out.end(), data.begin(), data.end());
+    }
+  }
+
+  if (stats)
+    stats->Record({r, features, tileClass, out.size() - start});
+  return tileClass;
+}
+
+// --- Encoder ---
+
+int EncodeTightPngRect(const uint8_t *fb, int fbW, const Rect &r,
+                       int qualityLevel, int compressLevel, int changes,
+                       ClassifierStats *stats, std::vector<uint8_t> &out,
+                       bool *lossy) {
+  if (lossy)
+    *lossy = false;
+  if (r.w <= 0 || r.h <= 0)
+    return 0;
+
+  int count = 0;
+  int bandW = std::min(r.w, TIGHT_MAX_RECT_WIDTH);
+  int bandH = std::max(1, TIGHT_MAX_RECT_PIXELS / bandW);
+  for (int y = r.y; y < r.y + r.h; y += bandH) {
+    for (int x = r.x; x < r.x + r.w; x += bandW) {
+      Rect band = {x, y, std::min(bandW, r.x + r.w - x),
+                   std::min(bandH, r.y + r.h - y)};
+
+      // Solid backgrounds and margins become fills before the image codecs
+      // see the rest
+      std::vector<SolidRect> solids;
+      std::vector<Rect> rest;
+      FindSolidRegions(fb, fbW, band, solids, rest);
+      for (const auto &s : solids) {
+        size_t start = out.size();
+        PutFill(out, s.rect, s.color);
+        if (stats)
+          stats->Record({s.rect, TileFeatures(), TILE_SOLID,
+                         out.size() - start});
+        count++;
+      }
+      for (const auto &tile : rest) {
+        if (EncodeTightPngTile(fb, fbW, tile, qualityLevel, compressLevel,
+                               changes, stats, out) == TILE_LOSSY &&
+            lossy)
+          *lossy = true;
+        count++;
+      }
+    }
+  }
+  return count;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "rfb.h"
+
+class ClassifierStats;
+
+// --- TightPNG (-260) ---
+//
+// Every rect is sent as one of three Tight compression types the browser
+// decodes natively: a solid fill, a JPEG, or a PNG. There is no "basic"
+// (zlib) sub-encoding in TightPNG, so no per-client zlib state is kept.
+
+// Tight compression-control byte (upper nibble)
+const uint8_t TIGHT_FILL = 0x80;
+const uint8_t TIGHT_JPEG = 0x90;
+const uint8_t TIGHT_PNG = 0xA0;
+
+// Maps the client's Tight quality level (0-9) to a libjpeg quality
+int TightJpegQuality(int qualityLevel);
+
+// Appends TightPNG rects covering `r` to `out` and returns how many were
+// written (large rects are split into bands). `qualityLevel` is -1 when the
+// client did not enable lossy compression. `changes` is how many of the
+// last 16 frames damaged the area; `stats` may be null. `lossy`, if given,
+// reports whether any part went out as JPEG.
+int EncodeTightPngRect(const uint8_t *fb, int fbW, const Rect &r,
+                       int qualityLevel, int compressLevel, int changes,
+                       ClassifierStats *stats, std::vector<uint8_t> &out,
+                       bool *lossy = nullptr);
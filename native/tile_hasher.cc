@@ -0,0 +1,101 @@
+#include "tile_hasher.h"
+
+#include <algorithm>
+#include <cstring>
+
+// xxHash64 primes: one multiply-rotate round per 8 bytes, four independent
+// lanes so the multiplies overlap
+const uint64_t HASH_PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t HASH_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+
+static inline uint64_t Rotl(uint64_t v, int n) {
+  return (v << n) | (v >> (64 - n));
+}
+
+static inline uint64_t Round(uint64_t acc, uint64_t v) {
+  return Rotl(acc + v * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+static inline uint64_t Load64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+uint64_t HashRect(const uint8_t *fb, int fbW, const Rect &r) {
+  uint64_t lanes[4] = {HASH_PRIME1 + HASH_PRIME2, HASH_PRIME2, 0,
+                       0 - HASH_PRIME1};
+  uint64_t tail = 0;
+  size_t rowBytes = (size_t)r.w * 4;
+  for (int y = r.y; y < r.y + r.h; y++) {
+    const uint8_t *p = fb + ((size_t)y * fbW + r.x) * 4;
+    size_t i = 0;
+    for (; i + 32 <= rowBytes; i += 32) {
+      lanes[0] = Round(lanes[0], Load64(p + i));
+      lanes[1] = Round(lanes[1], Load64(p + i + 8));
+      lanes[2] = Round(lanes[2], Load64(p + i + 16));
+      lanes[3] = Round(lanes[3], Load64(p + i + 24));
+    }
+    // Edge tiles: leftover whole pixels
+    for (; i < rowBytes; i += 4) {
+      uint32_t v;
+      memcpy(&v, p + i, 4);
+      tail = Round(tail, v);
+    }
+  }
+  uint64_t h = Rotl(lanes[0], 1) + Rotl(lanes[1], 7) + Rotl(lanes[2], 12) +
+               Rotl(lanes[3], 18) + tail;
+  h ^= h >> 33;
+  h *= HASH_PRIME2;
+  h ^= h >> 29;
+  return h;
+}
+
+void TileHasher::Invalidate(const Rect &r) {
+  if (known.empty() || r.w <= 0 || r.h <= 0)
+    return;
+  int x0 = std::max(0, r.x / TILE_SIZE);
+  int y0 = std::max(0, r.y / TILE_SIZE);
+  int x1 = std::min(gridW - 1, (r.x + r.w - 1) / TILE_SIZE);
+  int y1 = std::min(gridH - 1, (r.y + r.h - 1) / TILE_SIZE);
+  for (int ty = y0; ty <= y1; ty++)
+    for (int tx = x0; tx <= x1; tx++)
+      known[(size_t)ty * gridW + tx] = 0;
+}
+
+void TileHasher::Update(const uint8_t *fb, int w, int h,
+                        std::vector<Rect> &out) {
+  if (w != fbW || h != fbH) {
+    fbW = w;
+    fbH = h;
+    gridW = (w + TILE_SIZE - 1) / TILE_SIZE;
+    gridH = (h + TILE_SIZE - 1) / TILE_SIZE;
+    hashes.assign((size_t)gridW * gridH, 0);
+    known.assign((size_t)gridW * gridH, 0);
+  }
+  hashedFrames++;
+
+  for (int ty = 0; ty < gridH; ty++) {
+    int runStart = -1;
+    Rect tile = {0, ty * TILE_SIZE, 0, std::min(TILE_SIZE, h - ty * TILE_SIZE)};
+    for (int tx = 0; tx <= gridW; tx++) {
+      bool changed = false;
+      if (tx < gridW) {
+        tile.x = tx * TILE_SIZE;
+        tile.w = std::min(TILE_SIZE, w - tile.x);
+        size_t i = (size_t)ty * gridW + tx;
+        uint64_t hash = HashRect(fb, w, tile);
+        changed = !known[i] || hashes[i] != hash;
+        hashes[i] = hash;
+        known[i] = 1;
+      }
+      if (changed && runStart < 0) {
+        runStart = tx;
+      } else if (!changed && runStart >= 0) {
+        int x = runStart * TILE_SIZE;
+        out.push_back({x, tile.y, std::min(tx * TILE_SIZE, w) - x, tile.h});
+        runStart = -1;
+      }
+    }
+  }
+}
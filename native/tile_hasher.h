@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "rfb.h"
+
+// 64-bit content hash of the pixels of `r`
+uint64_t HashRect(const uint8_t *fb, int fbW, const Rect &r);
+
+// Damage for frames that come without any (X11 grabs, DXGI frames that only
+// moved the pointer): each 64x64 tile is hashed and compared with its hash
+// from the previous generation. That reads the frame once, where comparing
+// against the previous frame reads two; a still screen yields no damage.
+class TileHasher {
+public:
+  // Appends the changed tiles, merged into runs along each tile row
+  void Update(const uint8_t *fb, int fbW, int fbH, std::vector<Rect> &out);
+
+  // Tiles under `r` changed without being hashed (damage from metadata);
+  // they are reported by the next Update
+  void Invalidate(const Rect &r);
+
+  uint64_t HashedFrames() const { return hashedFrames; }
+
+private:
+  static constexpr int TILE_SIZE = 64;
+
+  int fbW = 0;
+  int fbH = 0;
+  int gridW = 0;
+  int gridH = 0;
+  std::vector<uint64_t> hashes;
+  std::vector<uint8_t> known; // 0 = hash stale, report the tile
+  std::atomic<uint64_t> hashedFrames{0};
+};
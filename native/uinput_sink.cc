@@ -0,0 +1,277 @@
+#include "input_sink.h"
+#include "keysym.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// --- Key tables ---
+
+struct EvdevKey {
+  uint32_t keysym;
+  uint16_t code;
+};
+
+static const EvdevKey FUNCTION_KEYS[] = {
+    {0xFE03, KEY_RIGHTALT}, // ISO_Level3_Shift (AltGr)
+    {0xFF08, KEY_BACKSPACE},
+    {0xFF09, KEY_TAB},
+    {0xFF0D, KEY_ENTER},
+    {0xFF13, KEY_PAUSE},
+    {0xFF14, KEY_SCROLLLOCK},
+    {0xFF15, KEY_SYSRQ},
+    {0xFF1B, KEY_ESC},
+    {0xFF50, KEY_HOME},
+    {0xFF51, KEY_LEFT},
+    {0xFF52, KEY_UP},
+    {0xFF53, KEY_RIGHT},
+    {0xFF54, KEY_DOWN},
+    {0xFF55, KEY_PAGEUP},
+    {0xFF56, KEY_PAGEDOWN},
+    {0xFF57, KEY_END},
+    {0xFF61, KEY_SYSRQ}, // Print
+    {0xFF63, KEY_INSERT},
+    {0xFF67, KEY_COMPOSE}, // Menu
+    {0xFF6A, KEY_HELP},
+    {0xFF6B, KEY_PAUSE}, // Break
+    {0xFF7F, KEY_NUMLOCK},
+    {0xFF80, KEY_SPACE}, // Keypad
+    {0xFF89, KEY_TAB},
+    {0xFF8D, KEY_KPENTER},
+    {0xFF95, KEY_KP7},
+    {0xFF96, KEY_KP4},
+    {0xFF97, KEY_KP8},
+    {0xFF98, KEY_KP6},
+    {0xFF99, KEY_KP2},
+    {0xFF9A, KEY_KP9},
+    {0xFF9B, KEY_KP3},
+    {0xFF9C, KEY_KP1},
+    {0xFF9D, KEY_KP5},
+    {0xFF9E, KEY_KP0},
+    {0xFF9F, KEY_KPDOT},
+    {0xFFAA, KEY_KPASTERISK},
+    {0xFFAB, KEY_KPPLUS},
+    {0xFFAC, KEY_KPCOMMA},
+    {0xFFAD, KEY_KPMINUS},
+    {0xFFAE, KEY_KPDOT},
+    {0xFFAF, KEY_KPSLASH},
+    {0xFFB0, KEY_KP0},
+    {0xFFB1, KEY_KP1},
+    {0xFFB2, KEY_KP2},
+    {0xFFB3, KEY_KP3},
+    {0xFFB4, KEY_KP4},
+    {0xFFB5, KEY_KP5},
+    {0xFFB6, KEY_KP6},
+    {0xFFB7, KEY_KP7},
+    {0xFFB8, KEY_KP8},
+    {0xFFB9, KEY_KP9},
+    {0xFFBD, KEY_KPEQUAL},
+    {0xFFC8, KEY_F11},
+    {0xFFC9, KEY_F12},
+    {0xFFE1, KEY_LEFTSHIFT},
+    {0xFFE2, KEY_RIGHTSHIFT},
+    {0xFFE3, KEY_LEFTCTRL},
+    {0xFFE4, KEY_RIGHTCTRL},
+    {0xFFE5, KEY_CAPSLOCK},
+    {0xFFE7, KEY_LEFTMETA}, // Meta
+    {0xFFE8, KEY_RIGHTMETA},
+    {0xFFE9, KEY_LEFTALT},
+    {0xFFEA, KEY_RIGHTALT},
+    {0xFFEB, KEY_LEFTMETA}, // Super
+    {0xFFEC, KEY_RIGHTMETA},
+    {0xFFFF, KEY_DELETE},
+};
+
+// Keys typing 0x20-0x7E on a US layout, Shift left to the client
+static const uint16_t ASCII_KEYS[0x7F - 0x20] = {
+    KEY_SPACE,      KEY_1,         KEY_APOSTROPHE, KEY_3,          // ' '-#
+    KEY_4,          KEY_5,         KEY_7,          KEY_APOSTROPHE, // $-'
+    KEY_9,          KEY_0,         KEY_8,          KEY_EQUAL,      // (-+
+    KEY_COMMA,      KEY_MINUS,     KEY_DOT,        KEY_SLASH,      // ,-/
+    KEY_0,          KEY_1,         KEY_2,          KEY_3,          // 0-3
+    KEY_4,          KEY_5,         KEY_6,          KEY_7,          // 4-7
+    KEY_8,          KEY_9,         KEY_SEMICOLON,  KEY_SEMICOLON,  // 8-;
+    KEY_COMMA,      KEY_EQUAL,     KEY_DOT,        KEY_SLASH,      // <-?
+    KEY_2,          KEY_A,         KEY_B,          KEY_C,          // @-C
+    KEY_D,          KEY_E,         KEY_F,          KEY_G,          // D-G
+    KEY_H,          KEY_I,         KEY_J,          KEY_K,          // H-K
+    KEY_L,          KEY_M,         KEY_N,          KEY_O,          // L-O
+    KEY_P,          KEY_Q,         KEY_R,          KEY_S,          // P-S
+    KEY_T,          KEY_U,         KEY_V,          KEY_W,          // T-W
+    KEY_X,          KEY_Y,         KEY_Z,          KEY_LEFTBRACE,  // X-[
+    KEY_BACKSLASH,  KEY_RIGHTBRACE, KEY_6,         KEY_MINUS,      // \-_
+    KEY_GRAVE,      KEY_A,         KEY_B,          KEY_C,          // `-c
+    KEY_D,          KEY_E,         KEY_F,          KEY_G,          // d-g
+    KEY_H,          KEY_I,         KEY_J,          KEY_K,          // h-k
+    KEY_L,          KEY_M,         KEY_N,          KEY_O,          // l-o
+    KEY_P,          KEY_Q,         KEY_R,          KEY_S,          // p-s
+    KEY_T,          KEY_U,         KEY_V,          KEY_W,          // t-w
+    KEY_X,          KEY_Y,         KEY_Z,          KEY_LEFTBRACE,  // x-{
+    KEY_BACKSLASH,  KEY_RIGHTBRACE, KEY_GRAVE,                     // |-~
+};
+
+// The function block by keysym - KEYSYM_FUNCTION_FIRST; 0 = no key
+static uint16_t FunctionKey(uint32_t keysym) {
+  static const std::vector<uint16_t> table = [] {
+    std::vector<uint16_t> t(KEYSYM_FUNCTION_COUNT, 0);
+    for (const auto &k : FUNCTION_KEYS)
+      t[k.keysym - KEYSYM_FUNCTION_FIRST] = k.code;
+    for (int i = 0; i < 10; i++) // F1 - F10
+      t[0xFFBE + i - KEYSYM_FUNCTION_FIRST] = KEY_F1 + i;
+    for (int i = 0; i < 12; i++) // F13 - F24
+      t[0xFFCA + i - KEYSYM_FUNCTION_FIRST] = KEY_F13 + i;
+    return t;
+  }();
+  return table[keysym - KEYSYM_FUNCTION_FIRST];
+}
+
+// --- Sink ---
+
+// Two virtual devices through /dev/uinput, a keyboard and an absolute
+// pointer, below any display server (X, Wayland or the console). A batch
+// is one write() per run of events for the same device. Key codes follow a
+// US layout, so text beyond ASCII cannot be typed.
+class UinputSink : public InputSink {
+public:
+  ~UinputSink() override;
+
+  bool Initialize();
+
+  const char *Name() const override { return "uinput"; }
+  void SetDesktopSize(int width, int height) override {
+    this->width = std::max(2, width);
+    this->height = std::max(2, height);
+  }
+  void Deliver(const std::vector<InputEvent> &batch) override;
+
+private:
+  static constexpr int ABS_RANGE = 65535;
+
+  static int CreateDevice(const char *name, bool pointer);
+  // Queues an event for `fd`, writing out what was queued for the other
+  // device first: key and pointer events keep their order (Ctrl+click)
+  void Put(int fd, int type, int code, int value);
+  void Flush();
+
+  int keyboard = -1;
+  int pointer = -1;
+  int width = 1920;
+  int height = 1080;
+  int pendingFd = -1;
+  std::vector<input_event> pending;
+};
+
+UinputSink::~UinputSink() {
+  for (int fd : {this->keyboard, this->pointer}) {
+    if (fd < 0)
+      continue;
+    ioctl(fd, UI_DEV_DESTROY);
+    close(fd);
+  }
+}
+
+int UinputSink::CreateDevice(const char *name, bool pointer) {
+  int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  ioctl(fd, UI_SET_EVBIT, EV_SYN);
+  ioctl(fd, UI_SET_EVBIT, EV_KEY);
+  if (pointer) {
+    for (int button : {BTN_LEFT, BTN_RIGHT, BTN_MIDDLE})
+      ioctl(fd, UI_SET_KEYBIT, button);
+    ioctl(fd, UI_SET_EVBIT, EV_REL);
+    ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
+    ioctl(fd, UI_SET_RELBIT, REL_HWHEEL);
+    ioctl(fd, UI_SET_EVBIT, EV_ABS);
+    for (int axis : {ABS_X, ABS_Y}) {
+      uinput_abs_setup abs = {};
+      abs.code = axis;
+      abs.absinfo.maximum = ABS_RANGE;
+      ioctl(fd, UI_ABS_SETUP, &abs);
+    }
+  } else {
+    for (int key = KEY_ESC; key <= KEY_F24; key++)
+      ioctl(fd, UI_SET_KEYBIT, key);
+  }
+  uinput_setup setup = {};
+  setup.id.bustype = BUS_VIRTUAL;
+  strncpy(setup.name, name, UINPUT_MAX_NAME_SIZE - 1);
+  if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool UinputSink::Initialize() {
+  this->keyboard = CreateDevice("VNC keyboard", false);
+  this->pointer = CreateDevice("VNC pointer", true);
+  return this->keyboard >= 0 && this->pointer >= 0;
+}
+
+void UinputSink::Put(int fd, int type, int code, int value) {
+  if (fd != this->pendingFd)
+    Flush();
+  this->pendingFd = fd;
+  input_event e = {};
+  e.type = type;
+  e.code = code;
+  e.value = value;
+  this->pending.push_back(e);
+}
+
+void UinputSink::Flush() {
+  // Devices are non-blocking: a stalled consumer loses input rather than
+  // holding up the injection thread
+  if (!this->pending.empty()) {
+    ssize_t written = write(this->pendingFd, this->pending.data(),
+                            this->pending.size() * sizeof(input_event));
+    (void)written;
+  }
+  this->pending.clear();
+}
+
+void UinputSink::Deliver(const std::vector<InputEvent> &batch) {
+  static const int BUTTONS[3] = {BTN_LEFT, BTN_MIDDLE, BTN_RIGHT};
+  for (const auto &e : batch) {
+    if (e.type == InputEvent::KEY) {
+      uint16_t code = 0;
+      if (IsFunctionKeysym(e.keysym))
+        code = FunctionKey(e.keysym);
+      else if (e.keysym >= 0x20 && e.keysym <= 0x7E)
+        code = ASCII_KEYS[e.keysym - 0x20];
+      if (code == 0)
+        continue;
+      Put(this->keyboard, EV_KEY, code, e.down ? 1 : 0);
+      Put(this->keyboard, EV_SYN, SYN_REPORT, 0);
+      continue;
+    }
+    Put(this->pointer, EV_ABS, ABS_X,
+        (int)((long long)e.x * ABS_RANGE / (this->width - 1)));
+    Put(this->pointer, EV_ABS, ABS_Y,
+        (int)((long long)e.y * ABS_RANGE / (this->height - 1)));
+    for (int b = 0; b < INPUT_BUTTONS; b++) {
+      uint8_t bit = 1 << b;
+      bool down = (e.buttons & bit) != 0;
+      if (down == ((e.previousButtons & bit) != 0))
+        continue;
+      if (b < 3)
+        Put(this->pointer, EV_KEY, BUTTONS[b], down ? 1 : 0);
+      else if (down) // Wheel: one notch per press
+        Put(this->pointer, EV_REL, b < 5 ? REL_WHEEL : REL_HWHEEL,
+            b == 3 || b == 6 ? 1 : -1);
+    }
+    Put(this->pointer, EV_SYN, SYN_REPORT, 0);
+  }
+  Flush();
+}
+
+std::unique_ptr<InputSink> CreateUinputSink() {
+  auto sink = std::make_unique<UinputSink>();
+  if (!sink->Initialize())
+    return nullptr;
+  return sink;
+}
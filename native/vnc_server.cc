@@ -1,6 +1,9 @@
 #include <algorithm>
 #include <atomic>
+#include <climits>
+#include <cmath>
 #include <condition_variable>
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <mutex>
@@ -10,6 +13,37 @@
 #include <thread>
 #include <vector>
 
+#include "bandwidth_estimator.h"
+#include "content_cache.h"
+#include "content_classifier.h"
+#include "cursor.h"
+#include "damage_history.h"
+#include "downscale.h"
+#include "encode_cache.h"
+#include "frame_pacer.h"
+#include "fence_throttle.h"
+#include "frame_diff.h"
+#include "h264_encoder.h"
+#include "input_injector.h"
+#include "keyframe_cache.h"
+#include "motion_detector.h"
+#include "pipeline.h"
+#include "quality_controller.h"
+#include "rect_scheduler.h"
+#include "refinement_tracker.h"
+#include "roi_tracker.h"
+#include "rfb.h"
+#include "rre_encoder.h"
+#include "solid_regions.h"
+#include "thread_pool.h"
+#include "tight_encoder.h"
+#include "tile_hasher.h"
+#ifdef _WIN32
+#include "dxgi_capture.h"
+#elif defined(__linux__)
+#include "x11_capture.h"
+#endif
+
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <d3d11.h>
@@ -22,6 +56,25 @@
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "dxgi.lib")
 #pragma comment(lib, "crypt32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Winsock names over BSD sockets so the network code is shared
+typedef int SOCKET;
+typedef sockaddr SOCKADDR;
+const SOCKET INVALID_SOCKET = -1;
+inline int closesocket(SOCKET s) { return close(s); }
+inline int ioctlsocket(SOCKET s, unsigned long cmd, unsigned long *arg) {
+  int value = 0;
+  int result = ioctl(s, cmd, &value);
+  *arg = (unsigned long)value;
+  return result;
+}
 #endif
 
 // --- Constants & Helpers ---
@@ -30,8 +83,79 @@ const int RFB_SCREEN_W = 1920;
 const int RFB_SCREEN_H = 1080;
 const int BYTES_PER_PIXEL = 4;
 
-struct Rect {
-  int x, y, w, h;
+// H.264 defaults until the bandwidth estimate takes over
+const int H264_MAX_FPS = 30;
+const int H264_DEFAULT_KBPS = 4000;
+const int H264_MIN_KBPS = 300;
+const int H264_MAX_KBPS = 20000;
+
+// Compressed updates are cut into tiles this size and encoded in parallel
+const int ENCODE_TILE_W = 512;
+const int ENCODE_TILE_H = 256;
+
+// Lossy areas are resent losslessly once static this long (refineDelayMs),
+// at most this many pixels per idle update
+const int REFINE_DEFAULT_DELAY_MS = 400;
+const int REFINE_MAX_PIXELS = 256 * 1024;
+
+// Tight quality levels added for tiles around a client's pointer and typing
+// (roiQualityBoost)
+const int ROI_DEFAULT_QUALITY_BOOST = 3;
+
+// Video regions (stable clusters of tiles changing every frame) go out at
+// most this often (videoRegionFps) and at no more than this JPEG quality
+const int VIDEO_REGION_DEFAULT_FPS = 15;
+const int VIDEO_REGION_QUALITY = 3;
+
+// On a slow link an update is cut to what it can carry in this many frame
+// intervals; the rest follows with the next one
+const int SCHEDULE_BUDGET_FRAMES = 2;
+const size_t SCHEDULE_MIN_BUDGET = 16 * 1024;
+
+// Encoded tiles kept across frames for repeated content (tileCacheMB)
+const int TILE_CACHE_DEFAULT_MB = 64;
+
+// Joining clients get a keyframe at most this many frames old, then the
+// damage since
+const int KEYFRAME_MAX_AGE = 30;
+// Cached keyframes are re-encoded in the background at this age, so a
+// joiner finds a fresh one instead of encoding it
+const int KEYFRAME_REFRESH_AGE = KEYFRAME_MAX_AGE / 2;
+
+// Damage outside a client's continuous-updates area is kept until the area
+// changes; past this many rects it is kept as their bounding box
+const int OUTSIDE_AREA_MAX_RECTS = 64;
+
+// Grabbed frames the capture stage may run ahead of the process stage
+const int PATCH_POOL = 3;
+// A client's writes queued for its sender thread: an update's rects plus
+// the odd control message, and no more than a few MB of them
+const int SEND_QUEUE_SLOTS = 4096;
+const size_t SEND_QUEUE_MAX_BYTES = 4 << 20;
+
+// Messages read back to back before the client thread turns to updates:
+// input arrives in bursts, and reading it must not wait for frames
+const int MESSAGE_BURST = 64;
+
+// Where the H.264 path applies (VncServerOptions.h264)
+enum H264Mode { H264_OFF, H264_MOTION, H264_ALWAYS };
+
+// Per-client encoding settings negotiated via SetEncodings
+struct ClientEncodings {
+  int32_t preferred = ENCODING_RAW;
+  int qualityLevel = -1; // Tight JPEG quality 0-9, -1 = lossless only
+  int compressLevel = 1; // zlib level 0-9
+  bool h264 = false;     // Client listed H.264 (50) anywhere
+  bool rre = false;      // Client listed RRE (2): solid areas as RRE
+  bool fence = false;    // Fence (-312)
+  bool continuousUpdates = false; // ContinuousUpdates (-313)
+  bool lastRect = false;          // LastRect (-224): rect count sent as 0xFFFF
+  bool cursor = false;            // Cursor (-239)
+  bool xcursor = false;           // XCursor (-240)
+  bool pointerPos = false;        // PointerPos (-232)
+  bool desktopSize = false;       // DesktopSize (-223)
+  bool extendedDesktopSize = false; // ExtendedDesktopSize (-308)
+  int scale = 1; // Server-side downscale factor, not negotiated
 };
 
 #ifdef _WIN32
@@ -62,8 +186,406 @@ std::string ComputeSHA1Base64(const std::string &input) {
 
   return std::string(b64.data(), b64Len - 1); // -1 to remove null terminator
 }
+#else
+// Portable SHA1 + Base64 for the WebSocket handshake (no CryptoAPI here)
+static void Sha1(const uint8_t *data, size_t len, uint8_t out[20]) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+  std::vector<uint8_t> msg(data, data + len);
+  msg.push_back(0x80);
+  while (msg.size() % 64 != 56)
+    msg.push_back(0);
+  uint64_t bits = (uint64_t)len * 8;
+  for (int i = 7; i >= 0; i--)
+    msg.push_back((bits >> (i * 8)) & 0xFF);
+
+  for (size_t off = 0; off < msg.size(); off += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+      const uint8_t *p = &msg[off + i * 4];
+      w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+             ((uint32_t)p[2] << 8) | p[3];
+    }
+    for (int i = 16; i < 80; i++) {
+      uint32_t v = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+      w[i] = (v << 1) | (v >> 31);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t t = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = (b << 30) | (b >> 2);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  for (int i = 0; i < 5; i++) {
+    out[i * 4 + 0] = (h[i] >> 24) & 0xFF;
+    out[i * 4 + 1] = (h[i] >> 16) & 0xFF;
+    out[i * 4 + 2] = (h[i] >> 8) & 0xFF;
+    out[i * 4 + 3] = h[i] & 0xFF;
+  }
+}
+
+std::string ComputeSHA1Base64(const std::string &input) {
+  std::string magic = input + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  uint8_t hash[20];
+  Sha1((const uint8_t *)magic.data(), magic.size(), hash);
+
+  static const char *alphabet =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string b64;
+  for (int i = 0; i < 20; i += 3) {
+    uint32_t v = (uint32_t)hash[i] << 16;
+    if (i + 1 < 20)
+      v |= (uint32_t)hash[i + 1] << 8;
+    if (i + 2 < 20)
+      v |= hash[i + 2];
+    b64 += alphabet[(v >> 18) & 63];
+    b64 += alphabet[(v >> 12) & 63];
+    b64 += i + 1 < 20 ? alphabet[(v >> 6) & 63] : '=';
+    b64 += i + 2 < 20 ? alphabet[v & 63] : '=';
+  }
+  return b64;
+}
 #endif
 
+// recv() until `len` bytes arrive (RFB messages may span TCP segments)
+bool RecvAll(SOCKET s, char *buf, int len) {
+  while (len > 0) {
+    int n = recv(s, buf, len, 0);
+    if (n <= 0)
+      return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+// send() until all of `buf` is out (large updates overflow the socket buffer)
+bool SendAll(SOCKET s, const uint8_t *buf, size_t len) {
+  while (len > 0) {
+    int n = send(s, (const char *)buf, (int)std::min(len, (size_t)1 << 30), 0);
+    if (n <= 0)
+      return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Encodings are listed in the client's order of preference: the first one
+// we implement wins, pseudo-encodings only tune it.
+ClientEncodings ParseEncodings(const uint8_t *buf, int count) {
+  ClientEncodings enc;
+  bool chosen = false;
+  for (int i = 0; i < count; i++) {
+    const uint8_t *p = buf + i * 4;
+    int32_t e = (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                          ((uint32_t)p[2] << 8) | p[3]);
+    if (e == ENCODING_RRE)
+      enc.rre = true;
+    if (e == ENCODING_LAST_RECT)
+      enc.lastRect = true;
+    if (e == ENCODING_CURSOR)
+      enc.cursor = true;
+    if (e == ENCODING_XCURSOR)
+      enc.xcursor = true;
+    if (e == ENCODING_POINTER_POS)
+      enc.pointerPos = true;
+    if (e == ENCODING_DESKTOP_SIZE)
+      enc.desktopSize = true;
+    if (e == ENCODING_EXTENDED_DESKTOP_SIZE)
+      enc.extendedDesktopSize = true;
+    if (e == ENCODING_FENCE)
+      enc.fence = true;
+    if (e == ENCODING_CONTINUOUS_UPDATES)
+      enc.continuousUpdates = true;
+    if (e == ENCODING_H264) {
+      enc.h264 = true;
+    } else if (!chosen && (e == ENCODING_RAW || e == ENCODING_RRE ||
+                           e == ENCODING_TIGHT_PNG)) {
+      enc.preferred = e;
+      chosen = true;
+    } else if (e >= ENCODING_QUALITY_LEVEL_0 && e <= ENCODING_QUALITY_LEVEL_9) {
+      enc.qualityLevel = e - ENCODING_QUALITY_LEVEL_0;
+    } else if (e >= ENCODING_COMPRESS_LEVEL_0 &&
+               e <= ENCODING_COMPRESS_LEVEL_9) {
+      enc.compressLevel = e - ENCODING_COMPRESS_LEVEL_0;
+    }
+  }
+  return enc;
+}
+
+// What one FramebufferUpdate cost
+struct SentUpdate {
+  size_t bytes = 0;
+  double encodeSeconds = 0;
+  double sendSeconds = 0; // send() blocked while the socket buffer drained
+};
+
+// Writes one client's messages to its socket on a thread of its own: the
+// client thread encodes the next update, without the framebuffer lock held
+// up, while a slow link drains the last one. Messages go out in the order
+// they were queued.
+class ClientSender {
+public:
+  explicit ClientSender(SOCKET s) : socket(s) {
+    this->thread = std::thread([this] { Run(); });
+  }
+  ~ClientSender() { Stop(); }
+
+  // Queue bytes, or an encoded part shared with other clients. Blocks while
+  // the queue is full; false once a write has failed.
+  bool Send(std::vector<uint8_t> bytes) {
+    Chunk chunk;
+    chunk.bytes = std::move(bytes);
+    return Push(chunk, chunk.bytes.size());
+  }
+  bool Send(const EncodedRectsPtr &part) {
+    Chunk chunk;
+    chunk.part = part;
+    return Push(chunk, part->bytes.size());
+  }
+
+  // Writes out what is queued, then ends the thread
+  void Stop() {
+    if (!this->thread.joinable())
+      return;
+    this->stopping = true;
+    this->filled.Ring();
+    this->thread.join();
+  }
+
+  bool Failed() const { return this->failed; }
+  size_t QueuedBytes() const { return this->queuedBytes; }
+  // Total time Send() waited for room: the link is slower than the updates
+  double BlockedSeconds() const { return this->blockedSeconds; }
+  const StageStats &Stats() const { return this->stats; }
+
+private:
+  struct Chunk {
+    std::vector<uint8_t> bytes;
+    EncodedRectsPtr part; // Sent instead of `bytes` when set
+    std::chrono::steady_clock::time_point queuedAt;
+  };
+
+  bool Push(Chunk &chunk, size_t size) {
+    auto started = std::chrono::steady_clock::now();
+    chunk.queuedAt = started;
+    bool waited = false;
+    while (!this->failed) {
+      // Counted before the push: the sender may be done with it right away
+      size_t queued = this->queuedBytes.fetch_add(size);
+      if ((queued == 0 || queued + size <= SEND_QUEUE_MAX_BYTES) &&
+          this->queue.TryPush(chunk)) {
+        this->filled.Ring();
+        if (waited)
+          this->blockedSeconds =
+              this->blockedSeconds +
+              std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            started)
+                  .count();
+        return true;
+      }
+      this->queuedBytes -= size;
+      waited = true;
+      this->drained.Wait(std::chrono::milliseconds(10));
+    }
+    return false;
+  }
+
+  void Run() {
+    for (;;) {
+      Chunk chunk;
+      if (!this->queue.TryPop(chunk)) {
+        if (this->stopping)
+          return;
+        this->filled.Wait(std::chrono::milliseconds(100));
+        continue;
+      }
+      const std::vector<uint8_t> &bytes =
+          chunk.part ? chunk.part->bytes : chunk.bytes;
+      auto started = std::chrono::steady_clock::now();
+      // After a failure the rest is dropped; the client thread notices
+      if (!this->failed && !SendAll(this->socket, bytes.data(), bytes.size()))
+        this->failed = true;
+      auto done = std::chrono::steady_clock::now();
+      this->stats.Record(
+          std::chrono::duration<double, std::milli>(done - started).count(),
+          std::chrono::duration<double, std::milli>(done - chunk.queuedAt)
+              .count());
+      this->queuedBytes -= bytes.size();
+      this->drained.Ring();
+    }
+  }
+
+  SOCKET socket;
+  SpscQueue<Chunk> queue{SEND_QUEUE_SLOTS};
+  Doorbell filled;
+  Doorbell drained;
+  std::atomic<size_t> queuedBytes{0};
+  std::atomic<double> blockedSeconds{0};
+  std::atomic<bool> failed{false};
+  std::atomic<bool> stopping{false};
+  StageStats stats;
+  std::thread thread;
+};
+
+// Pseudo-encoding rects (cursor shape, pointer position) that go out with
+// the next update
+struct PseudoRects {
+  std::vector<uint8_t> bytes;
+  int count = 0;
+};
+
+// What the capture stage hands the process stage: the pixels under one
+// grab's damage, or the whole frame when the damage is unknown
+struct FramePatch {
+  int width = 0;
+  int height = 0;
+  std::vector<Rect> screens;
+  int left = 0; // Desktop position of the frame origin
+  int top = 0;
+  std::vector<Rect> rects;     // In the frame, clipped
+  bool hash = false;           // Whole frame, changes found by tile hashes
+  std::vector<uint8_t> pixels; // The rects' rows, one after the other
+  CursorState cursor;
+  std::chrono::steady_clock::time_point capturedAt;
+};
+
+static void PackRects(const uint8_t *fb, int fbW, const std::vector<Rect> &rects,
+                      std::vector<uint8_t> &out) {
+  size_t total = 0;
+  for (const auto &r : rects)
+    total += (size_t)r.w * r.h * 4;
+  out.resize(total);
+  uint8_t *dst = out.data();
+  for (const auto &r : rects) {
+    for (int y = r.y; y < r.y + r.h; y++) {
+      memcpy(dst, fb + ((size_t)y * fbW + r.x) * 4, (size_t)r.w * 4);
+      dst += (size_t)r.w * 4;
+    }
+  }
+}
+
+static void UnpackRects(const std::vector<uint8_t> &packed,
+                        const std::vector<Rect> &rects, uint8_t *fb, int fbW) {
+  const uint8_t *src = packed.data();
+  for (const auto &r : rects) {
+    for (int y = r.y; y < r.y + r.h; y++) {
+      memcpy(fb + ((size_t)y * fbW + r.x) * 4, src, (size_t)r.w * 4);
+      src += (size_t)r.w * 4;
+    }
+  }
+}
+
+// Parts of a client's update encoded apart from the rest
+struct UpdateZones {
+  std::vector<Rect> focus; // First, at a boosted quality
+  std::vector<Rect> video; // At a capped quality
+};
+
+// What a client encodes from, taken under framebufferMutex so the encode
+// runs without it: the update's rects copied out of the shared framebuffer
+// (or the client's own downscaled frame), and the frame state the encoders
+// look at
+struct FrameSnapshot {
+  const uint8_t *pixels = nullptr; // `copy`, or the client's scaled frame
+  int width = 0;
+  int height = 0;
+  uint64_t frame = 0;
+  uint64_t layoutVersion = 0;
+  std::chrono::steady_clock::time_point capturedAt; // Grab of `frame`
+  MotionDetector motion;
+  std::vector<uint8_t> copy; // Framebuffer-sized, valid under copied rects
+};
+
+// Live per-client numbers for getStats(), written by the client thread
+struct ClientStats {
+  std::atomic<int> qualityLevel{-1};
+  std::atomic<int> compressLevel{0};
+  std::atomic<int> fps{0};
+  std::atomic<double> latencyMs{0};
+  std::atomic<double> rttMs{0};
+  std::atomic<double> bandwidthKbps{0};
+  std::atomic<bool> continuousUpdates{false};
+  std::atomic<double> inFlightKB{0}; // Unacknowledged by a fence
+  std::atomic<int> scale{1}; // Downscale factor (setClientScale, scaleToFit)
+  std::atomic<int> deferredRects{0}; // Left for the next update
+  std::atomic<double> encodeMs{0};    // Last update
+  std::atomic<double> sendQueueKB{0}; // Queued for the sender thread
+  std::atomic<double> sendMs{0};      // Smoothed, from queued to written
+};
+
+// Raw / RRE clients: solid areas as single-color RRE rects when the client
+// knows RRE, the rest as RRE if it prefers that and it pays off, else Raw
+static int EncodePlainRect(const uint8_t *fb, int fbW, const Rect &r,
+                           const ClientEncodings &enc,
+                           std::vector<uint8_t> &out) {
+  if (!enc.rre) {
+    PutRawRect(out, fb, fbW, r);
+    return 1;
+  }
+  std::vector<SolidRect> solids;
+  std::vector<Rect> rest;
+  FindSolidRegions(fb, fbW, r, solids, rest);
+  for (const auto &s : solids)
+    PutRreSolidRect(out, s.rect, s.color);
+  for (const auto &m : rest) {
+    if (enc.preferred != ENCODING_RRE || !EncodeRreRect(fb, fbW, m, out))
+      PutRawRect(out, fb, fbW, m);
+  }
+  return (int)(solids.size() + rest.size());
+}
+
+// Cache key for a rect of the stateless path. Settings an encoding ignores
+// are normalized so that clients differing only in those share entries.
+static EncodeKey SharedEncodeKey(uint64_t frame, const Rect &r,
+                                 const ClientEncodings &enc) {
+  bool tight = enc.preferred == ENCODING_TIGHT_PNG;
+  return {frame,
+          r,
+          enc.preferred,
+          tight ? enc.qualityLevel : 0,
+          tight ? enc.compressLevel : 0,
+          tight     ? ENCODING_TIGHT_PNG
+          : enc.rre ? ENCODING_RRE
+                    : ENCODING_RAW,
+          enc.scale};
+}
+
+// Settings that produce `key` (see above), for encoding without a client
+static ClientEncodings KeyEncodings(const EncodeKey &key) {
+  ClientEncodings enc;
+  enc.preferred = key.encoding;
+  enc.qualityLevel = key.qualityLevel;
+  enc.compressLevel = key.compressLevel;
+  enc.rre = key.solidEncoding == ENCODING_RRE;
+  enc.scale = key.scale;
+  return enc;
+}
+
 // Simple ThreadSafe Queue for broadcasting updates
 template <typename T> class SafeQueue {
   std::queue<T> q;
@@ -106,7 +628,10 @@ private:
   Napi::Value Start(const Napi::CallbackInfo &info);
   Napi::Value Stop(const Napi::CallbackInfo &info);
   Napi::Value SetQuality(const Napi::CallbackInfo &info);
+  Napi::Value SetClientScale(const Napi::CallbackInfo &info);
   Napi::Value GetActiveClientsCount(const Napi::CallbackInfo &info);
+  Napi::Value GetStats(const Napi::CallbackInfo &info);
+  Napi::Value TakeRecordedInput(const Napi::CallbackInfo &info);
 
   // Events
   Napi::Value OnClientConnected(const Napi::CallbackInfo &info);
@@ -122,17 +647,74 @@ private:
 #ifdef _WIN32
   void InitializeDXGI();
   void CleanupDXGI();
-  bool AcquireFrame(std::vector<uint8_t> &buffer, int &width, int &height,
-                    std::vector<Rect> &dirtyRects);
+#elif defined(__linux__)
+  void InitializeX11();
+  void LayoutX11();
+  void CleanupX11();
+#endif
+  // Capture stage: grabs into captureBuffer and appends the damage;
+  // `unknown` when there is none to go by and the whole frame counts
+  bool AcquireFrame(std::vector<Rect> &dirtyRects, bool &unknown);
+  // Size and monitor layout of what the backends grab; `left`, `top` is
+  // where the frame origin lies on the desktop (input coordinates)
+  void SetCaptureLayout(int width, int height,
+                        const std::vector<Rect> &screens, int left = 0,
+                        int top = 0);
+  // Process stage: applies grabbed frames to the shared framebuffer, with
+  // damage verification, tile hashing and motion detection
+  void ProcessLoop();
+  // Takes the pixels of whole-frame patches, leaving it the old frame
+  void ProcessFrame(FramePatch &patch);
+  // Re-encodes cached keyframes as they age, on the encode pool
+  void KeyframeLoop();
+  // New capture size or monitor layout (`screens`, in framebuffer
+  // coordinates); drops everything derived from frames of the old one.
+  // Called with framebufferMutex held, which must stay held until the new
+  // pixels are in: clients see the layout and its frame together. False
+  // if nothing changed.
+  bool ResizeFramebuffer(int width, int height,
+                         const std::vector<Rect> &screens, int left,
+                         int top);
+  // SetDesktopSize from a client: an EDS_STATUS_* code
+  uint16_t RequestDesktopSize(int width, int height);
 
   // WebSocket & RFB Helpers
   bool HandshakeWebSocket(SOCKET clientSocket);
   bool HandshakeRFB(SOCKET clientSocket, int width, int height,
                     std::string name);
-  void SendFrameUpdate(SOCKET clientSocket, const std::vector<Rect> &rects,
-                       const std::vector<uint8_t> &framebuffer, int fbWidth,
-                       int fbHeight);
-#endif
+  // Under framebufferMutex: copies `rects` of the shared framebuffer into
+  // `snapshot`, along with the frame state that goes with them
+  void TakeSnapshot(const std::vector<Rect> &rects, FrameSnapshot &snapshot);
+  SentUpdate SendFrameUpdate(ClientSender &sender,
+                             const std::vector<Rect> &rects,
+                             const FrameSnapshot &snapshot,
+                             const ClientEncodings &encodings,
+                             H264Encoder *video, RefinementTracker &refinement,
+                             const UpdateZones &zones,
+                             const PseudoRects &pseudo = PseudoRects());
+  // Whole screen: `keyframe` if the cache had one, else encoded from the
+  // snapshot and cached for the next joiners. `keyframeFrame` is the frame
+  // it shows, later damage is still owed to the client.
+  SentUpdate SendKeyframe(ClientSender &sender, const FrameSnapshot &snapshot,
+                          KeyframePtr keyframe,
+                          const ClientEncodings &encodings,
+                          RefinementTracker &refinement,
+                          const PseudoRects &pseudo, uint64_t &keyframeFrame);
+  // Stateless rects, tiled for compressed encodings; each piece is encoded
+  // once per frame and shared between clients. Parts inside the `zones`
+  // become pieces of their own with their own JPEG quality, focus ones
+  // first. `ready`, if set, is called with each piece's index in order as
+  // soon as it is encoded.
+  void EncodeShared(const std::vector<Rect> &rects,
+                    const FrameSnapshot &snapshot,
+                    const ClientEncodings &encodings,
+                    const UpdateZones &zones, std::vector<Rect> &pieces,
+                    std::vector<EncodedRectsPtr> &parts,
+                    const std::function<void(int)> &ready = nullptr);
+  // Queues the update header in `msg` (plus any rects already in it) and
+  // `parts`; nothing if `count` is 0
+  void SendParts(ClientSender &sender, std::vector<uint8_t> &msg, int count,
+                 const std::vector<EncodedRectsPtr> &parts, SentUpdate &sent);
 
   // State
   std::atomic<bool> running;
@@ -148,27 +730,100 @@ private:
   // Configuration
   int port;
   std::string password;
-
+  H264Mode h264Mode = H264_OFF;
+  int refineDelayMs = REFINE_DEFAULT_DELAY_MS; // 0 = never refine
+  int roiQualityBoost = ROI_DEFAULT_QUALITY_BOOST;
+  int videoRegionFps = VIDEO_REGION_DEFAULT_FPS; // 0 = no video regions
+  bool allowResize = false; // Clients may change the display mode
+  bool allMonitors = true; // Every monitor, or only the primary one
+  bool scaleToFit = false; // SetDesktopSize downscales when not resizing
   std::atomic<int> activeClients;
 
-  // Screen dimensions (set from DXGI)
+  // setQuality() bounds; clients pick up changes by version
+  std::mutex qualityMutex;
+  QualityBounds qualityBounds;
+  std::atomic<uint64_t> qualityVersion{0};
+  FramePacer pacer; // When the capture thread grabs, at most maxFps
+
+  // Per-client stats by connection number
+  std::mutex clientsMutex;
+  std::map<int, std::shared_ptr<ClientStats>> clientStats;
+  int nextClientId = 0;
+
+  // Screen dimensions (from the capture backend, under framebufferMutex)
   int width = 1920;
   int height = 1080;
+  std::vector<Rect> screens; // Monitors within the framebuffer
+  int desktopLeft = 0; // Desktop position of the framebuffer origin
+  int desktopTop = 0;
+  uint64_t layoutVersion = 0; // Bumped on every size or layout change
 
   // Framebuffer State (Shared between Capture and Clients)
   std::vector<uint8_t> serverFramebuffer;
   std::mutex framebufferMutex;
-  std::vector<Rect> currentDirtyRects;
+  DamageHistory damageHistory; // Recent frames' damage, by frame number
+  std::vector<uint8_t> previousFramebuffer; // Last frame, to verify damage
+  DamageTrimmer damageTrimmer;
+  TileHasher tileHasher; // Damage for frames without metadata
   std::condition_variable frameCv;
   uint64_t frameCounter = 0;
-
-  // DXGI
+  std::chrono::steady_clock::time_point frameCapturedAt; // Its grab
+
+  // Rects encoded for the current frame, shared by all clients
+  EncodeCache encodeCache;
+  ContentCache contentCache; // Across frames, by pixel hash
+  KeyframeCache keyframes;   // Whole screen for joining clients
+  ThreadPool encodePool;
+  ClassifierStats classifierStats;
+
+  // Per-tile damage history: change frequency for the classifier and the
+  // high-motion area for the H.264 path (H264_MOTION only)
+  MotionDetector motionDetector;
+  Rect motionRegion = {0, 0, 0, 0};
+  std::vector<Rect> videoRegions; // motionDetector.Regions() of the frame
+
+  // Pointer: as captured (capture thread only) and as published to the
+  // clients (under framebufferMutex)
+  CursorState capturedCursor;
+  CursorState cursor;
+
+  // Capture stage (capture thread only): backends grab whole frames here,
+  // which go on to the process stage as patches of their damage
+  std::vector<uint8_t> captureBuffer;
+  int captureWidth = 0;
+  int captureHeight = 0;
+  std::vector<Rect> captureScreens;
+  int captureLeft = 0;
+  int captureTop = 0;
+  bool captureFull = true; // Next patch carries the whole frame
+  bool captureRewrites = false; // Every grab fills the whole buffer (X11)
+  // One thread per monitor (the capture thread is one of them), apart
+  // from encodePool so grabs never wait behind client encodes
+  ThreadPool capturePool;
+  SpscQueue<std::unique_ptr<FramePatch>> filledPatches{PATCH_POOL};
+  SpscQueue<std::unique_ptr<FramePatch>> freePatches{PATCH_POOL};
+  Doorbell patchFilled;
+  Doorbell patchFreed;
+  std::atomic<bool> processRunning{false};
+  std::thread processThread;
+  std::atomic<bool> keyframeRunning{false};
+  std::thread keyframeThread;
+  Doorbell frameProcessed; // Keyframes may have aged
+  StageStats captureStage;
+  StageStats processStage;
+  StageStats encodeStage; // Client threads, off framebufferMutex
+
+  InputInjector injector; // Input from all clients, in arrival order
+  RecordingInputSink *recorder = nullptr; // The injector's sink, if "record"
+
+  // Capture backends, one per monitor (DXGI output or X screen)
 #ifdef _WIN32
-  ID3D11Device *d3dDevice = nullptr;
-  ID3D11DeviceContext *d3dContext = nullptr;
-  IDXGIOutputDuplication *dxgiOutputDuplication = nullptr;
-  DXGI_OUTDUPL_DESC outputDuplDesc;
-  ID3D11Texture2D *stagingTexture = nullptr;
+  std::vector<std::unique_ptr<DxgiCapture>> dxgiOutputs; // Parallel to screens
+  CursorImage pointerShape; // Last shape DXGI reported, even while hidden
+  bool pointerVisible = false;
+  std::chrono::steady_clock::time_point dxgiRetryAt; // After losing access
+#elif defined(__linux__)
+  std::vector<std::unique_ptr<X11Capture>> x11Screens; // Parallel to screens
 #endif
 };
 
@@ -184,8 +839,11 @@ Napi::Object VncServer::Init(Napi::Env env, Napi::Object exports) {
           InstanceMethod("start", &VncServer::Start),
           InstanceMethod("stop", &VncServer::Stop),
           InstanceMethod("setQuality", &VncServer::SetQuality),
+          InstanceMethod("setClientScale", &VncServer::SetClientScale),
           InstanceMethod("getActiveClientsCount",
                          &VncServer::GetActiveClientsCount),
+          InstanceMethod("getStats", &VncServer::GetStats),
+          InstanceMethod("takeRecordedInput", &VncServer::TakeRecordedInput),
           InstanceMethod("onClientConnected", &VncServer::OnClientConnected),
           InstanceMethod("onClientDisconnected",
                          &VncServer::OnClientDisconnected),
@@ -211,6 +869,55 @@ VncServer::VncServer(const Napi::CallbackInfo &info)
   this->password = options.Has("password")
                        ? options.Get("password").As<Napi::String>().Utf8Value()
                        : "";
+  std::string h264 = options.Has("h264")
+                         ? options.Get("h264").As<Napi::String>().Utf8Value()
+                         : "off";
+  this->h264Mode = h264 == "always"   ? H264_ALWAYS
+                   : h264 == "motion" ? H264_MOTION
+                                      : H264_OFF;
+
+  int encodeThreads =
+      options.Has("encodeThreads")
+          ? options.Get("encodeThreads").As<Napi::Number>().Int32Value()
+          : 0;
+  this->encodePool.Start(encodeThreads);
+  int tileCacheMB =
+      options.Has("tileCacheMB")
+          ? options.Get("tileCacheMB").As<Napi::Number>().Int32Value()
+          : TILE_CACHE_DEFAULT_MB;
+  this->contentCache.SetBudget((size_t)std::max(0, tileCacheMB) << 20);
+  if (options.Has("refineDelayMs"))
+    this->refineDelayMs = std::max(
+        0, options.Get("refineDelayMs").As<Napi::Number>().Int32Value());
+  if (options.Has("roiQualityBoost"))
+    this->roiQualityBoost = std::max(
+        0, options.Get("roiQualityBoost").As<Napi::Number>().Int32Value());
+  if (options.Has("videoRegionFps"))
+    this->videoRegionFps = std::max(
+        0, options.Get("videoRegionFps").As<Napi::Number>().Int32Value());
+  if (options.Has("trimDamage"))
+    this->damageTrimmer.SetEnabled(
+        options.Get("trimDamage").As<Napi::Boolean>().Value());
+  if (options.Has("allowResize"))
+    this->allowResize = options.Get("allowResize").As<Napi::Boolean>().Value();
+  if (options.Has("scaleToFit"))
+    this->scaleToFit = options.Get("scaleToFit").As<Napi::Boolean>().Value();
+  if (options.Has("monitors"))
+    this->allMonitors =
+        options.Get("monitors").As<Napi::String>().Utf8Value() != "primary";
+  std::string inputSink =
+      options.Has("inputSink")
+          ? options.Get("inputSink").As<Napi::String>().Utf8Value()
+          : "auto";
+  std::unique_ptr<InputSink> sink = CreateInputSink(inputSink);
+  if (!sink) {
+    std::cerr << "VncServer: input backend '" << inputSink
+              << "' is not available, input is ignored" << std::endl;
+    sink = std::make_unique<NullInputSink>();
+  } else if (inputSink == "record") {
+    this->recorder = static_cast<RecordingInputSink *>(sink.get());
+  }
+  this->injector.SetSink(std::move(sink));
 
   this->running = false;
   this->captureRunning = false;
@@ -218,6 +925,10 @@ VncServer::VncServer(const Napi::CallbackInfo &info)
 
   // Pre-allocate framebuffer (default 1920x1080)
   this->serverFramebuffer.resize(1920 * 1080 * 4);
+  for (int i = 0; i < PATCH_POOL; i++) {
+    auto patch = std::make_unique<FramePatch>();
+    this->freePatches.TryPush(patch);
+  }
 }
 
 VncServer::~VncServer() {
@@ -225,8 +936,10 @@ VncServer::~VncServer() {
   this->captureRunning = false;
   if (this->networkThread.joinable())
     this->networkThread.join();
+  this->pacer.Interrupt();
   if (this->captureThread.joinable())
     this->captureThread.join();
+  this->injector.Stop();
 
   if (onConnectTsfn)
     onConnectTsfn.Release();
@@ -260,6 +973,7 @@ Napi::Value VncServer::Start(const Napi::CallbackInfo &info) {
   if (this->running)
     return info.Env().Null();
   this->running = true;
+  this->injector.Start();
   this->networkThread = std::thread(&VncServer::NetworkLoop, this);
   return info.Env().Null();
 }
@@ -269,25 +983,250 @@ Napi::Value VncServer::Stop(const Napi::CallbackInfo &info) {
   this->captureRunning = false;
   if (this->networkThread.joinable())
     this->networkThread.join();
+  this->pacer.Interrupt();
   if (this->captureThread.joinable())
     this->captureThread.join();
+  this->injector.Stop();
   return info.Env().Null();
 }
 
+// Maps a libjpeg quality (0-100) to the highest Tight level not above it
+static int TightLevelForJpegQuality(int jpegQuality) {
+  int level = 0;
+  while (level < 9 && TightJpegQuality(level + 1) <= jpegQuality)
+    level++;
+  return level;
+}
+
 Napi::Value VncServer::SetQuality(const Napi::CallbackInfo &info) {
-  return info.Env().Null();
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsObject()) {
+    Napi::TypeError::New(env, "Options expected").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Napi::Object options = info[0].As<Napi::Object>();
+  auto number = [&options](const char *key, int fallback) {
+    return options.Has(key) && options.Get(key).IsNumber()
+               ? options.Get(key).As<Napi::Number>().Int32Value()
+               : fallback;
+  };
+
+  std::lock_guard<std::mutex> lock(this->qualityMutex);
+  QualityBounds &b = this->qualityBounds;
+  if (options.Has("mode") && options.Get("mode").IsString())
+    b.mode = options.Get("mode").As<Napi::String>().Utf8Value() == "latency"
+                 ? QUALITY_MODE_LATENCY
+                 : QUALITY_MODE_QUALITY;
+  if (options.Has("jpegQuality"))
+    b.maxQualityLevel = TightLevelForJpegQuality(number("jpegQuality", 100));
+  if (options.Has("minJpegQuality"))
+    b.minQualityLevel = TightLevelForJpegQuality(number("minJpegQuality", 0));
+  b.maxCompressLevel = number("zlibLevel", b.maxCompressLevel);
+  b.minCompressLevel = number("minZlibLevel", b.minCompressLevel);
+  b.maxFps = number("maxFps", b.maxFps);
+  b.minFps = number("minFps", b.minFps);
+  b.latencyMs = number("latencyMs", b.latencyMs);
+
+  // Capture never needs to outrun the fastest client
+  this->pacer.SetMaxFps(b.maxFps);
+  this->qualityVersion++;
+  return env.Null();
 }
+Napi::Value VncServer::SetClientScale(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+    Napi::TypeError::New(env, "Client id and scale expected")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int id = info[0].As<Napi::Number>().Int32Value();
+  double scale = info[1].As<Napi::Number>().DoubleValue();
+  std::lock_guard<std::mutex> lock(this->clientsMutex);
+  auto it = this->clientStats.find(id);
+  if (it == this->clientStats.end())
+    return Napi::Boolean::New(env, false);
+  it->second->scale = ScaleFactorFor(scale);
+  return Napi::Boolean::New(env, true);
+}
+
 Napi::Value VncServer::GetActiveClientsCount(const Napi::CallbackInfo &info) {
   return Napi::Number::New(info.Env(), this->activeClients);
 }
 
+// {x, y, width, height} objects for getStats()
+static Napi::Array RectsToArray(Napi::Env env, const std::vector<Rect> &rects) {
+  Napi::Array array = Napi::Array::New(env, rects.size());
+  for (size_t i = 0; i < rects.size(); i++) {
+    Napi::Object rect = Napi::Object::New(env);
+    rect.Set("x", rects[i].x);
+    rect.Set("y", rects[i].y);
+    rect.Set("width", rects[i].w);
+    rect.Set("height", rects[i].h);
+    array.Set((uint32_t)i, rect);
+  }
+  return array;
+}
+
+Napi::Value VncServer::GetStats(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  Napi::Object stats = Napi::Object::New(env);
+
+  Napi::Object cache = Napi::Object::New(env);
+  cache.Set("hits", (double)this->encodeCache.Hits());
+  cache.Set("misses", (double)this->encodeCache.Misses());
+  stats.Set("encodeCache", cache);
+
+  Napi::Object tiles = Napi::Object::New(env);
+  uint64_t tileHits = this->contentCache.Hits();
+  uint64_t tileLookups = tileHits + this->contentCache.Misses();
+  tiles.Set("hits", (double)tileHits);
+  tiles.Set("misses", (double)this->contentCache.Misses());
+  tiles.Set("hitRate", tileLookups ? (double)tileHits / tileLookups : 0.0);
+  tiles.Set("entries", (double)this->contentCache.Entries());
+  tiles.Set("bytes", (double)this->contentCache.Bytes());
+  tiles.Set("budgetBytes", (double)this->contentCache.Budget());
+  stats.Set("tileCache", tiles);
+
+  Napi::Object keyframes = Napi::Object::New(env);
+  keyframes.Set("hits", (double)this->keyframes.Hits());
+  keyframes.Set("misses", (double)this->keyframes.Misses());
+  stats.Set("keyframes", keyframes);
+
+  Napi::Object capture = Napi::Object::New(env);
+  capture.Set("frames", (double)this->pacer.Captures());
+  capture.Set("delayMs", this->pacer.DelayMs());
+  stats.Set("capture", capture);
+
+  auto stage = [&env](const StageStats &st) {
+    Napi::Object o = Napi::Object::New(env);
+    o.Set("frames", (double)st.items.load());
+    o.Set("busyMs", st.busyMs.load());
+    o.Set("latencyMs", st.latencyMs.load());
+    return o;
+  };
+  Napi::Object pipeline = Napi::Object::New(env);
+  pipeline.Set("queued", (double)this->filledPatches.Size());
+  pipeline.Set("capture", stage(this->captureStage));
+  pipeline.Set("process", stage(this->processStage));
+  pipeline.Set("encode", stage(this->encodeStage));
+  stats.Set("pipeline", pipeline);
+
+  Napi::Object input = Napi::Object::New(env);
+  input.Set("queued", (double)this->injector.Queued());
+  input.Set("events", (double)this->injector.Events());
+  input.Set("injected", (double)this->injector.Injected());
+  input.Set("batches", (double)this->injector.Batches());
+  input.Set("dropped", (double)this->injector.Dropped());
+  input.Set("sink", this->injector.SinkName());
+  stats.Set("input", input);
+
+  Napi::Object damage = Napi::Object::New(env);
+  damage.Set("reportedPixels", (double)this->damageTrimmer.ReportedPixels());
+  damage.Set("changedPixels", (double)this->damageTrimmer.ChangedPixels());
+  damage.Set("unchangedRects", (double)this->damageTrimmer.UnchangedRects());
+  damage.Set("trimmedFrames", (double)this->damageTrimmer.TrimmedFrames());
+  damage.Set("skippedFrames", (double)this->damageTrimmer.SkippedFrames());
+  damage.Set("savedBytes", (double)this->damageTrimmer.SavedBytes());
+  damage.Set("hashedFrames", (double)this->tileHasher.HashedFrames());
+  stats.Set("damage", damage);
+
+  Napi::Object classifier = Napi::Object::New(env);
+  for (int c = 0; c < TILE_CLASS_COUNT; c++) {
+    Napi::Object entry = Napi::Object::New(env);
+    entry.Set("tiles", (double)this->classifierStats.Tiles((TileClass)c));
+    entry.Set("bytes", (double)this->classifierStats.Bytes((TileClass)c));
+    classifier.Set(TileClassName((TileClass)c), entry);
+  }
+  std::vector<ClassifierStats::Sample> recent = this->classifierStats.Recent();
+  Napi::Array samples = Napi::Array::New(env, recent.size());
+  for (size_t i = 0; i < recent.size(); i++) {
+    const ClassifierStats::Sample &s = recent[i];
+    Napi::Object sample = Napi::Object::New(env);
+    sample.Set("x", s.rect.x);
+    sample.Set("y", s.rect.y);
+    sample.Set("w", s.rect.w);
+    sample.Set("h", s.rect.h);
+    sample.Set("class", TileClassName(s.tileClass));
+    sample.Set("colors", s.features.colors);
+    sample.Set("edgeRatio", s.features.edgeRatio);
+    sample.Set("smoothRatio", s.features.smoothRatio);
+    sample.Set("changes", s.features.changes);
+    sample.Set("bytes", (double)s.bytes);
+    samples.Set((uint32_t)i, sample);
+  }
+  classifier.Set("recent", samples);
+  stats.Set("classifier", classifier);
+
+  {
+    std::lock_guard<std::mutex> lock(this->framebufferMutex);
+    stats.Set("screens", RectsToArray(env, this->screens));
+    stats.Set("videoRegions", RectsToArray(env, this->videoRegions));
+  }
+
+  std::lock_guard<std::mutex> lock(this->clientsMutex);
+  Napi::Array clients = Napi::Array::New(env, this->clientStats.size());
+  uint32_t index = 0;
+  for (const auto &entry : this->clientStats) {
+    const ClientStats &c = *entry.second;
+    Napi::Object client = Napi::Object::New(env);
+    client.Set("id", entry.first);
+    client.Set("qualityLevel", c.qualityLevel.load());
+    client.Set("compressLevel", c.compressLevel.load());
+    client.Set("fps", c.fps.load());
+    client.Set("latencyMs", c.latencyMs.load());
+    client.Set("rttMs", c.rttMs.load());
+    client.Set("bandwidthKbps", c.bandwidthKbps.load());
+    client.Set("continuousUpdates", c.continuousUpdates.load());
+    client.Set("inFlightKB", c.inFlightKB.load());
+    client.Set("scale", 1.0 / c.scale.load());
+    client.Set("deferredRects", c.deferredRects.load());
+    client.Set("encodeMs", c.encodeMs.load());
+    client.Set("sendQueueKB", c.sendQueueKB.load());
+    client.Set("sendMs", c.sendMs.load());
+    clients.Set(index++, client);
+  }
+  stats.Set("clients", clients);
+  return stats;
+}
+
+Napi::Value VncServer::TakeRecordedInput(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  std::vector<InputEvent> events;
+  if (this->recorder)
+    this->recorder->Take(events);
+  Napi::Array array = Napi::Array::New(env, events.size());
+  for (size_t i = 0; i < events.size(); i++) {
+    const InputEvent &e = events[i];
+    Napi::Object event = Napi::Object::New(env);
+    event.Set("client", e.client);
+    if (e.type == InputEvent::KEY) {
+      event.Set("type", "key");
+      event.Set("keysym", (double)e.keysym);
+      event.Set("down", e.down);
+    } else {
+      event.Set("type", "pointer");
+      event.Set("x", e.x);
+      event.Set("y", e.y);
+      event.Set("buttons", (double)e.buttons);
+    }
+    array.Set((uint32_t)i, event);
+  }
+  return array;
+}
+
 // --- Network Logic ---
 
 void VncServer::NetworkLoop() {
 #ifdef _WIN32
   WSADATA wsaData;
   WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
   SOCKET serverSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#ifndef _WIN32
+  // Allow quick restarts while old connections sit in TIME_WAIT
+  int reuse = 1;
+  setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
   sockaddr_in service;
   service.sin_family = AF_INET;
   service.sin_addr.s_addr = INADDR_ANY;
@@ -300,7 +1239,7 @@ void VncServer::NetworkLoop() {
     FD_ZERO(&readfds);
     FD_SET(serverSocket, &readfds);
     timeval timeout = {1, 0};
-    if (select(0, &readfds, NULL, NULL, &timeout) > 0) {
+    if (select((int)serverSocket + 1, &readfds, NULL, NULL, &timeout) > 0) {
       SOCKET clientSocket = accept(serverSocket, NULL, NULL);
       if (clientSocket != INVALID_SOCKET) {
         std::thread(&VncServer::ClientHandler, this, (uintptr_t)clientSocket,
@@ -310,12 +1249,12 @@ void VncServer::NetworkLoop() {
     }
   }
   closesocket(serverSocket);
+#ifdef _WIN32
   WSACleanup();
 #endif
 }
 
 void VncServer::ClientHandler(uintptr_t socketPtr, std::string id) {
-#ifdef _WIN32
   SOCKET clientSocket = (SOCKET)socketPtr;
   this->activeClients++;
 
@@ -332,13 +1271,31 @@ void VncServer::ClientHandler(uintptr_t socketPtr, std::string id) {
     this->captureThread = std::thread(&VncServer::CaptureLoop, this);
   }
 
-  // 3. RFB Handshake
-  if (!HandshakeRFB(clientSocket, this->width, this->height, "NodeVNC")) {
+  // 3. RFB Handshake, with the capture's size once it has one. The size
+  // this client knows is tracked from here on: resizes are sent to it.
+  int clientW, clientH;
+  this->pacer.Demand();
+  {
+    std::unique_lock<std::mutex> lock(this->framebufferMutex);
+    this->frameCv.wait_for(lock, std::chrono::seconds(1),
+                           [this] { return this->frameCounter > 0; });
+    clientW = this->width;
+    clientH = this->height;
+  }
+  if (!HandshakeRFB(clientSocket, clientW, clientH, "NodeVNC")) {
     closesocket(clientSocket);
     this->activeClients--;
     return;
   }
 
+  int clientId;
+  auto clientStats = std::make_shared<ClientStats>();
+  {
+    std::lock_guard<std::mutex> lock(this->clientsMutex);
+    clientId = this->nextClientId++;
+    this->clientStats[clientId] = clientStats;
+  }
+
   // Notify JS
   if (this->onConnectTsfn) {
     auto cb = [](Napi::Env env, Napi::Function jsCb) {
@@ -349,10 +1306,57 @@ void VncServer::ClientHandler(uintptr_t socketPtr, std::string id) {
 
   // 4. Main Loop
   uint64_t lastFrameSeen = 0;
+  bool fullRequested = true; // Non-incremental request (and the first one)
   bool updateRequested = true;         // Start true to send initial frame
   uint8_t currentClientButtonMask = 0; // Per-client button state (NOT static!)
-
-  while (this->running) {
+  ClientEncodings encodings;           // Raw until the client says otherwise
+  H264Encoder h264;                    // Per-client decoder context
+  BandwidthEstimator bandwidth;
+  RefinementTracker refinement; // What this client holds only lossy
+  RoiTracker roi;                // Where this client's user is working
+  RectScheduler scheduler;
+  std::vector<Rect> deferred; // Damage the last update had no room for
+  std::vector<Rect> videoPending; // Video region damage held to its rate
+  auto videoSentAt = std::chrono::steady_clock::time_point();
+  QualityController quality;
+  uint64_t qualitySeen = (uint64_t)-1;
+  ClientSender sender(clientSocket); // All writes from here on
+  int burst = 0; // Messages read since the last update pass
+  SentUpdate lastUpdate;
+  auto lastUpdateAt = std::chrono::steady_clock::time_point();
+  bool fenceAnnounced = false;
+  bool continuousAnnounced = false;
+  bool continuous = false; // Updates without requests, within the area
+  Rect continuousArea = {0, 0, 0, 0};
+  std::vector<Rect> outsideArea; // Damage the area has left out so far
+  FenceThrottle throttle;
+  uint64_t cursorShapeSent = 0; // CursorState serials this client has
+  uint64_t cursorMoveSent = 0;
+  int pointerX = -1; // Last PointerEvent, not echoed back as PointerPos
+  int pointerY = -1;
+  uint64_t layoutSeen = (uint64_t)-1; // ExtendedDesktopSize: one up front
+  int resizeStatus = -1;   // SetDesktopSize result still to report
+  int scale = 1;           // Downscale factor in effect
+  int originX = 0; // Desktop position of the layout this client is served
+  int originY = 0;
+  ScaledFramebuffer scaled; // What this client sees when scale > 1
+  FrameSnapshot snapshot;   // What the next update is encoded from
+
+  // In continuous mode every update is followed by a fence, whose answer
+  // tells how much is still in flight
+  auto afterUpdate = [&] {
+    if (!continuous || !encodings.fence || lastUpdate.bytes == 0)
+      return;
+    uint32_t fenceId = throttle.Sent(lastUpdate.bytes);
+    uint8_t payload[4] = {(uint8_t)(fenceId >> 24), (uint8_t)(fenceId >> 16),
+                          (uint8_t)(fenceId >> 8), (uint8_t)fenceId};
+    std::vector<uint8_t> fence;
+    PutFence(fence, FENCE_REQUEST | FENCE_BLOCK_BEFORE, payload, 4);
+    sender.Send(std::move(fence));
+    clientStats->inFlightKB = throttle.InFlight() / 1024.0;
+  };
+
+  while (this->running && !sender.Failed()) {
     // Check for incoming data (RFB messages)
     unsigned long bytesAvailable = 0;
     ioctlsocket(clientSocket, FIONREAD, &bytesAvailable);
@@ -378,18 +1382,125 @@ void VncServer::ClientHandler(uintptr_t socketPtr, std::string id) {
       } break;
       case 2: // SetEncodings
       {
-        char buf[3];
-        recv(clientSocket, buf, 3, 0);
+        uint8_t buf[3];
+        recv(clientSocket, (char *)buf, 3, 0);
         uint16_t numEncodings = (buf[1] << 8) | buf[2];
-        char *encBuf = new char[numEncodings * 4];
-        recv(clientSocket, encBuf, numEncodings * 4, 0);
-        delete[] encBuf;
+        std::vector<uint8_t> encBuf(numEncodings * 4);
+        if (RecvAll(clientSocket, (char *)encBuf.data(), (int)encBuf.size()))
+          encodings = ParseEncodings(encBuf.data(), numEncodings);
+
+        // Both extensions are announced by the server using them once: a
+        // Fence request, and EndOfContinuousUpdates
+        std::vector<uint8_t> reply;
+        if (encodings.fence && !fenceAnnounced)
+          PutFence(reply, FENCE_REQUEST, nullptr, 0);
+        if (encodings.continuousUpdates && !continuousAnnounced)
+          PutU8(reply, MSG_END_OF_CONTINUOUS_UPDATES);
+        fenceAnnounced = fenceAnnounced || encodings.fence;
+        continuousAnnounced =
+            continuousAnnounced || encodings.continuousUpdates;
+        if (!reply.empty())
+          sender.Send(std::move(reply));
       } break;
       case 3: // FramebufferUpdateRequest
       {
         char buf[9];
         recv(clientSocket, buf, 9, 0);
         updateRequested = true; // Client requests update
+        // [incremental][x:2][y:2][w:2][h:2]; 0 = client holds nothing valid
+        if (buf[0] == 0)
+          fullRequested = true;
+        if (bandwidth.RequestReceived()) {
+          quality.Update(lastUpdate.encodeSeconds, lastUpdate.sendSeconds,
+                         bandwidth.LastTurnaround(), bandwidth.MinTurnaround(),
+                         encodings.qualityLevel, encodings.compressLevel);
+          clientStats->latencyMs = quality.LatencyMs();
+          clientStats->rttMs = bandwidth.MinTurnaround() * 1000;
+          clientStats->bandwidthKbps = bandwidth.BytesPerSecond() * 8 / 1000;
+        }
+      } break;
+      case MSG_ENABLE_CONTINUOUS_UPDATES: {
+        uint8_t buf[9];
+        if (!RecvAll(clientSocket, (char *)buf, 9))
+          break;
+        // [enable][x:2][y:2][w:2][h:2]
+        continuous = buf[0] != 0;
+        continuousArea = {(buf[1] << 8) | buf[2], (buf[3] << 8) | buf[4],
+                          (buf[5] << 8) | buf[6], (buf[7] << 8) | buf[8]};
+        clientStats->continuousUpdates = continuous;
+        // What the old area left out is due again; whatever the new one
+        // still leaves out goes back
+        deferred.insert(deferred.end(), outsideArea.begin(),
+                        outsideArea.end());
+        outsideArea.clear();
+        if (!continuous) {
+          sender.Send(std::vector<uint8_t>(1, MSG_END_OF_CONTINUOUS_UPDATES));
+        }
+      } break;
+      case MSG_SET_DESKTOP_SIZE: {
+        uint8_t buf[7];
+        // [padding][w:2][h:2][screens][padding] then 16 bytes per screen;
+        // the layout is always a single screen here
+        if (!RecvAll(clientSocket, (char *)buf, 7))
+          break;
+        int w = (buf[1] << 8) | buf[2];
+        int h = (buf[3] << 8) | buf[4];
+        std::vector<uint8_t> screens(buf[5] * 16);
+        if (!screens.empty() &&
+            !RecvAll(clientSocket, (char *)screens.data(),
+                     (int)screens.size()))
+          break;
+        resizeStatus = buf[5] == 0 ? EDS_STATUS_INVALID_LAYOUT
+                                   : RequestDesktopSize(w, h);
+        if (resizeStatus == EDS_STATUS_PROHIBITED && this->scaleToFit &&
+            w > 0 && h > 0) {
+          // No mode switch, but a smaller viewer can have the screen
+          // scaled down to fit its window
+          std::lock_guard<std::mutex> lock(this->framebufferMutex);
+          int fit = (int)std::ceil(std::max((double)this->width / w,
+                                            (double)this->height / h));
+          clientStats->scale = std::max(1, std::min(fit, MAX_SCALE_FACTOR));
+          resizeStatus = EDS_STATUS_OK;
+        }
+      } break;
+      case MSG_FENCE: {
+        uint8_t buf[8];
+        uint8_t payload[255];
+        // [padding:3][flags:4][length][payload]
+        if (!RecvAll(clientSocket, (char *)buf, 8))
+          break;
+        uint32_t flags = ((uint32_t)buf[3] << 24) | ((uint32_t)buf[4] << 16) |
+                         ((uint32_t)buf[5] << 8) | buf[6];
+        uint8_t length = buf[7];
+        if (length > 0 && !RecvAll(clientSocket, (char *)payload, length))
+          break;
+        // A longer payload than allowed is read, so the stream stays in
+        // step, and cut to the limit
+        length = std::min<uint8_t>(length, FENCE_MAX_PAYLOAD);
+
+        if (flags & FENCE_REQUEST) {
+          // Messages are handled on this one thread and written in the
+          // order they were queued, so every ordering flag already holds
+          const uint32_t supported =
+              FENCE_BLOCK_BEFORE | FENCE_BLOCK_AFTER | FENCE_SYNC_NEXT;
+          std::vector<uint8_t> reply;
+          PutFence(reply, flags & supported, payload, length);
+          sender.Send(std::move(reply));
+        } else if (length == 4 &&
+                   throttle.Acknowledged(((uint32_t)payload[0] << 24) |
+                                         ((uint32_t)payload[1] << 16) |
+                                         ((uint32_t)payload[2] << 8) |
+                                         payload[3])) {
+          // No requests in continuous mode: fence answers drive the
+          // quality controller instead
+          quality.Update(lastUpdate.encodeSeconds, lastUpdate.sendSeconds,
+                         throttle.LastTurnaround(), throttle.MinRtt(),
+                         encodings.qualityLevel, encodings.compressLevel);
+          clientStats->latencyMs = quality.LatencyMs();
+          clientStats->rttMs = throttle.MinRtt() * 1000;
+          clientStats->bandwidthKbps = throttle.BytesPerSecond() * 8 / 1000;
+          clientStats->inFlightKB = throttle.InFlight() / 1024.0;
+        }
       } break;
       case 4: // KeyEvent
       {
@@ -400,87 +1511,17 @@ void VncServer::ClientHandler(uintptr_t socketPtr, std::string id) {
         uint8_t downFlag = buf[0];
         uint32_t keysym =
             (buf[3] << 24) | (buf[4] << 16) | (buf[5] << 8) | buf[6];
-
-#ifdef _WIN32
-        // Map RFB Keysym to Windows VK code (basic mapping)
-        WORD vkCode = 0;
-
-        // ASCII range (0x20-0x7E)
-        if (keysym >= 0x20 && keysym <= 0x7E) {
-          vkCode = VkKeyScanA((char)keysym) & 0xFF;
-        }
-        // Function keys
-        else if (keysym >= 0xFFBE && keysym <= 0xFFC9) {
-          vkCode = VK_F1 + (keysym - 0xFFBE);
-        }
-        // Special keys
-        else {
-          switch (keysym) {
-          case 0xFF08:
-            vkCode = VK_BACK;
-            break;
-          case 0xFF09:
-            vkCode = VK_TAB;
-            break;
-          case 0xFF0D:
-            vkCode = VK_RETURN;
-            break;
-          case 0xFF1B:
-            vkCode = VK_ESCAPE;
-            break;
-          case 0xFF50:
-            vkCode = VK_HOME;
-            break;
-          case 0xFF51:
-            vkCode = VK_LEFT;
-            break;
-          case 0xFF52:
-            vkCode = VK_UP;
-            break;
-          case 0xFF53:
-            vkCode = VK_RIGHT;
-            break;
-          case 0xFF54:
-            vkCode = VK_DOWN;
-            break;
-          case 0xFF55:
-            vkCode = VK_PRIOR;
-            break; // Page Up
-          case 0xFF56:
-            vkCode = VK_NEXT;
-            break; // Page Down
-          case 0xFF57:
-            vkCode = VK_END;
-            break;
-          case 0xFF63:
-            vkCode = VK_INSERT;
-            break;
-          case 0xFFFF:
-            vkCode = VK_DELETE;
-            break;
-          case 0xFFE1:
-            vkCode = VK_SHIFT;
-            break;
-          case 0xFFE3:
-            vkCode = VK_CONTROL;
-            break;
-          case 0xFFE9:
-            vkCode = VK_MENU;
-            break; // Alt
-          default:
-            vkCode = 0;
-            break;
-          }
-        }
-
-        if (vkCode != 0) {
-          INPUT input = {0};
-          input.type = INPUT_KEYBOARD;
-          input.ki.wVk = vkCode;
-          input.ki.dwFlags = downFlag ? 0 : KEYEVENTF_KEYUP;
-          ::SendInput(1, &input, sizeof(INPUT));
-        }
-#endif
+        if (downFlag)
+          roi.KeyPressed();
+        this->pacer.Demand(); // The screen is about to answer
+
+        // Injected on the input thread; reading goes on meanwhile
+        InputEvent event;
+        event.type = InputEvent::KEY;
+        event.client = clientId;
+        event.keysym = keysym;
+        event.down = downFlag != 0;
+        this->injector.Push(event);
       } break;
       case 5: // PointerEvent
       {
@@ -491,52 +1532,23 @@ void VncServer::ClientHandler(uintptr_t socketPtr, std::string id) {
         uint8_t buttonMask = buf[0];
         uint16_t x = (buf[1] << 8) | buf[2];
         uint16_t y = (buf[3] << 8) | buf[4];
-
-#ifdef _WIN32
-        // Normalize coordinates to 0-65535 range
-        long normalizedX = (long)x * 65535 / this->width;
-        long normalizedY = (long)y * 65535 / this->height;
-
-        // 1. MOVE: Always send cursor position
-        INPUT moveInput = {0};
-        moveInput.type = INPUT_MOUSE;
-        moveInput.mi.dx = normalizedX;
-        moveInput.mi.dy = normalizedY;
-        moveInput.mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE;
-        ::SendInput(1, &moveInput, sizeof(INPUT));
-
-        // 2. BUTTONS: Send button state changes
-        // Check each button and send DOWN or UP
-
-        // Left button
-        if ((buttonMask & 0x01) != (currentClientButtonMask & 0x01)) {
-          INPUT btnInput = {0};
-          btnInput.type = INPUT_MOUSE;
-          btnInput.mi.dwFlags =
-              (buttonMask & 0x01) ? MOUSEEVENTF_LEFTDOWN : MOUSEEVENTF_LEFTUP;
-          ::SendInput(1, &btnInput, sizeof(INPUT));
-        }
-
-        // Middle button
-        if ((buttonMask & 0x02) != (currentClientButtonMask & 0x02)) {
-          INPUT btnInput = {0};
-          btnInput.type = INPUT_MOUSE;
-          btnInput.mi.dwFlags = (buttonMask & 0x02) ? MOUSEEVENTF_MIDDLEDOWN
-                                                    : MOUSEEVENTF_MIDDLEUP;
-          ::SendInput(1, &btnInput, sizeof(INPUT));
-        }
-
-        // Right button
-        if ((buttonMask & 0x04) != (currentClientButtonMask & 0x04)) {
-          INPUT btnInput = {0};
-          btnInput.type = INPUT_MOUSE;
-          btnInput.mi.dwFlags =
-              (buttonMask & 0x04) ? MOUSEEVENTF_RIGHTDOWN : MOUSEEVENTF_RIGHTUP;
-          ::SendInput(1, &btnInput, sizeof(INPUT));
-        }
-
+        pointerX = x;
+        pointerY = y;
+        roi.PointerMoved(x, y);
+        this->pacer.Demand();
+        // Downscaled clients point in their own coordinates
+        x *= scale;
+        y *= scale;
+
+        InputEvent event;
+        event.type = InputEvent::POINTER;
+        event.client = clientId;
+        event.x = x + originX;
+        event.y = y + originY;
+        event.buttons = buttonMask;
+        event.previousButtons = currentClientButtonMask;
+        this->injector.Push(event);
         currentClientButtonMask = buttonMask; // Save new state for this client
-#endif
       } break;
       default:
         // Unknown message, drain buffer
@@ -544,35 +1556,386 @@ void VncServer::ClientHandler(uintptr_t socketPtr, std::string id) {
         recv(clientSocket, buf, sizeof(buf), 0);
         break;
       }
+
+      unsigned long more = 0;
+      ioctlsocket(clientSocket, FIONREAD, &more);
+      if (more > 0 && ++burst < MESSAGE_BURST)
+        continue;
+    }
+    burst = 0;
+
+    if (this->qualityVersion != qualitySeen) {
+      std::lock_guard<std::mutex> lock(this->qualityMutex);
+      qualitySeen = this->qualityVersion;
+      quality.SetBounds(this->qualityBounds);
+    }
+    ClientEncodings effective = encodings;
+    effective.qualityLevel = quality.QualityLevel(encodings.qualityLevel);
+    effective.compressLevel = quality.CompressLevel(encodings.compressLevel);
+    clientStats->qualityLevel = effective.qualityLevel;
+    clientStats->compressLevel = effective.compressLevel;
+    clientStats->fps = quality.Fps();
+    clientStats->encodeMs = lastUpdate.encodeSeconds * 1000;
+    clientStats->sendQueueKB = sender.QueuedBytes() / 1024.0;
+    clientStats->sendMs = sender.Stats().latencyMs.load();
+
+    // The controller's frame rate spaces out this client's updates
+    auto interval = std::chrono::microseconds(1000000 / quality.Fps());
+    auto now = std::chrono::steady_clock::now();
+    bool due = now - lastUpdateAt >= interval;
+    auto wait = std::chrono::milliseconds(30);
+    if (!due) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          lastUpdateAt + interval - now);
+      wait = std::min(wait, left + std::chrono::milliseconds(1));
+    }
+
+    // Continuous updates stand in for requests while the fence window
+    // has room. Without either nothing can go out, so wait for the
+    // client's next message rather than for frames: a request after a
+    // quiet spell is answered at once.
+    bool requested = updateRequested ||
+                     (continuous && (!encodings.fence || throttle.CanSend()));
+    if (!requested) {
+      fd_set readfds;
+      FD_ZERO(&readfds);
+      FD_SET(clientSocket, &readfds);
+      timeval timeout = {0, (long)wait.count() * 1000};
+      select((int)clientSocket + 1, &readfds, NULL, NULL, &timeout);
+      continue;
     }
 
     // Check for new frame AND client requested update
     // THREAD-SAFE: Lock framebuffer mutex to read shared state
     std::unique_lock<std::mutex> lock(this->framebufferMutex);
 
-    // Wait for new frame (max 30ms ~= 30 FPS)
-    this->frameCv.wait_for(lock, std::chrono::milliseconds(30),
-                           [this, &lastFrameSeen, &updateRequested] {
-                             return updateRequested &&
-                                    (this->frameCounter > lastFrameSeen);
-                           });
-
-    if (updateRequested && this->frameCounter > lastFrameSeen) {
-      // Send update
-      SendFrameUpdate(clientSocket, this->currentDirtyRects,
-                      this->serverFramebuffer, this->width, this->height);
-      lastFrameSeen = this->frameCounter;
-      updateRequested = false; // Reset until next request
+    // Wait for new frame (max 30ms)
+    bool wantsShape = encodings.cursor || encodings.xcursor;
+    auto cursorPending = [&] {
+      return (wantsShape && this->cursor.shapeSerial != cursorShapeSent) ||
+             (encodings.pointerPos &&
+              this->cursor.moveSerial != cursorMoveSent);
+    };
+    // Size changes go to clients that understand them before any pixels.
+    // Only those can be downscaled: the scaled size is a size change.
+    bool canResize = encodings.desktopSize || encodings.extendedDesktopSize;
+    scale = canResize ? clientStats->scale.load() : 1;
+    effective.scale = scale;
+    originX = this->desktopLeft;
+    originY = this->desktopTop;
+    if (scale > 1 && scaled.Configure(scale, this->width, this->height))
+      fullRequested = true;
+    int outW = this->width / scale;
+    int outH = this->height / scale;
+    // The pixels an update needs are copied out, so the lock is not held
+    // while encoding: other clients and the process stage go on meanwhile.
+    // Downscaled clients encode from their own scaled frame.
+    auto takeSnapshot = [&](const std::vector<Rect> &rects) {
+      TakeSnapshot(scale > 1 ? std::vector<Rect>() : rects, snapshot);
+      if (scale > 1) {
+        snapshot.pixels = scaled.Pixels().data();
+        snapshot.width = outW;
+        snapshot.height = outH;
+      }
+    };
+    auto recordEncode = [&] {
+      this->encodeStage.Record(
+          lastUpdate.encodeSeconds * 1000,
+          std::chrono::duration<double, std::milli>(
+              std::chrono::steady_clock::now() - snapshot.capturedAt)
+              .count());
+    };
+    auto layoutPending = [&] {
+      return canResize &&
+             (clientW != outW || clientH != outH ||
+              (encodings.extendedDesktopSize &&
+               (layoutSeen != this->layoutVersion || resizeStatus >= 0)));
+    };
+    auto videoInterval =
+        std::chrono::microseconds(1000000 / std::max(1, this->videoRegionFps));
+    auto videoDue = [&] {
+      return std::chrono::steady_clock::now() - videoSentAt >= videoInterval;
+    };
+    auto hasUpdate = [&] {
+      return this->frameCounter > lastFrameSeen || !deferred.empty() ||
+             (!videoPending.empty() && videoDue()) ||
+             (fullRequested && this->frameCounter > 0) || cursorPending() ||
+             layoutPending();
+    };
+    // Pointer changes ride along with the next update
+    auto takeCursor = [&] {
+      PseudoRects pseudo;
+      if (wantsShape && this->cursor.shapeSerial != cursorShapeSent) {
+        if (encodings.cursor)
+          PutCursorRect(pseudo.bytes, this->cursor.shape);
+        else
+          PutXCursorRect(pseudo.bytes, this->cursor.shape);
+        pseudo.count++;
+        cursorShapeSent = this->cursor.shapeSerial;
+      }
+      if (encodings.pointerPos && this->cursor.moveSerial != cursorMoveSent) {
+        int x = this->cursor.x / scale;
+        int y = this->cursor.y / scale;
+        if (x != pointerX || y != pointerY) {
+          PutPointerPosRect(pseudo.bytes, std::max(0, x), std::max(0, y));
+          pseudo.count++;
+        }
+        cursorMoveSent = this->cursor.moveSerial;
+      }
+      return pseudo;
+    };
+    if (requested)
+      this->pacer.Demand();
+    this->frameCv.wait_for(lock, wait, [due, requested, &hasUpdate] {
+      return due && requested && hasUpdate();
+    });
+
+    bool videoEnabled = encodings.h264 && this->h264Mode != H264_OFF &&
+                        H264Encoder::Available();
+    // Clients without resize support keep their size and get the part of
+    // the screen that fits
+    bool sizeMatches = clientW == outW && clientH == outH;
+    auto clipToClient = [&](std::vector<Rect> &rects) {
+      if (sizeMatches)
+        return;
+      std::vector<Rect> inside;
+      for (const auto &r : rects) {
+        Rect clipped = ClipRect(r, clientW, clientH);
+        if (clipped.w > 0 && clipped.h > 0)
+          inside.push_back(clipped);
+      }
+      rects.swap(inside);
+    };
+    if (due && requested && layoutPending()) {
+      // The new size goes out alone; the client repaints everything at it
+      std::vector<uint8_t> msg = {0, 0, 0, 1}; // FramebufferUpdate, 1 rect
+      std::vector<Rect> layout;
+      for (const auto &r : this->screens)
+        layout.push_back({r.x / scale, r.y / scale, r.w / scale, r.h / scale});
+      if (encodings.extendedDesktopSize)
+        PutExtendedDesktopSizeRect(
+            msg, resizeStatus >= 0 ? EDS_REASON_CLIENT : EDS_REASON_SERVER,
+            resizeStatus >= 0 ? resizeStatus : EDS_STATUS_OK, outW, outH,
+            layout);
+      else
+        PutDesktopSizeRect(msg, outW, outH);
+      size_t layoutBytes = msg.size();
+      layoutSeen = this->layoutVersion;
+      lock.unlock();
+      sender.Send(std::move(msg));
+      if (!sizeMatches) {
+        clientW = outW;
+        clientH = outH;
+        fullRequested = true;
+        deferred.clear();
+        videoPending.clear();
+        outsideArea.clear();
+        h264.Reset();
+      }
+      resizeStatus = -1;
+      lastUpdate = SentUpdate();
+      lastUpdate.bytes = layoutBytes;
+      bandwidth.UpdateSent(lastUpdate.bytes);
+      afterUpdate();
+      lastUpdateAt = std::chrono::steady_clock::now();
+      updateRequested = false;
+    } else if (due && requested && fullRequested && !videoEnabled &&
+               sizeMatches && scale == 1 && this->frameCounter > 0) {
+      // Whole screen as a shared keyframe, possibly a few frames old: the
+      // damage since follows with the next request. A cached one needs no
+      // pixels; otherwise this joiner encodes one for the next ones.
+      uint64_t minFrame = std::max(
+          this->damageHistory.Horizon(),
+          this->frameCounter > (uint64_t)KEYFRAME_MAX_AGE
+              ? this->frameCounter - KEYFRAME_MAX_AGE
+              : 0);
+      KeyframePtr keyframe = this->keyframes.Find(
+          SharedEncodeKey(0, Rect{0, 0, 0, 0}, effective), minFrame);
+      std::vector<Rect> whole;
+      if (!keyframe)
+        whole.push_back({0, 0, this->width, this->height});
+      takeSnapshot(whole);
+      PseudoRects pseudo = takeCursor();
+      lock.unlock();
+      uint64_t shown = 0;
+      lastUpdate = SendKeyframe(sender, snapshot, keyframe, effective,
+                                refinement, pseudo, shown);
+      if (!keyframe)
+        recordEncode();
+      bandwidth.UpdateSent(lastUpdate.bytes);
+      afterUpdate();
+      lastUpdateAt = std::chrono::steady_clock::now();
+      lastFrameSeen = shown;
+      deferred.clear();
+      videoPending.clear();
+      outsideArea.clear();
+      fullRequested = false;
+      updateRequested = false;
+    } else if (due && requested && hasUpdate()) {
+      // Everything since the last frame this client got, unless that is
+      // no longer known
+      std::vector<Rect> rects;
+      bool full = fullRequested && this->frameCounter > 0;
+      if (full || (this->frameCounter > lastFrameSeen &&
+                   !this->damageHistory.Since(lastFrameSeen, this->width,
+                                              this->height, rects)))
+        rects.assign(1, Rect{0, 0, this->width, this->height});
+      // Scaled pixels are refreshed for all damage, also what the
+      // continuous area leaves out, so later refinements stay exact
+      if (scale > 1)
+        scaled.Update(this->serverFramebuffer.data(), rects);
+      clipToClient(rects);
+      if (!full) {
+        rects.insert(rects.end(), deferred.begin(), deferred.end());
+      } else {
+        videoPending.clear();
+        outsideArea.clear();
+      }
+      deferred.clear();
+      if (continuous && !full) {
+        std::vector<Rect> inside;
+        for (const auto &r : rects) {
+          Rect clipped = IntersectRect(r, continuousArea);
+          if (clipped.w > 0 && clipped.h > 0)
+            inside.push_back(clipped);
+          SubtractRect(r, continuousArea, outsideArea);
+        }
+        rects.swap(inside);
+        if (outsideArea.size() > (size_t)OUTSIDE_AREA_MAX_RECTS) {
+          Rect box = outsideArea[0];
+          for (const auto &r : outsideArea)
+            box = UnionRect(box, r);
+          outsideArea.assign(1, box);
+        }
+      }
+      fullRequested = fullRequested && !full;
+      H264Encoder *video = nullptr;
+
+      if (videoEnabled && sizeMatches && scale == 1) {
+        Rect region = this->h264Mode == H264_ALWAYS
+                          ? Rect{0, 0, this->width & ~1, this->height & ~1}
+                          : this->motionRegion;
+        Rect previous = h264.Region();
+        double bps = bandwidth.BytesPerSecond();
+        int kbps = bps > 0 ? std::max(H264_MIN_KBPS,
+                                      std::min((int)(bps * 8 / 1000 * 0.7),
+                                               H264_MAX_KBPS))
+                           : H264_DEFAULT_KBPS;
+
+        if (region.w > 0 && h264.Configure(region, kbps, H264_MAX_FPS)) {
+          h264.SetBitrate(kbps);
+          video = &h264;
+        } else {
+          h264.Reset();
+        }
+        // The old video area is repainted losslessly once it moves or ends
+        if (previous.w > 0 &&
+            (!video || previous.x != region.x || previous.y != region.y ||
+             previous.w != region.w || previous.h != region.h))
+          rects.push_back(previous);
+      }
+
+      // Without H.264, video regions go out as low-quality JPEG at their
+      // own capped rate; damage there waits for the next slot
+      UpdateZones zones;
+      if (!video) {
+        for (const auto &v : this->videoRegions)
+          zones.video.push_back(
+              {v.x / scale, v.y / scale, v.w / scale, v.h / scale});
+      }
+      // Held damage goes out once the regions are gone, or it never would
+      if ((!zones.video.empty() || !videoPending.empty()) && !full) {
+        std::vector<Rect> outside = rects;
+        for (const auto &v : zones.video) {
+          std::vector<Rect> rest;
+          for (const auto &r : outside) {
+            Rect inside = IntersectRect(r, v);
+            if (inside.w > 0 && inside.h > 0)
+              videoPending.push_back(inside);
+            SubtractRect(r, v, rest);
+          }
+          outside.swap(rest);
+        }
+        rects.swap(outside);
+        if (videoDue() || zones.video.empty()) {
+          rects.insert(rects.end(), videoPending.begin(), videoPending.end());
+          videoPending.clear();
+          videoSentAt = std::chrono::steady_clock::now();
+        }
+      }
+
+      // Send update, what the user is working on first. Unless video
+      // carries the motion, a link too slow for all of it gets the most
+      // visible part now and the rest next time.
+      roi.Damage(rects);
+      roi.Regions(outW, outH, zones.focus);
+      double linkRate = continuous ? throttle.BytesPerSecond()
+                                   : bandwidth.BytesPerSecond();
+      size_t budget = 0;
+      if (!video && linkRate > 0)
+        budget = std::max(SCHEDULE_MIN_BUDGET,
+                          (size_t)(linkRate * SCHEDULE_BUDGET_FRAMES /
+                                   quality.Fps()));
+      scheduler.Schedule(rects, zones.focus, zones.video, budget,
+                         ENCODE_TILE_W, ENCODE_TILE_H, deferred);
+      clientStats->deferredRects = (int)deferred.size();
+      std::vector<Rect> copied = rects;
+      if (video)
+        copied.push_back(video->Region());
+      takeSnapshot(copied);
+      PseudoRects pseudo = takeCursor();
+      lock.unlock();
+      lastUpdate = SendFrameUpdate(sender, rects, snapshot, effective, video,
+                                   refinement, zones, pseudo);
+      if (lastUpdate.bytes > 0)
+        recordEncode();
+      if (!video) {
+        long long sentPixels = 0;
+        for (const auto &r : rects)
+          sentPixels += (long long)r.w * r.h;
+        scheduler.Sent(lastUpdate.bytes, sentPixels);
+      }
+      bandwidth.UpdateSent(lastUpdate.bytes);
+      afterUpdate();
+      lastUpdateAt = std::chrono::steady_clock::now();
+      lastFrameSeen = snapshot.frame;
+      // Reset until next request, unless nothing was left to send (a
+      // pointer move this client made itself)
+      if (lastUpdate.bytes > 0)
+        updateRequested = false;
+    } else if (due && requested && !hasUpdate() &&
+               this->refineDelayMs > 0 && refinement.Pending()) {
+      // Nothing changed since the last update, so the link is idle: spend
+      // the request on replacing settled lossy areas with exact pixels
+      std::vector<Rect> settled;
+      refinement.TakeDue(std::chrono::milliseconds(this->refineDelayMs),
+                         REFINE_MAX_PIXELS, settled);
+      clipToClient(settled);
+      if (!settled.empty()) {
+        ClientEncodings lossless = effective;
+        lossless.qualityLevel = -1;
+        takeSnapshot(settled);
+        lock.unlock();
+        lastUpdate = SendFrameUpdate(sender, settled, snapshot, lossless,
+                                     nullptr, refinement, UpdateZones());
+        bandwidth.UpdateSent(lastUpdate.bytes);
+        afterUpdate();
+        lastUpdateAt = std::chrono::steady_clock::now();
+        updateRequested = false;
+      }
     }
-    // lock auto-unlocks when going out of scope
+    // Unlocked before any encode, else when going out of scope
   }
 
+  {
+    std::lock_guard<std::mutex> lock(this->clientsMutex);
+    this->clientStats.erase(clientId);
+  }
+  sender.Stop();
   closesocket(clientSocket);
   this->activeClients--;
-#endif
 }
 
-#ifdef _WIN32
 // Minimal WebSocket Handshake (Assumes polite client)
 bool VncServer::HandshakeWebSocket(SOCKET s) {
   char buf[4096];
@@ -654,222 +2017,761 @@ bool VncServer::HandshakeRFB(SOCKET s, int w, int h, std::string name) {
   return true;
 }
 
-void VncServer::SendFrameUpdate(SOCKET s, const std::vector<Rect> &rects,
-                                const std::vector<uint8_t> &fb, int fbW,
-                                int fbH) {
+void VncServer::TakeSnapshot(const std::vector<Rect> &rects,
+                             FrameSnapshot &snapshot) {
+  snapshot.copy.resize(this->serverFramebuffer.size());
+  for (const auto &d : rects) {
+    Rect r = ClipRect(d, this->width, this->height);
+    for (int y = r.y; y < r.y + r.h; y++) {
+      size_t offset = ((size_t)y * this->width + r.x) * 4;
+      memcpy(snapshot.copy.data() + offset,
+             this->serverFramebuffer.data() + offset, (size_t)r.w * 4);
+    }
+  }
+  snapshot.pixels = snapshot.copy.data();
+  snapshot.width = this->width;
+  snapshot.height = this->height;
+  snapshot.frame = this->frameCounter;
+  snapshot.layoutVersion = this->layoutVersion;
+  snapshot.capturedAt = this->frameCapturedAt;
+  snapshot.motion = this->motionDetector;
+}
+
+SentUpdate VncServer::SendFrameUpdate(ClientSender &sender,
+                                      const std::vector<Rect> &rects,
+                                      const FrameSnapshot &snapshot,
+                                      const ClientEncodings &enc,
+                                      H264Encoder *video,
+                                      RefinementTracker &refinement,
+                                      const UpdateZones &zones,
+                                      const PseudoRects &pseudo) {
   // Msg Type 0 (FramebufferUpdate)
   // Padding (1)
   // Number of Rects (2)
-  if (rects.empty())
-    return;
+  SentUpdate sent;
+  if (rects.empty() && pseudo.count == 0)
+    return sent;
+  refinement.Resize(snapshot.width, snapshot.height);
+  auto started = std::chrono::steady_clock::now();
+  double blocked = sender.BlockedSeconds();
+
+  // Encoded rects are built up front: the count is only known afterwards
+  std::vector<uint8_t> msg(4, 0);
+  msg.insert(msg.end(), pseudo.bytes.begin(), pseudo.bytes.end());
+  int count = pseudo.count;
+
+  // Damage touching the video region is covered by one H.264 frame of the
+  // whole region; only what lies outside it goes to the rect encoder. If
+  // rate control drops the frame, everything falls back to rects.
+  const std::vector<Rect> *pending = &rects;
+  std::vector<Rect> outside;
+  if (video) {
+    bool videoDamaged = false;
+    for (const auto &r : rects)
+      videoDamaged = videoDamaged || RectsIntersect(r, video->Region());
+    if (videoDamaged &&
+        video->EncodeRect(snapshot.pixels, snapshot.width, msg)) {
+      count++;
+      refinement.MarkSent(video->Region(), true);
+      for (const auto &r : rects)
+        SubtractRect(r, video->Region(), outside);
+      pending = &outside;
+    }
+  }
 
-  std::vector<uint8_t> header(4);
-  header[0] = 0;
-  header[1] = 0;
-  uint16_t count = rects.size();
-  header[2] = (count >> 8) & 0xFF;
-  header[3] = count & 0xFF;
-  send(s, (char *)header.data(), 4, 0);
+  std::vector<Rect> pieces;
+  std::vector<EncodedRectsPtr> parts;
+  if (enc.lastRect) {
+    // Count unknown up front: the header goes out now, each rect as soon
+    // as it is encoded, and a LastRect rect ends the update
+    msg[2] = msg[3] = 0xFF;
+    sent.bytes = msg.size();
+    bool ok = sender.Send(std::move(msg));
+    auto sendPiece = [&](int i) {
+      refinement.MarkSent(pieces[i], parts[i]->lossy);
+      if (!ok || parts[i]->count == 0)
+        return;
+      ok = sender.Send(parts[i]);
+      if (ok)
+        sent.bytes += parts[i]->bytes.size();
+    };
+    EncodeShared(*pending, snapshot, enc, zones, pieces, parts, sendPiece);
+    std::vector<uint8_t> last;
+    PutRectHeader(last, Rect{0, 0, 0, 0}, ENCODING_LAST_RECT);
+    sent.bytes += last.size();
+    if (ok)
+      sender.Send(std::move(last));
+    sent.sendSeconds = sender.BlockedSeconds() - blocked;
+    sent.encodeSeconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - started)
+                             .count() -
+                         sent.sendSeconds;
+    return sent;
+  }
 
-  for (const auto &r : rects) {
-    // Rect Header (12 bytes)
-    // X, Y, W, H, Encoding (0 = Raw)
-    uint8_t rh[12];
-    rh[0] = (r.x >> 8) & 0xFF;
-    rh[1] = r.x & 0xFF;
-    rh[2] = (r.y >> 8) & 0xFF;
-    rh[3] = r.y & 0xFF;
-    rh[4] = (r.w >> 8) & 0xFF;
-    rh[5] = r.w & 0xFF;
-    rh[6] = (r.h >> 8) & 0xFF;
-    rh[7] = r.h & 0xFF;
-    rh[8] = 0;
-    rh[9] = 0;
-    rh[10] = 0;
-    rh[11] = 0; // Raw Encoding
-    send(s, (char *)rh, 12, 0);
-
-    // Pixel Data (Raw)
-    // Send line by line
-    for (int y = 0; y < r.h; y++) {
-      int srcIdx = ((r.y + y) * fbW + r.x) * 4;
-      send(s, (char *)&fb[srcIdx], r.w * 4, 0);
+  EncodeShared(*pending, snapshot, enc, zones, pieces, parts);
+  for (size_t i = 0; i < parts.size(); i++) {
+    count += parts[i]->count;
+    refinement.MarkSent(pieces[i], parts[i]->lossy);
+  }
+  auto encoded = std::chrono::steady_clock::now();
+  sent.encodeSeconds = std::chrono::duration<double>(encoded - started).count();
+  SendParts(sender, msg, count, parts, sent);
+  return sent;
+}
+
+SentUpdate VncServer::SendKeyframe(ClientSender &sender,
+                                   const FrameSnapshot &snapshot,
+                                   KeyframePtr keyframe,
+                                   const ClientEncodings &enc,
+                                   RefinementTracker &refinement,
+                                   const PseudoRects &pseudo,
+                                   uint64_t &keyframeFrame) {
+  SentUpdate sent;
+  refinement.Resize(snapshot.width, snapshot.height);
+  auto started = std::chrono::steady_clock::now();
+
+  if (!keyframe) {
+    auto fresh = std::make_shared<Keyframe>();
+    fresh->frame = snapshot.frame;
+    EncodeShared(
+        std::vector<Rect>(1, Rect{0, 0, snapshot.width, snapshot.height}),
+        snapshot, enc, UpdateZones(), fresh->rects, fresh->parts);
+    // A resize meanwhile has emptied the cache, which must stay so
+    std::lock_guard<std::mutex> lock(this->framebufferMutex);
+    if (snapshot.layoutVersion == this->layoutVersion)
+      this->keyframes.Store(SharedEncodeKey(0, Rect{0, 0, 0, 0}, enc), fresh);
+    keyframe = fresh;
+  }
+  keyframeFrame = keyframe->frame;
+
+  std::vector<uint8_t> msg(4, 0);
+  msg.insert(msg.end(), pseudo.bytes.begin(), pseudo.bytes.end());
+  int count = pseudo.count;
+  for (size_t i = 0; i < keyframe->parts.size(); i++) {
+    count += keyframe->parts[i]->count;
+    refinement.MarkSent(keyframe->rects[i], keyframe->parts[i]->lossy);
+  }
+  sent.encodeSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - started)
+                           .count();
+  SendParts(sender, msg, count, keyframe->parts, sent);
+  return sent;
+}
+
+void VncServer::EncodeShared(const std::vector<Rect> &rects,
+                             const FrameSnapshot &snapshot,
+                             const ClientEncodings &enc,
+                             const UpdateZones &zones,
+                             std::vector<Rect> &pieces,
+                             std::vector<EncodedRectsPtr> &parts,
+                             const std::function<void(int)> &ready) {
+  // Everything else is stateless: encode once per frame, share the bytes.
+  // Compressed rects are tiled and the tiles encoded on the shared pool;
+  // Raw/RRE are cheap and gain nothing from smaller pieces.
+  bool tight = enc.preferred == ENCODING_TIGHT_PNG;
+  if (tight) {
+    for (const auto &r : rects)
+      SplitIntoTiles(r, ENCODE_TILE_W, ENCODE_TILE_H, pieces);
+  } else {
+    pieces = rects;
+  }
+
+  // Zones are cut out of the pieces they touch: focus pieces move ahead of
+  // the rest, video pieces to the end
+  size_t focused = 0;
+  size_t videoFrom = pieces.size();
+  if (!zones.focus.empty() || !zones.video.empty()) {
+    std::vector<Rect> first, rest = pieces, last;
+    auto cut = [&rest](const std::vector<Rect> &zone,
+                       std::vector<Rect> &into) {
+      for (const auto &z : zone) {
+        std::vector<Rect> outside;
+        for (const auto &p : rest) {
+          Rect inside = IntersectRect(p, z);
+          if (inside.w <= 0 || inside.h <= 0) {
+            outside.push_back(p);
+            continue;
+          }
+          into.push_back(inside);
+          SubtractRect(p, z, outside);
+        }
+        rest.swap(outside);
+      }
+    };
+    cut(zones.focus, first);
+    cut(zones.video, last);
+    focused = first.size();
+    videoFrom = first.size() + rest.size();
+    pieces.swap(first);
+    pieces.insert(pieces.end(), rest.begin(), rest.end());
+    pieces.insert(pieces.end(), last.begin(), last.end());
+  }
+  ClientEncodings boosted = enc;
+  ClientEncodings capped = enc;
+  if (enc.qualityLevel >= 0) {
+    boosted.qualityLevel =
+        std::min(9, enc.qualityLevel + this->roiQualityBoost);
+    capped.qualityLevel = std::min(enc.qualityLevel, VIDEO_REGION_QUALITY);
+  }
+
+  parts.assign(pieces.size(), nullptr);
+  auto encodePiece = [&](int i) {
+    const Rect &r = pieces[i];
+    const ClientEncodings &pieceEnc = (size_t)i < focused    ? boosted
+                                      : (size_t)i >= videoFrom ? capped
+                                                               : enc;
+    EncodeKey key = SharedEncodeKey(snapshot.frame, r, pieceEnc);
+    parts[i] = this->encodeCache.Get(key, [&](EncodedRects &out) {
+      // Raw is a copy, cheaper than hashing and looking it up
+      bool cacheable =
+          pieceEnc.preferred != ENCODING_RAW && this->contentCache.Enabled();
+      ContentKey content = {0, key};
+      if (cacheable) {
+        content.hash = HashRect(snapshot.pixels, snapshot.width, r);
+        content.settings.frame = 0;
+        if (EncodedRectsPtr hit = this->contentCache.Find(content)) {
+          out = *hit;
+          return;
+        }
+      }
+      if (tight) {
+        out.count = EncodeTightPngRect(
+            snapshot.pixels, snapshot.width, r, pieceEnc.qualityLevel,
+            pieceEnc.compressLevel,
+            snapshot.motion.Changes(
+                Rect{r.x * pieceEnc.scale, r.y * pieceEnc.scale,
+                     r.w * pieceEnc.scale, r.h * pieceEnc.scale}),
+            &this->classifierStats,
+            out.bytes, &out.lossy);
+      } else {
+        out.count = EncodePlainRect(snapshot.pixels, snapshot.width, r,
+                                    pieceEnc, out.bytes);
+      }
+      if (cacheable)
+        this->contentCache.Insert(content,
+                                  std::make_shared<EncodedRects>(out));
+    });
+  };
+  if (ready)
+    this->encodePool.ParallelForOrdered((int)pieces.size(), encodePiece,
+                                        ready);
+  else
+    this->encodePool.ParallelFor((int)pieces.size(), encodePiece);
+}
+
+void VncServer::SendParts(ClientSender &sender, std::vector<uint8_t> &msg,
+                          int count, const std::vector<EncodedRectsPtr> &parts,
+                          SentUpdate &sent) {
+  if (count == 0)
+    return;
+  double blocked = sender.BlockedSeconds();
+  msg[2] = (count >> 8) & 0xFF;
+  msg[3] = count & 0xFF;
+  sent.bytes = msg.size();
+  if (sender.Send(std::move(msg))) {
+    for (const auto &part : parts) {
+      if (!sender.Send(part))
+        break;
+      sent.bytes += part->bytes.size();
     }
   }
+  sent.sendSeconds = sender.BlockedSeconds() - blocked;
 }
-#endif
 
 // --- Capture Logic ---
 
-void VncServer::CaptureLoop() {
+bool VncServer::ResizeFramebuffer(int w, int h,
+                                  const std::vector<Rect> &screens, int left,
+                                  int top) {
+  bool sameLayout = screens.size() == this->screens.size() &&
+                    left == this->desktopLeft && top == this->desktopTop;
+  for (size_t i = 0; sameLayout && i < screens.size(); i++)
+    sameLayout = SameRect(screens[i], this->screens[i]);
+  if (w == this->width && h == this->height && sameLayout &&
+      this->serverFramebuffer.size() == (size_t)w * h * 4)
+    return false;
+  this->width = w;
+  this->height = h;
+  this->screens = screens;
+  this->desktopLeft = left;
+  this->desktopTop = top;
+  this->layoutVersion++;
+  this->serverFramebuffer.assign((size_t)w * h * 4, 0);
+  // The next frame counts as the first: clients that fall back on history
+  // or a keyframe get the whole new screen instead
+  this->previousFramebuffer.clear();
+  this->damageHistory.Clear();
+  this->keyframes.Clear();
+  this->motionDetector.Clear();
+  this->motionRegion = {0, 0, 0, 0};
+  this->videoRegions.clear();
+  this->injector.SetDesktopSize(w, h);
+  return true;
+}
+
+void VncServer::SetCaptureLayout(int w, int h,
+                                 const std::vector<Rect> &screens, int left,
+                                 int top) {
+  // The process stage resizes the shared framebuffer when the first patch
+  // at the new layout arrives, which carries the whole frame
+  this->captureWidth = w;
+  this->captureHeight = h;
+  this->captureScreens = screens;
+  this->captureLeft = left;
+  this->captureTop = top;
+  this->captureBuffer.assign((size_t)w * h * 4, 0);
+  this->captureFull = true;
+  int outputs = std::max(1, (int)screens.size());
+  if (this->capturePool.Size() != outputs)
+    this->capturePool.Start(outputs);
+}
+
+uint16_t VncServer::RequestDesktopSize(int w, int h) {
+  if (w <= 0 || h <= 0)
+    return EDS_STATUS_INVALID_LAYOUT;
+  if (!this->allowResize)
+    return EDS_STATUS_PROHIBITED;
 #ifdef _WIN32
-  InitializeDXGI();
+  // ChangeDisplaySettingsEx without a device name switches the primary
+  // monitor only
+  if (this->dxgiOutputs.size() > 1)
+    return EDS_STATUS_PROHIBITED;
+  // The capture notices the mode switch through DXGI_ERROR_ACCESS_LOST
+  DEVMODEW mode = {};
+  mode.dmSize = sizeof(mode);
+  if (!EnumDisplaySettingsW(nullptr, ENUM_CURRENT_SETTINGS, &mode))
+    return EDS_STATUS_OUT_OF_RESOURCES;
+  mode.dmPelsWidth = w;
+  mode.dmPelsHeight = h;
+  mode.dmFields = DM_PELSWIDTH | DM_PELSHEIGHT;
+  return ChangeDisplaySettingsExW(nullptr, &mode, nullptr, 0, nullptr) ==
+                 DISP_CHANGE_SUCCESSFUL
+             ? EDS_STATUS_OK
+             : EDS_STATUS_INVALID_LAYOUT;
+#else
+  // Mode switches need RandR, which the X11 capture does not use
+  return EDS_STATUS_PROHIBITED;
+#endif
+}
 
-  while (this->running && this->captureRunning) {
-    if (this->activeClients == 0) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+void VncServer::ProcessLoop() {
+  // Drains what the capture stage queued before it stopped
+  for (;;) {
+    std::unique_ptr<FramePatch> patch;
+    if (!this->filledPatches.TryPop(patch)) {
+      if (!this->processRunning)
+        return;
+      this->patchFilled.Wait(std::chrono::milliseconds(100));
       continue;
     }
+    auto started = std::chrono::steady_clock::now();
+    ProcessFrame(*patch);
+    auto done = std::chrono::steady_clock::now();
+    this->processStage.Record(
+        std::chrono::duration<double, std::milli>(done - started).count(),
+        std::chrono::duration<double, std::milli>(done - patch->capturedAt)
+            .count());
+    this->freePatches.TryPush(patch);
+    this->patchFreed.Ring();
+    this->frameProcessed.Ring();
+  }
+}
 
-    std::vector<uint8_t> frameBuffer; // Not used, we use serverFramebuffer
-    int frameW, frameH;
-    std::vector<Rect> dirtyRects;
-
-    if (AcquireFrame(frameBuffer, frameW, frameH, dirtyRects)) {
-      // Frame Acquired!
+void VncServer::KeyframeLoop() {
+  // Keyframes exist for the settings joiners use. While the screen moves
+  // they are replaced here, before they get too old to serve.
+  FrameSnapshot snapshot;
+  while (this->keyframeRunning) {
+    this->frameProcessed.Wait(std::chrono::milliseconds(100));
+    std::vector<EncodeKey> stale;
+    std::vector<Rect> whole;
+    {
       std::lock_guard<std::mutex> lock(this->framebufferMutex);
+      if (this->activeClients == 0 ||
+          this->frameCounter <= (uint64_t)KEYFRAME_REFRESH_AGE)
+        continue;
+      this->keyframes.Stale(
+          std::max(this->damageHistory.Horizon(),
+                   this->frameCounter - KEYFRAME_REFRESH_AGE),
+          stale);
+      if (stale.empty())
+        continue;
+      whole.push_back({0, 0, this->width, this->height});
+      TakeSnapshot(whole, snapshot);
+    }
+    for (const auto &settings : stale) {
+      auto fresh = std::make_shared<Keyframe>();
+      fresh->frame = snapshot.frame;
+      EncodeShared(whole, snapshot, KeyEncodings(settings), UpdateZones(),
+                   fresh->rects, fresh->parts);
+      // A resize meanwhile has emptied the cache, which must stay so
+      std::lock_guard<std::mutex> lock(this->framebufferMutex);
+      if (snapshot.layoutVersion == this->layoutVersion)
+        this->keyframes.Store(settings, fresh);
+    }
+  }
+}
 
-      // Update Dirty Rects
-      this->currentDirtyRects = dirtyRects;
-
-      // If full update needed (e.g. first frame), add full rect
-      if (dirtyRects.empty()) {
-        this->currentDirtyRects.push_back({0, 0, this->width, this->height});
-      }
+void VncServer::ProcessFrame(FramePatch &patch) {
+  // No damage metadata: find changed tiles by hashing the frame, still in
+  // the patch and outside the lock (only this thread uses the hasher).
+  // Otherwise the hashes under the reported damage go stale.
+  std::vector<Rect> dirtyRects;
+  if (patch.hash) {
+    this->tileHasher.Update(patch.pixels.data(), patch.width, patch.height,
+                            dirtyRects);
+  } else {
+    dirtyRects = patch.rects;
+    for (const auto &r : dirtyRects)
+      this->tileHasher.Invalidate(r);
+  }
 
-      this->frameCounter++;
-      this->frameCv.notify_all(); // Wake up waiting clients
+  // A new layout and the frame at it are published in one go: no client
+  // sees the cleared framebuffer, nor keyframes it
+  std::lock_guard<std::mutex> lock(this->framebufferMutex);
+  bool resized = ResizeFramebuffer(patch.width, patch.height, patch.screens,
+                                   patch.left, patch.top);
+  // A whole frame is laid out like the framebuffer: swapped in, not copied
+  if (patch.hash)
+    this->serverFramebuffer.swap(patch.pixels);
+  else
+    UnpackRects(patch.pixels, patch.rects, this->serverFramebuffer.data(),
+                this->width);
+
+  // Check reported damage against the last frame: byte-identical rects
+  // are dropped, over-reported ones trimmed to the changed pixels
+  std::vector<uint8_t> &prev = this->previousFramebuffer;
+  const std::vector<uint8_t> &cur = this->serverFramebuffer;
+  std::vector<Rect> changed;
+  if (prev.size() != cur.size()) {
+    prev = cur;
+    for (const auto &d : dirtyRects) {
+      Rect r = ClipRect(d, this->width, this->height);
+      if (r.w > 0 && r.h > 0)
+        changed.push_back(r);
     }
+  } else {
+    this->damageTrimmer.Process(prev.data(), cur.data(), this->width,
+                                this->height, dirtyRects,
+                                this->activeClients, changed);
+  }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(33));
+  this->motionDetector.Update(changed, this->width, this->height);
+  if (this->h264Mode == H264_MOTION)
+    this->motionRegion = this->motionDetector.Region();
+  if (this->videoRegionFps > 0)
+    this->videoRegions = this->motionDetector.Regions();
+
+  // Pointer changes reach clients without any pixels changing
+  bool cursorChanged = false;
+  if (patch.cursor.shapeSerial != this->cursor.shapeSerial) {
+    this->cursor.shape = patch.cursor.shape;
+    this->cursor.shapeSerial = patch.cursor.shapeSerial;
+    cursorChanged = true;
   }
-  CleanupDXGI();
-#endif
+  if (patch.cursor.moveSerial != this->cursor.moveSerial) {
+    this->cursor.x = patch.cursor.x;
+    this->cursor.y = patch.cursor.y;
+    this->cursor.moveSerial = patch.cursor.moveSerial;
+    cursorChanged = true;
+  }
+
+  // Nothing really changed: no new frame for the clients
+  if (!changed.empty()) {
+    this->frameCounter++;
+    this->frameCapturedAt = patch.capturedAt;
+    this->damageHistory.Add(this->frameCounter, changed);
+  }
+  // Wake up waiting clients; after a resize they announce the new size
+  if (!changed.empty() || cursorChanged || resized)
+    this->frameCv.notify_all();
 }
 
+void VncServer::CaptureLoop() {
+#if defined(_WIN32) || defined(__linux__)
+  // Applying frames to the shared framebuffer runs behind the grabs, so
+  // the next grab overlaps the damage checks of the last one
+  this->processRunning = true;
+  this->processThread = std::thread(&VncServer::ProcessLoop, this);
+  this->keyframeRunning = true;
+  this->keyframeThread = std::thread(&VncServer::KeyframeLoop, this);
 #ifdef _WIN32
-void VncServer::InitializeDXGI() {
-  // ... (Same as previous, ensure d3dDevice etc are init) ...
-  // For brevity, assuming previous implementation or standard DXGI init
-  D3D11_CREATE_DEVICE_FLAG flags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
-  D3D_FEATURE_LEVEL featureLevels[] = {D3D_FEATURE_LEVEL_11_0};
-  D3D_FEATURE_LEVEL featureLevel;
-  D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, flags,
-                    featureLevels, 1, D3D11_SDK_VERSION, &d3dDevice,
-                    &featureLevel, &d3dContext);
-
-  IDXGIDevice *dxgiDevice = nullptr;
-  d3dDevice->QueryInterface(__uuidof(IDXGIDevice), (void **)&dxgiDevice);
-  IDXGIAdapter *dxgiAdapter = nullptr;
-  dxgiDevice->GetParent(__uuidof(IDXGIAdapter), (void **)&dxgiAdapter);
-  dxgiDevice->Release();
-  IDXGIOutput *dxgiOutput = nullptr;
-  dxgiAdapter->EnumOutputs(0, &dxgiOutput);
-  dxgiAdapter->Release();
-  IDXGIOutput1 *dxgiOutput1 = nullptr;
-  dxgiOutput->QueryInterface(__uuidof(IDXGIOutput1), (void **)&dxgiOutput1);
-  dxgiOutput->Release();
-  dxgiOutput1->DuplicateOutput(d3dDevice, &dxgiOutputDuplication);
-  dxgiOutput1->Release();
-  dxgiOutputDuplication->GetDesc(&outputDuplDesc);
-
-  // Update dimensions from DXGI
-  this->width = outputDuplDesc.ModeDesc.Width;
-  this->height = outputDuplDesc.ModeDesc.Height;
-  this->serverFramebuffer.resize(this->width * this->height * 4);
-}
-
-void VncServer::CleanupDXGI() {
-  if (stagingTexture) {
-    stagingTexture->Release();
-    stagingTexture = nullptr;
-  }
-  if (dxgiOutputDuplication) {
-    dxgiOutputDuplication->Release();
-    dxgiOutputDuplication = nullptr;
-  }
-  if (d3dContext) {
-    d3dContext->Release();
-    d3dContext = nullptr;
-  }
-  if (d3dDevice) {
-    d3dDevice->Release();
-    d3dDevice = nullptr;
-  }
-}
-
-bool VncServer::AcquireFrame(std::vector<uint8_t> &buffer, int &width,
-                             int &height, std::vector<Rect> &dirtyRects) {
-  if (!dxgiOutputDuplication)
-    return false;
+  InitializeDXGI();
+#else
+  InitializeX11();
+#endif
 
-  DXGI_OUTDUPL_FRAME_INFO frameInfo;
-  IDXGIResource *desktopResource = nullptr;
-  HRESULT hr = dxgiOutputDuplication->AcquireNextFrame(100, &frameInfo,
-                                                       &desktopResource);
-  if (FAILED(hr))
-    return false;
+  while (this->running && this->captureRunning) {
+    // Only while clients want frames, and no faster than maxFps
+    if (!this->pacer.WaitForCapture(std::chrono::milliseconds(100)) ||
+        this->activeClients == 0)
+      continue;
 
-  // Get Dirty Rects from DXGI metadata
-  if (frameInfo.TotalMetadataBufferSize > 0) {
-    UINT bufSize = frameInfo.TotalMetadataBufferSize;
-    std::vector<BYTE> metaBuf(bufSize);
-    UINT moveCount = 0;
-
-    hr = dxgiOutputDuplication->GetFrameMoveRects(
-        bufSize, (DXGI_OUTDUPL_MOVE_RECT *)metaBuf.data(), &moveCount);
-
-    // Get Dirty Rects
-    UINT dirtyCount = 0;
-    hr = dxgiOutputDuplication->GetFrameDirtyRects(
-        bufSize, (RECT *)metaBuf.data(), &dirtyCount);
-
-    if (SUCCEEDED(hr) && dirtyCount > 0) {
-      RECT *rects = (RECT *)metaBuf.data();
-      for (UINT i = 0; i < dirtyCount; i++) {
-        dirtyRects.push_back({(int)rects[i].left, (int)rects[i].top,
-                              (int)(rects[i].right - rects[i].left),
-                              (int)(rects[i].bottom - rects[i].top)});
+    auto started = std::chrono::steady_clock::now();
+    std::vector<Rect> dirtyRects;
+    bool unknown = false;
+    if (!AcquireFrame(dirtyRects, unknown))
+      continue;
+
+    // The process stage returns patches as it is done with them
+    std::unique_ptr<FramePatch> patch;
+    while (!this->freePatches.TryPop(patch) && this->running &&
+           this->captureRunning)
+      this->patchFreed.Wait(std::chrono::milliseconds(100));
+    if (!patch)
+      break;
+    // A returned whole-frame patch holds an old frame at its layout
+    bool sameLayout = patch->width == this->captureWidth &&
+                      patch->height == this->captureHeight &&
+                      patch->screens.size() == this->captureScreens.size();
+    for (size_t i = 0; sameLayout && i < patch->screens.size(); i++)
+      sameLayout = SameRect(patch->screens[i], this->captureScreens[i]);
+    patch->width = this->captureWidth;
+    patch->height = this->captureHeight;
+    patch->screens = this->captureScreens;
+    patch->left = this->captureLeft;
+    patch->top = this->captureTop;
+    patch->hash = unknown || this->captureFull;
+    patch->rects.clear();
+    if (patch->hash) {
+      patch->rects.push_back({0, 0, this->captureWidth, this->captureHeight});
+    } else {
+      for (const auto &d : dirtyRects) {
+        Rect r = ClipRect(d, this->captureWidth, this->captureHeight);
+        if (r.w > 0 && r.h > 0)
+          patch->rects.push_back(r);
       }
     }
+    this->captureFull = false;
+    if (patch->hash && this->captureRewrites) {
+      // The next grab overwrites all of the buffer anyway: hand this one
+      // over and grab into the old frame the patch brings back
+      patch->pixels.swap(this->captureBuffer);
+      if (!sameLayout || this->captureBuffer.size() != patch->pixels.size())
+        this->captureBuffer.assign(patch->pixels.size(), 0);
+    } else {
+      PackRects(this->captureBuffer.data(), this->captureWidth, patch->rects,
+                patch->pixels);
+    }
+    patch->cursor = this->capturedCursor;
+    patch->capturedAt = started;
+    this->filledPatches.TryPush(patch); // Cannot be full: patches go round
+    this->patchFilled.Ring();
+    double busy = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - started)
+                      .count();
+    this->captureStage.Record(busy, busy);
   }
+  this->processRunning = false;
+  this->patchFilled.Ring();
+  this->processThread.join();
+  this->keyframeRunning = false;
+  this->frameProcessed.Ring();
+  this->keyframeThread.join();
+  this->capturePool.Stop();
+#ifdef _WIN32
+  CleanupDXGI();
+#else
+  CleanupX11();
+#endif
+#endif
+}
 
-  // If no dirty rects, assume full update (e.g., first frame or accumulation)
-  if (dirtyRects.empty()) {
-    dirtyRects.push_back({0, 0, this->width, this->height});
+#ifdef _WIN32
+void VncServer::InitializeDXGI() {
+  CleanupDXGI();
+  for (const auto &id : DxgiCapture::ListOutputs()) {
+    if (!this->allMonitors && !id.primary)
+      continue;
+    auto output = std::make_unique<DxgiCapture>();
+    if (output->Initialize(id))
+      this->dxgiOutputs.push_back(std::move(output));
   }
+  if (this->dxgiOutputs.empty())
+    return;
 
-  ID3D11Texture2D *desktopImage = nullptr;
-  desktopResource->QueryInterface(__uuidof(ID3D11Texture2D),
-                                  (void **)&desktopImage);
-  desktopResource->Release();
+  // The virtual framebuffer is the bounding box of the captured monitors
+  int left = INT_MAX, top = INT_MAX, right = INT_MIN, bottom = INT_MIN;
+  for (const auto &o : this->dxgiOutputs) {
+    left = std::min(left, o->Left());
+    top = std::min(top, o->Top());
+    right = std::max(right, o->Left() + o->Width());
+    bottom = std::max(bottom, o->Top() + o->Height());
+  }
+  std::vector<Rect> areas;
+  for (const auto &o : this->dxgiOutputs)
+    areas.push_back({o->Left() - left, o->Top() - top, o->Width(),
+                     o->Height()});
+  SetCaptureLayout(right - left, bottom - top, areas, left, top);
+}
 
-  if (!stagingTexture) {
-    D3D11_TEXTURE2D_DESC desc;
-    desktopImage->GetDesc(&desc);
-    desc.Usage = D3D11_USAGE_STAGING;
-    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-    desc.BindFlags = 0;
-    desc.MiscFlags = 0;
-    d3dDevice->CreateTexture2D(&desc, nullptr, &stagingTexture);
+void VncServer::CleanupDXGI() { this->dxgiOutputs.clear(); }
+
+bool VncServer::AcquireFrame(std::vector<Rect> &dirtyRects, bool &unknown) {
+  if (this->dxgiOutputs.empty()) {
+    auto now = std::chrono::steady_clock::now();
+    if (now < dxgiRetryAt)
+      return false;
+    dxgiRetryAt = now + std::chrono::milliseconds(500);
+    InitializeDXGI();
+    if (this->dxgiOutputs.empty())
+      return false;
   }
 
-  d3dContext->CopyResource(stagingTexture, desktopImage);
-  desktopImage->Release();
+  // Outputs are grabbed in parallel, each into its place in the virtual
+  // framebuffer with its own damage. With several, none may wait: an idle
+  // monitor would hold back a busy one.
+  int count = (int)this->dxgiOutputs.size();
+  std::vector<DxgiCapture::GrabResult> results(count);
+  std::vector<std::vector<Rect>> damage(count);
+  std::vector<char> needsHash(count, 0);
+  size_t stride = (size_t)this->captureWidth * 4;
+  auto grab = [&](int i) {
+    const Rect &area = this->captureScreens[i];
+    bool hash = false;
+    results[i] = this->dxgiOutputs[i]->Grab(
+        this->captureBuffer.data() +
+            ((size_t)area.y * this->captureWidth + area.x) * 4,
+        stride, count == 1 ? 100 : 0, damage[i], hash);
+    needsHash[i] = hash;
+  };
+  if (count == 1)
+    grab(0);
+  else
+    this->capturePool.ParallelFor(count, grab);
+
+  bool any = false;
+  for (int i = 0; i < count; i++) {
+    if (results[i] == DxgiCapture::GRAB_LOST) {
+      // Mode switch (or desktop switch): duplicate the outputs again,
+      // which picks up the new layout
+      InitializeDXGI();
+      return false;
+    }
+    any = any || results[i] == DxgiCapture::GRAB_FRAME;
+  }
+  if (!any)
+    return false;
 
-  D3D11_MAPPED_SUBRESOURCE map;
-  if (SUCCEEDED(d3dContext->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &map))) {
-    // Copy to serverFramebuffer
-    // Convert BGRA -> RGBA
-    uint8_t *src = (uint8_t *)map.pData;
-    uint8_t *dst = this->serverFramebuffer.data();
-    int w = this->width;
-    int h = this->height;
+  // Damage in framebuffer coordinates. An output without metadata makes
+  // it unknown, so the whole frame is hashed. A frame with only pointer
+  // updates has none.
+  for (int i = 0; i < count; i++) {
+    unknown = unknown || needsHash[i];
+    for (const auto &r : damage[i])
+      dirtyRects.push_back({r.x + this->captureScreens[i].x,
+                            r.y + this->captureScreens[i].y, r.w, r.h});
+  }
 
-    for (int i = 0; i < w * h; i++) {
-      dst[i * 4 + 0] = src[i * 4 + 2]; // R
-      dst[i * 4 + 1] = src[i * 4 + 1]; // G
-      dst[i * 4 + 2] = src[i * 4 + 0]; // B
-      dst[i * 4 + 3] = 255;            // A
+  // Pointer: a new shape may come from any output, the position from the
+  // one it is on
+  bool shapeChanged = false;
+  int owner = -1;
+  for (int i = 0; i < count; i++) {
+    shapeChanged = this->dxgiOutputs[i]->TakeShape(pointerShape) ||
+                   shapeChanged;
+    if (owner < 0 && this->dxgiOutputs[i]->PointerVisible())
+      owner = i;
+  }
+  bool visible = owner >= 0;
+  shapeChanged = shapeChanged || visible != pointerVisible;
+  pointerVisible = visible;
+  if (visible) {
+    // DXGI reports the shape's top-left corner
+    int x = this->captureScreens[owner].x +
+            this->dxgiOutputs[owner]->PointerX() + pointerShape.hotX;
+    int y = this->captureScreens[owner].y +
+            this->dxgiOutputs[owner]->PointerY() + pointerShape.hotY;
+    if (x != capturedCursor.x || y != capturedCursor.y) {
+      capturedCursor.x = x;
+      capturedCursor.y = y;
+      capturedCursor.moveSerial++;
     }
+  }
+  if (shapeChanged) {
+    capturedCursor.shape = pointerVisible ? pointerShape : CursorImage();
+    capturedCursor.shapeSerial++;
+  }
+  return true;
+}
 
-    d3dContext->Unmap(stagingTexture, 0);
+#elif defined(__linux__)
+void VncServer::InitializeX11() {
+  auto first = std::make_unique<X11Capture>();
+  if (!first->Initialize()) {
+    std::cerr << "VncServer: cannot open X display (is $DISPLAY set?)"
+              << std::endl;
+    return;
+  }
+  int count = this->allMonitors ? first->Screens() : 1;
+  if (count == 1) {
+    this->x11Screens.push_back(std::move(first));
+  } else {
+    // One connection per screen, so they can be grabbed in parallel
+    first.reset();
+    for (int i = 0; i < count; i++) {
+      auto screen = std::make_unique<X11Capture>();
+      if (screen->Initialize(nullptr, i))
+        this->x11Screens.push_back(std::move(screen));
+    }
   }
+  LayoutX11();
+}
 
-  dxgiOutputDuplication->ReleaseFrame();
-  return true;
+void VncServer::LayoutX11() {
+  // X screens have no relative placement: side by side, top-aligned
+  std::vector<Rect> areas;
+  int w = 0, h = 0;
+  for (const auto &screen : this->x11Screens) {
+    areas.push_back({w, 0, screen->Width(), screen->Height()});
+    w += screen->Width();
+    h = std::max(h, screen->Height());
+  }
+  SetCaptureLayout(w, h, areas);
+  this->captureRewrites = true;
 }
 
+void VncServer::CleanupX11() { this->x11Screens.clear(); }
+
+bool VncServer::AcquireFrame(std::vector<Rect> &dirtyRects, bool &unknown) {
+  // Plain screen grabs: no damage metadata, the process stage hashes the
+  // frame to find what changed. The pointer comes from XFixes, if
+  // available.
+  (void)dirtyRects;
+  unknown = true;
+  int count = (int)this->x11Screens.size();
+  if (count == 0)
+    return false;
+  bool resized = false;
+  for (const auto &screen : this->x11Screens)
+    resized = screen->CheckResize() || resized;
+  if (resized)
+    LayoutX11();
+
+  std::vector<char> grabbed(count, 0);
+  size_t stride = (size_t)this->captureWidth * 4;
+  auto grab = [&](int i) {
+    const Rect &area = this->captureScreens[i];
+    grabbed[i] = this->x11Screens[i]->Grab(
+        this->captureBuffer.data() +
+            ((size_t)area.y * this->captureWidth + area.x) * 4,
+        stride);
+  };
+  if (count == 1)
+    grab(0);
+  else
+    this->capturePool.ParallelFor(count, grab);
+
+  for (int i = 0; i < count; i++)
+    if (this->x11Screens[i]->GrabCursor(capturedCursor,
+                                        this->captureScreens[i].x,
+                                        this->captureScreens[i].y))
+      break;
+  // Grabs go into recycled buffers, where a screen that failed would show
+  // an older frame: only complete frames count
+  return std::find(grabbed.begin(), grabbed.end(), 0) == grabbed.end();
+}
 #endif
 
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
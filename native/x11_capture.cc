@@ -0,0 +1,260 @@
+#include "x11_capture.h"
+
+#include <cstring>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xfixes.h>
+
+struct X11Capture::State {
+  Display *display = nullptr;
+  int screen = 0;
+  Window root = 0;
+  XImage *shmImage = nullptr;
+  XShmSegmentInfo shm;
+  bool useShm = false;
+  bool hasXFixes = false;
+  bool haveCursor = false;
+  unsigned long cursorSerial = 0;
+};
+
+// --- Helpers ---
+
+// XShmAttach fails asynchronously on remote displays; the default X error
+// handler would exit the whole process
+static bool x11AttachFailed = false;
+static int X11AttachErrorHandler(Display *, XErrorEvent *) {
+  x11AttachFailed = true;
+  return 0;
+}
+
+static uint8_t MaskToByte(unsigned long pixel, unsigned long mask) {
+  if (!mask)
+    return 0;
+  int shift = 0;
+  while (!(mask & 1)) {
+    mask >>= 1;
+    shift++;
+  }
+  unsigned long v = (pixel >> shift) & mask;
+  return (uint8_t)(v * 255 / mask);
+}
+
+static void ConvertImage(XImage *img, uint8_t *dst, size_t stride, int w,
+                         int h) {
+  // Common case: 24-bit TrueColor in 32-bit little-endian BGRX
+  if (img->bits_per_pixel == 32 && img->byte_order == LSBFirst &&
+      img->red_mask == 0xFF0000 && img->green_mask == 0xFF00 &&
+      img->blue_mask == 0xFF) {
+    for (int y = 0; y < h; y++) {
+      const uint8_t *src = (const uint8_t *)img->data + y * img->bytes_per_line;
+      uint8_t *out = dst + y * stride;
+      for (int x = 0; x < w; x++) {
+        out[x * 4 + 0] = src[x * 4 + 2]; // R
+        out[x * 4 + 1] = src[x * 4 + 1]; // G
+        out[x * 4 + 2] = src[x * 4 + 0]; // B
+        out[x * 4 + 3] = 255;            // A
+      }
+    }
+    return;
+  }
+
+  for (int y = 0; y < h; y++) {
+    uint8_t *out = dst + y * stride;
+    for (int x = 0; x < w; x++) {
+      unsigned long p = XGetPixel(img, x, y);
+      out[x * 4 + 0] = MaskToByte(p, img->red_mask);
+      out[x * 4 + 1] = MaskToByte(p, img->green_mask);
+      out[x * 4 + 2] = MaskToByte(p, img->blue_mask);
+      out[x * 4 + 3] = 255;
+    }
+  }
+}
+
+// --- Capture ---
+
+X11Capture::~X11Capture() { Cleanup(); }
+
+bool X11Capture::Initialize(const char *displayName, int screen) {
+  Cleanup();
+  Display *display = XOpenDisplay(displayName);
+  if (!display)
+    return false;
+  if (screen < 0)
+    screen = DefaultScreen(display);
+  if (screen >= ScreenCount(display)) {
+    XCloseDisplay(display);
+    return false;
+  }
+
+  state = new State();
+  state->display = display;
+  state->screen = screen;
+  state->root = RootWindow(display, screen);
+  width = DisplayWidth(display, screen);
+  height = DisplayHeight(display, screen);
+  int eventBase, errorBase;
+  state->hasXFixes = XFixesQueryExtension(display, &eventBase, &errorBase);
+
+  if (XShmQueryExtension(display))
+    CreateShmImage();
+  return true; // XGetImage works without SHM
+}
+
+void X11Capture::CreateShmImage() {
+  Display *display = state->display;
+  int screen = state->screen;
+  XShmSegmentInfo &shm = state->shm;
+  memset(&shm, 0, sizeof(shm));
+  XImage *img =
+      XShmCreateImage(display, DefaultVisual(display, screen),
+                      DefaultDepth(display, screen), ZPixmap, nullptr, &shm,
+                      width, height);
+  if (!img)
+    return;
+
+  shm.shmid = shmget(IPC_PRIVATE, (size_t)img->bytes_per_line * img->height,
+                     IPC_CREAT | 0600);
+  if (shm.shmid < 0) {
+    XDestroyImage(img);
+    return;
+  }
+  shm.shmaddr = img->data = (char *)shmat(shm.shmid, nullptr, 0);
+  shm.readOnly = False;
+
+  bool attached = false;
+  if (shm.shmaddr != (char *)-1) {
+    x11AttachFailed = false;
+    XErrorHandler previous = XSetErrorHandler(X11AttachErrorHandler);
+    attached = XShmAttach(display, &shm) && (XSync(display, False), true) &&
+               !x11AttachFailed;
+    XSetErrorHandler(previous);
+  }
+  // Segment is freed once both sides detach
+  shmctl(shm.shmid, IPC_RMID, nullptr);
+
+  if (!attached) {
+    if (shm.shmaddr != (char *)-1)
+      shmdt(shm.shmaddr);
+    img->data = nullptr;
+    XDestroyImage(img);
+    return;
+  }
+  state->shmImage = img;
+  state->useShm = true;
+}
+
+void X11Capture::DestroyShmImage() {
+  if (!state->useShm)
+    return;
+  XShmDetach(state->display, &state->shm);
+  state->shmImage->data = nullptr; // Owned by the SHM segment
+  XDestroyImage(state->shmImage);
+  shmdt(state->shm.shmaddr);
+  state->shmImage = nullptr;
+  state->useShm = false;
+}
+
+void X11Capture::Cleanup() {
+  if (!state)
+    return;
+  DestroyShmImage();
+  XCloseDisplay(state->display);
+  delete state;
+  state = nullptr;
+}
+
+int X11Capture::Screens() const {
+  return state ? ScreenCount(state->display) : 0;
+}
+
+bool X11Capture::CheckResize() {
+  if (!state)
+    return false;
+  // The root window follows RandR mode switches; DisplayWidth() only does
+  // when the client processes RRScreenChangeNotify
+  XWindowAttributes attrs;
+  if (!XGetWindowAttributes(state->display, state->root, &attrs))
+    return false;
+  if (attrs.width == width && attrs.height == height)
+    return false;
+  bool shm = state->useShm;
+  DestroyShmImage();
+  width = attrs.width;
+  height = attrs.height;
+  if (shm)
+    CreateShmImage();
+  return true;
+}
+
+bool X11Capture::Grab(uint8_t *rgba, size_t stride) {
+  if (!state)
+    return false;
+
+  if (state->useShm) {
+    if (!XShmGetImage(state->display, state->root, state->shmImage, 0, 0,
+                      AllPlanes))
+      return false;
+    ConvertImage(state->shmImage, rgba, stride, width, height);
+    return true;
+  }
+
+  XImage *img = XGetImage(state->display, state->root, 0, 0, width, height,
+                          AllPlanes, ZPixmap);
+  if (!img)
+    return false;
+  ConvertImage(img, rgba, stride, width, height);
+  XDestroyImage(img);
+  return true;
+}
+
+bool X11Capture::GrabCursor(CursorState &cursor, int offsetX, int offsetY) {
+  if (!state || !state->hasXFixes)
+    return false;
+  // XFixes reports root coordinates of whichever screen has the pointer
+  if (ScreenCount(state->display) > 1) {
+    Window rootRet, childRet;
+    int rootX, rootY, winX, winY;
+    unsigned int mask;
+    if (!XQueryPointer(state->display, state->root, &rootRet, &childRet,
+                       &rootX, &rootY, &winX, &winY, &mask))
+      return false;
+  }
+  XFixesCursorImage *img = XFixesGetCursorImage(state->display);
+  if (!img)
+    return false;
+
+  if (!state->haveCursor || img->cursor_serial != state->cursorSerial) {
+    state->haveCursor = true;
+    state->cursorSerial = img->cursor_serial;
+    CursorImage &shape = cursor.shape;
+    shape.width = img->width;
+    shape.height = img->height;
+    shape.hotX = img->xhot;
+    shape.hotY = img->yhot;
+    shape.rgba.resize((size_t)img->width * img->height * 4);
+    // Premultiplied ARGB, one pixel per unsigned long
+    for (size_t i = 0; i < (size_t)img->width * img->height; i++) {
+      unsigned long p = img->pixels[i];
+      uint8_t a = (p >> 24) & 0xFF;
+      uint8_t *out = &shape.rgba[i * 4];
+      out[0] = a ? (uint8_t)(((p >> 16) & 0xFF) * 255 / a) : 0;
+      out[1] = a ? (uint8_t)(((p >> 8) & 0xFF) * 255 / a) : 0;
+      out[2] = a ? (uint8_t)((p & 0xFF) * 255 / a) : 0;
+      out[3] = a;
+    }
+    cursor.shapeSerial++;
+  }
+  int x = img->x + offsetX;
+  int y = img->y + offsetY;
+  if (x != cursor.x || y != cursor.y) {
+    cursor.x = x;
+    cursor.y = y;
+    cursor.moveSerial++;
+  }
+  XFree(img);
+  return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cursor.h"
+
+// Linux screen capture from one screen of an X server (a real display or
+// Xvfb), using MIT-SHM when the server offers it and XGetImage otherwise.
+// Each instance has its own connection, so screens can be grabbed from
+// different threads. Core X11 has
+// no damage metadata, so every grab is a full frame. Grabs do not include
+// the pointer; XFixes reports it separately. X11 headers stay in
+// the .cc: their macros (None, Status, Bool...) clash with everything.
+class X11Capture {
+public:
+  ~X11Capture();
+
+  // `displayName` null means $DISPLAY, `screen` -1 its default screen
+  bool Initialize(const char *displayName = nullptr, int screen = -1);
+  void Cleanup();
+
+  // Screens on the display (Xvfb -screen 0 ... -screen 1 ...)
+  int Screens() const;
+
+  // Picks up a new root window size (xrandr); true when Width()/Height()
+  // changed and the caller must resize its buffer before the next Grab()
+  bool CheckResize();
+
+  int Width() const { return width; }
+  int Height() const { return height; }
+
+  // Copies the root window into `rgba`, Height() rows `stride` bytes apart
+  bool Grab(uint8_t *rgba, size_t stride);
+
+  // Updates `cursor` from XFixes, its position moved by the offsets, and
+  // bumps its serials on changes. False without the XFixes extension or
+  // while the pointer is on another screen.
+  bool GrabCursor(CursorState &cursor, int offsetX = 0, int offsetY = 0);
+
+private:
+  void CreateShmImage();
+  void DestroyShmImage();
+
+  struct State;
+  State *state = nullptr;
+  int width = 0;
+  int height = 0;
+};
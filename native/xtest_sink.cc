@@ -0,0 +1,155 @@
+#include "input_sink.h"
+#include "keysym.h"
+
+#include <dlfcn.h>
+#include <unordered_map>
+
+#include <X11/Xlib.h>
+
+// libXtst is loaded at run time: where it (or the extension) is missing the
+// server still captures, view-only or through uinput
+typedef Bool (*XTestQueryExtensionFn)(Display *, int *, int *, int *, int *);
+typedef int (*XTestFakeKeyEventFn)(Display *, unsigned int, Bool,
+                                   unsigned long);
+typedef int (*XTestFakeButtonEventFn)(Display *, unsigned int, Bool,
+                                      unsigned long);
+typedef int (*XTestFakeMotionEventFn)(Display *, int, int, int,
+                                      unsigned long);
+
+// XTest on its own connection to $DISPLAY (works against Xvfb). Keysyms
+// are looked up in a table of the server's keymap built at start; those
+// it lacks are bound to unused keycodes as they come, so any keysym can be
+// typed. A batch is one flush.
+class XTestSink : public InputSink {
+public:
+  ~XTestSink() override;
+
+  bool Initialize();
+
+  const char *Name() const override { return "xtest"; }
+  void Deliver(const std::vector<InputEvent> &batch) override;
+
+private:
+  void LoadKeymap();
+  // 0 = cannot be typed
+  unsigned Keycode(uint32_t keysym);
+
+  void *library = nullptr;
+  Display *display = nullptr;
+  XTestFakeKeyEventFn fakeKey = nullptr;
+  XTestFakeButtonEventFn fakeButton = nullptr;
+  XTestFakeMotionEventFn fakeMotion = nullptr;
+
+  std::unordered_map<uint32_t, unsigned> keycodes;
+  std::vector<unsigned> spare;              // Keycodes without keysyms
+  std::unordered_map<unsigned, uint32_t> bound; // Spare keycode -> keysym
+  size_t nextSpare = 0;
+};
+
+XTestSink::~XTestSink() {
+  if (this->display)
+    XCloseDisplay(this->display);
+  if (this->library)
+    dlclose(this->library);
+}
+
+bool XTestSink::Initialize() {
+  this->library = dlopen("libXtst.so.6", RTLD_NOW | RTLD_LOCAL);
+  if (!this->library)
+    return false;
+  auto query = (XTestQueryExtensionFn)dlsym(this->library,
+                                            "XTestQueryExtension");
+  this->fakeKey =
+      (XTestFakeKeyEventFn)dlsym(this->library, "XTestFakeKeyEvent");
+  this->fakeButton =
+      (XTestFakeButtonEventFn)dlsym(this->library, "XTestFakeButtonEvent");
+  this->fakeMotion =
+      (XTestFakeMotionEventFn)dlsym(this->library, "XTestFakeMotionEvent");
+  if (!query || !this->fakeKey || !this->fakeButton || !this->fakeMotion)
+    return false;
+
+  this->display = XOpenDisplay(nullptr);
+  if (!this->display)
+    return false;
+  int eventBase, errorBase, major, minor;
+  if (!query(this->display, &eventBase, &errorBase, &major, &minor))
+    return false;
+  LoadKeymap();
+  return true;
+}
+
+void XTestSink::LoadKeymap() {
+  int minCode, maxCode, perCode;
+  XDisplayKeycodes(this->display, &minCode, &maxCode);
+  int count = maxCode - minCode + 1;
+  KeySym *map =
+      XGetKeyboardMapping(this->display, (KeyCode)minCode, count, &perCode);
+  if (!map)
+    return;
+  // Lower levels first: 'a' is typed with the key that has it unshifted
+  for (int level = 0; level < perCode; level++) {
+    for (int i = 0; i < count; i++) {
+      KeySym sym = map[i * perCode + level];
+      if (sym != NoSymbol)
+        this->keycodes.emplace((uint32_t)sym, (unsigned)(minCode + i));
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    bool empty = true;
+    for (int level = 0; level < perCode && empty; level++)
+      empty = map[i * perCode + level] == NoSymbol;
+    if (empty)
+      this->spare.push_back(minCode + i);
+  }
+  XFree(map);
+}
+
+unsigned XTestSink::Keycode(uint32_t keysym) {
+  // Unicode keysyms for Latin-1 are the Latin-1 keysyms in keymaps
+  uint32_t ucs = keysym > KEYSYM_UNICODE_OFFSET ? KeysymToUnicode(keysym) : 0;
+  if (ucs >= 0x20 && ucs <= 0xFF && (ucs <= 0x7E || ucs >= 0xA0))
+    keysym = ucs;
+  auto it = this->keycodes.find(keysym);
+  if (it != this->keycodes.end())
+    return it->second;
+  if (this->spare.empty())
+    return 0;
+
+  // Round-robin over the spare keycodes; the oldest binding goes
+  unsigned code = this->spare[this->nextSpare++ % this->spare.size()];
+  auto old = this->bound.find(code);
+  if (old != this->bound.end())
+    this->keycodes.erase(old->second);
+  KeySym syms[2] = {(KeySym)keysym, (KeySym)keysym};
+  XChangeKeyboardMapping(this->display, (int)code, 2, syms, 1);
+  XSync(this->display, False); // The mapping must be in before the key
+  this->bound[code] = keysym;
+  this->keycodes[keysym] = code;
+  return code;
+}
+
+void XTestSink::Deliver(const std::vector<InputEvent> &batch) {
+  for (const auto &e : batch) {
+    if (e.type == InputEvent::KEY) {
+      unsigned code = Keycode(e.keysym);
+      if (code != 0)
+        this->fakeKey(this->display, code, e.down, CurrentTime);
+      continue;
+    }
+    this->fakeMotion(this->display, -1, e.x, e.y, CurrentTime);
+    for (int b = 0; b < INPUT_BUTTONS; b++) {
+      uint8_t bit = 1 << b;
+      if ((e.buttons & bit) != (e.previousButtons & bit))
+        this->fakeButton(this->display, b + 1, (e.buttons & bit) != 0,
+                         CurrentTime);
+    }
+  }
+  XFlush(this->display);
+}
+
+std::unique_ptr<InputSink> CreateXTestSink() {
+  auto sink = std::make_unique<XTestSink>();
+  if (!sink->Initialize())
+    return nullptr;
+  return sink;
+}
@@ -1,5 +1,11 @@
 import { EventEmitter } from 'events';
-import { VncServerOptions, QualityOptions, ClientInfo } from './types';
+import {
+    VncServerOptions,
+    QualityOptions,
+    ClientInfo,
+    ServerStats,
+    RecordedInputEvent,
+} from './types';
 const addon = require('bindings')('vnc_server');
 
 export class VncServer extends EventEmitter {
@@ -45,7 +51,27 @@ export class VncServer extends EventEmitter {
         this._nativeServer.setQuality(options);
     }
 
+    /**
+     * Downscales what client `clientId` (ClientStats.id) receives to 1/2,
+     * 1/3 or 1/4 size; false if there is no such client.
+     */
+    setClientScale(clientId: number, scale: number): boolean {
+        return this._nativeServer.setClientScale(clientId, scale);
+    }
+
     getActiveClientsCount(): number {
         return this._nativeServer.getActiveClientsCount();
     }
+
+    getStats(): ServerStats {
+        return this._nativeServer.getStats();
+    }
+
+    /**
+     * Events the 'record' input sink has received since the last call, in
+     * injection order; empty with any other sink.
+     */
+    takeRecordedInput(): RecordedInputEvent[] {
+        return this._nativeServer.takeRecordedInput();
+    }
 }
@@ -5,21 +5,261 @@ export interface VncServerOptions {
      */
     port: number;
     password?: string;
+    /**
+     * H.264 (encoding 50) for clients that ask for it. Needs an addon built
+     * with VNC_WITH_OPENH264=1.
+     * 'motion' streams only the detected video/animation region,
+     * 'always' streams the whole screen. Default 'off'.
+     */
+    h264?: 'off' | 'motion' | 'always';
+    /**
+     * Threads used to encode compressed updates (shared by all clients).
+     * 0 or unset = one per CPU core.
+     */
+    encodeThreads?: number;
+    /**
+     * Areas sent as JPEG are resent losslessly once they have been static
+     * this long and the client is idle. 0 disables refinement. Default 400.
+     */
+    refineDelayMs?: number;
+    /**
+     * JPEG quality levels added for the area around a client's pointer and
+     * where it last typed; those tiles are also sent first. 0 keeps the
+     * quality of the rest of the screen. Default 3.
+     */
+    roiQualityBoost?: number;
+    /**
+     * Areas that change every frame (video players, animations) are sent as
+     * low-quality JPEG at most this many times per second, unless H.264
+     * covers them. 0 treats them like the rest of the screen. Default 15.
+     */
+    videoRegionFps?: number;
+    /**
+     * Trim reported damage to the pixels that really changed, whenever that
+     * saves more encoding than the comparison costs. Default true.
+     */
+    trimDamage?: boolean;
+    /**
+     * Memory for encoded tiles kept across frames, so content that comes
+     * back (window switches, repainted toolbars) is not encoded again.
+     * Shared by all clients; 0 disables it. Default 64.
+     */
+    tileCacheMB?: number;
+    /**
+     * Let clients change the display resolution (SetDesktopSize). Windows
+     * only; refused on Linux. Default false.
+     */
+    allowResize?: boolean;
+    /**
+     * Capture every monitor (DXGI outputs, X screens) side by side in one
+     * virtual framebuffer, or only the primary one. Default 'all'.
+     */
+    monitors?: 'all' | 'primary';
+    /**
+     * When a client asks for a smaller desktop (SetDesktopSize) and the
+     * resolution cannot change, downscale the screen to fit it instead of
+     * refusing. Default false.
+     */
+    scaleToFit?: boolean;
+    /**
+     * Where client input goes: 'auto' picks SendInput on Windows and XTest,
+     * then uinput, on Linux. 'record' keeps events for takeRecordedInput()
+     * (tests, benchmarks); 'none' ignores them. Default 'auto'.
+     */
+    inputSink?: 'auto' | 'sendinput' | 'xtest' | 'uinput' | 'record' | 'none';
 }
 
 
 export interface QualityOptions {
     /**
-     * JPEG (0-100) for TIGHT
+     * What the per-client controller protects when the link or CPU can't
+     * keep up: 'latency' drops JPEG quality before frame rate, 'quality'
+     * drops frame rate first. Default 'quality'.
+     */
+    mode?: 'latency' | 'quality';
+    /**
+     * JPEG (0-100) for TIGHT: upper bound
      */
     jpegQuality?: number;
     /**
-     * Compress level (0-9) for zlib
+     * JPEG (0-100) lower bound
+     */
+    minJpegQuality?: number;
+    /**
+     * Compress level (0-9) for zlib: upper bound
      */
     zlibLevel?: number;
+    /**
+     * Compress level (0-9) lower bound
+     */
+    minZlibLevel?: number;
+    /**
+     * Update rate bounds per client. maxFps also caps the capture rate.
+     * Defaults 5 and 30.
+     */
+    minFps?: number;
+    maxFps?: number;
+    /**
+     * Latency budget per update in ms. Default 80 in 'latency' mode,
+     * 250 in 'quality' mode.
+     */
+    latencyMs?: number;
 }
 
 export interface ClientInfo {
     id: string;
     address: string;
 }
+
+/** An input event as the 'record' sink received it */
+export interface RecordedInputEvent {
+    type: 'key' | 'pointer';
+    client: number;
+    /** key: X keysym */
+    keysym?: number;
+    down?: boolean;
+    /** pointer: framebuffer position and RFB button mask */
+    x?: number;
+    y?: number;
+    buttons?: number;
+}
+
+export interface TileClassStats {
+    tiles: number;
+    bytes: number;
+}
+
+export interface TileSample {
+    x: number;
+    y: number;
+    w: number;
+    h: number;
+    class: 'solid' | 'lossless' | 'lossy';
+    /** Distinct colors in a sample (capped at 128) */
+    colors: number;
+    /** Share of neighbour pixel pairs with a hard step */
+    edgeRatio: number;
+    /** Share of neighbour pixel pairs with a small non-zero step */
+    smoothRatio: number;
+    /** Frames (out of the last 16) the tile was damaged in */
+    changes: number;
+    bytes: number;
+}
+
+/**
+ * Current choices of a client's quality controller
+ */
+export interface ClientStats {
+    id: number;
+    /** Tight quality level in use, -1 = lossless only */
+    qualityLevel: number;
+    compressLevel: number;
+    fps: number;
+    /** Smoothed encode + send + turnaround per update */
+    latencyMs: number;
+    rttMs: number;
+    bandwidthKbps: number;
+    /** Client enabled ContinuousUpdates: no request per update */
+    continuousUpdates: boolean;
+    /** Sent but not yet acknowledged by a fence (continuous mode) */
+    inFlightKB: number;
+    /** Server-side downscale in effect: 1, 0.5, 0.33 or 0.25 */
+    scale: number;
+    /** Damage held back from the last update to fit the link, sent next */
+    deferredRects: number;
+    /** Encode time of the last update */
+    encodeMs: number;
+    /** Written by the client thread, not yet by its sender thread */
+    sendQueueKB: number;
+    /** Smoothed time from queueing a message to it being written */
+    sendMs: number;
+}
+
+/** One stage of the capture pipeline */
+export interface PipelineStageStats {
+    frames: number;
+    /** Smoothed work per frame */
+    busyMs: number;
+    /** Smoothed time from the grab's start until the stage was done */
+    latencyMs: number;
+}
+
+/**
+ * Debug counters, mainly for tuning encoder thresholds.
+ */
+export interface ServerStats {
+    /** Captured monitors, in framebuffer coordinates */
+    screens: { x: number; y: number; width: number; height: number }[];
+    /** Areas currently treated as video, in framebuffer coordinates */
+    videoRegions: { x: number; y: number; width: number; height: number }[];
+    encodeCache: {
+        hits: number;
+        misses: number;
+    };
+    /** Encoded tiles reused across frames (tileCacheMB) */
+    tileCache: {
+        hits: number;
+        misses: number;
+        /** hits / (hits + misses), 0 before the first lookup */
+        hitRate: number;
+        entries: number;
+        bytes: number;
+        budgetBytes: number;
+    };
+    /** Whole-screen updates served from / rebuilt for the keyframe cache */
+    keyframes: {
+        hits: number;
+        misses: number;
+    };
+    /** Frames grabbed, and the smoothed wait from a client wanting one */
+    capture: {
+        frames: number;
+        delayMs: number;
+    };
+    /** Grabbing (capture) runs ahead of damage checks and hashing (process) */
+    pipeline: {
+        /** Grabbed frames waiting for the process stage */
+        queued: number;
+        capture: PipelineStageStats;
+        process: PipelineStageStats;
+        /** Client updates encoded, on the client threads */
+        encode: PipelineStageStats;
+    };
+    /** Client input on its way to the injection thread, since start */
+    input: {
+        /** Waiting in the queue */
+        queued: number;
+        /** Key and pointer events received */
+        events: number;
+        /** Left after collapsing pointer moves */
+        injected: number;
+        /** Injection calls */
+        batches: number;
+        /** Lost to a full queue */
+        dropped: number;
+        /** Backend in use: 'sendinput', 'xtest', 'uinput', 'record', 'none' */
+        sink: string;
+    };
+    /** Reported vs. really changed damage since start */
+    damage: {
+        reportedPixels: number;
+        changedPixels: number;
+        /** Reported rects with no changed pixel at all */
+        unchangedRects: number;
+        /** Frames checked with exact trimming / whole-rect compares only */
+        trimmedFrames: number;
+        skippedFrames: number;
+        /** (reportedPixels - changedPixels) as raw 32-bit pixels */
+        savedBytes: number;
+        /** Frames without damage metadata, diffed by 64x64 tile hashes */
+        hashedFrames: number;
+    };
+    classifier: {
+        solid: TileClassStats;
+        lossless: TileClassStats;
+        lossy: TileClassStats;
+        /** Last 64 classified tiles, oldest first */
+        recent: TileSample[];
+    };
+    clients: ClientStats[];
+}
@@ -0,0 +1,127 @@
+// Input through the 'record' sink: what clients send arrives in order,
+// pointer moves are collapsed, and no button or wheel transition is lost.
+const test = require('node:test');
+const assert = require('node:assert');
+const { VncServer } = require('bindings')('vnc_server');
+const { RfbClient } = require('./rfb_client');
+
+const PORT = 5990;
+
+// Collects recorded events until `done(events)` holds
+async function record(server, done, timeoutMs = 3000) {
+    const events = [];
+    const deadline = Date.now() + timeoutMs;
+    while (!done(events)) {
+        if (Date.now() > deadline)
+            assert.fail(`timed out with ${events.length} events recorded`);
+        await new Promise((resolve) => setTimeout(resolve, 20));
+        events.push(...server.takeRecordedInput());
+    }
+    return events;
+}
+
+// Events whose button mask differs from the one before: presses, releases
+// and wheel steps
+function transitions(events) {
+    let buttons = 0;
+    return events.filter((e) => {
+        const changed = e.buttons !== buttons;
+        buttons = e.buttons;
+        return changed;
+    }).map((e) => ({ x: e.x, y: e.y, buttons: e.buttons }));
+}
+
+test('record sink', async (t) => {
+    const server = new VncServer({ port: PORT, inputSink: 'record' });
+    server.start();
+    await new Promise((resolve) => setTimeout(resolve, 200));
+    t.after(() => server.stop());
+    assert.strictEqual(server.getStats().input.sink, 'record');
+
+    await t.test('collapses pointer moves and keeps the last one', async () => {
+        const client = await RfbClient.connect(PORT);
+        const moves = [];
+        for (let i = 0; i < 500; i++)
+            moves.push(RfbClient.pointerEvent(i, 100, 0));
+        client.send(moves);
+
+        const events = await record(server, (e) => e.some((m) => m.x === 499));
+        client.close();
+        assert.ok(events.every((e) => e.type === 'pointer' && e.y === 100));
+        assert.ok(events.length < moves.length,
+            `${events.length} of ${moves.length} moves injected`);
+        for (let i = 1; i < events.length; i++)
+            assert.ok(events[i].x > events[i - 1].x, 'moves out of order');
+        assert.strictEqual(events[events.length - 1].x, 499);
+    });
+
+    await t.test('keeps every button and wheel transition', async () => {
+        const client = await RfbClient.connect(PORT);
+        const sent = [];
+        const pointer = (x, y, buttons) => sent.push({ x, y, buttons });
+        pointer(10, 10, 0);
+        pointer(10, 10, 1); // Left press, drag, release
+        for (let x = 11; x <= 60; x++)
+            pointer(x, 20, 1);
+        pointer(60, 20, 0);
+        for (const wheel of [8, 16, 32, 64]) { // Up, down, left, right
+            pointer(60, 20, wheel);
+            pointer(60, 20, 0);
+        }
+        for (let x = 61; x <= 80; x++) // Right drag
+            pointer(x, 30, 4);
+        pointer(80, 30, 0);
+        client.send(sent.map((p) => RfbClient.pointerEvent(p.x, p.y, p.buttons)));
+
+        const expected = transitions(sent);
+        const events = await record(server,
+            (e) => transitions(e).length >= expected.length);
+        client.close();
+        assert.deepStrictEqual(transitions(events), expected);
+        assert.ok(events.length < sent.length,
+            `${events.length} of ${sent.length} events injected`);
+    });
+
+    await t.test('keeps the order of events across clients', async () => {
+        const a = await RfbClient.connect(PORT);
+        const b = await RfbClient.connect(PORT);
+
+        // One at a time: the recorded order is the order sent
+        const steps = [
+            [a, 0x61, true], [b, 0x62, true], [a, 0x61, false],
+            [b, 0x63, true], [b, 0x62, false], [a, 0x64, true],
+        ];
+        const events = [];
+        for (const [client, keysym, down] of steps) {
+            client.key(keysym, down);
+            events.push(...await record(server, (e) => e.length === 1));
+        }
+        assert.deepStrictEqual(events.map((e) => [e.keysym, e.down]),
+            steps.map(([, keysym, down]) => [keysym, down]));
+        const clientA = events[0].client;
+        const clientB = events[1].client;
+        assert.notStrictEqual(clientA, clientB);
+        assert.deepStrictEqual(events.map((e) => e.client),
+            steps.map(([client]) => (client === a ? clientA : clientB)));
+
+        // Both at once: keys are never collapsed, and each client's stay
+        // in its own order
+        const burst = (client, base) => {
+            const keys = [];
+            for (let i = 0; i < 200; i++)
+                keys.push(RfbClient.keyEvent(base + (i >> 1), i % 2 === 0));
+            client.send(keys);
+        };
+        burst(a, 0x1000);
+        burst(b, 0x2000);
+        const mixed = await record(server, (e) => e.length >= 400);
+        a.close();
+        b.close();
+        assert.strictEqual(mixed.length, 400);
+        for (const [id, base] of [[clientA, 0x1000], [clientB, 0x2000]]) {
+            const own = mixed.filter((e) => e.client === id);
+            assert.deepStrictEqual(own.map((e) => [e.keysym, e.down]),
+                Array.from({ length: 200 }, (_, i) => [base + (i >> 1), i % 2 === 0]));
+        }
+    });
+});
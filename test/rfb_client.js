@@ -0,0 +1,275 @@
+// Minimal RFB client for the tests and benchmarks: the handshake this
+// server speaks, input messages, and FramebufferUpdates with Raw pixels.
+// TightPNG rects are stepped over, not decoded.
+const net = require('net');
+const { EventEmitter } = require('events');
+
+const ENCODING_RAW = 0;
+const ENCODING_TIGHT_PNG = -260;
+const ENCODING_QUALITY_LEVEL_0 = -32;
+const ENCODING_COMPRESS_LEVEL_0 = -256;
+const ENCODING_LAST_RECT = -224;
+const ENCODING_POINTER_POS = -232;
+const ENCODING_DESKTOP_SIZE = -223;
+const ENCODING_EXTENDED_DESKTOP_SIZE = -308;
+const ENCODING_FENCE = -312;
+const ENCODING_CONTINUOUS_UPDATES = -313;
+
+const FENCE_REQUEST = 0x80000000;
+
+class RfbClient extends EventEmitter {
+    constructor(socket) {
+        super();
+        this.socket = socket;
+        this.buffer = Buffer.alloc(0);
+        this.stage = 'http';
+        this.width = 0;
+        this.height = 0;
+        this.framebuffer = Buffer.alloc(0); // 32-bit pixels, as sent
+        this.updates = 0;
+        this.fences = 0; // Fence requests answered
+        socket.setNoDelay(true);
+        socket.on('data', (data) => {
+            this.buffer = Buffer.concat([this.buffer, data]);
+            this._parse();
+        });
+        socket.on('error', (error) => this.emit('error', error));
+        socket.on('close', () => this.emit('close'));
+    }
+
+    /** Connects and resolves once ServerInit has arrived */
+    static connect(port, host = '127.0.0.1') {
+        return new Promise((resolve, reject) => {
+            const socket = net.connect(port, host);
+            const client = new RfbClient(socket);
+            socket.once('error', reject);
+            socket.on('connect', () => {
+                // The server expects a WebSocket upgrade first
+                socket.write('GET / HTTP/1.1\r\nSec-WebSocket-Key: test\r\n\r\n');
+            });
+            client.once('ready', () => {
+                socket.removeListener('error', reject);
+                resolve(client);
+            });
+        });
+    }
+
+    setEncodings(encodings) {
+        const msg = Buffer.alloc(4 + 4 * encodings.length);
+        msg[0] = 2;
+        msg.writeUInt16BE(encodings.length, 2);
+        encodings.forEach((e, i) => msg.writeInt32BE(e, 4 + 4 * i));
+        this.socket.write(msg);
+    }
+
+    requestUpdate(incremental) {
+        const msg = Buffer.alloc(10);
+        msg[0] = 3;
+        msg[1] = incremental ? 1 : 0;
+        msg.writeUInt16BE(this.width, 6);
+        msg.writeUInt16BE(this.height, 8);
+        this.socket.write(msg);
+    }
+
+    enableContinuousUpdates(enable, x = 0, y = 0, w = this.width, h = this.height) {
+        const msg = Buffer.alloc(10);
+        msg[0] = 150;
+        msg[1] = enable ? 1 : 0;
+        msg.writeUInt16BE(x, 2);
+        msg.writeUInt16BE(y, 4);
+        msg.writeUInt16BE(w, 6);
+        msg.writeUInt16BE(h, 8);
+        this.socket.write(msg);
+    }
+
+    /** Builds a PointerEvent; pass several to send() to have them read in one go */
+    static pointerEvent(x, y, buttons) {
+        const msg = Buffer.alloc(6);
+        msg[0] = 5;
+        msg[1] = buttons;
+        msg.writeUInt16BE(x, 2);
+        msg.writeUInt16BE(y, 4);
+        return msg;
+    }
+
+    static keyEvent(keysym, down) {
+        const msg = Buffer.alloc(8);
+        msg[0] = 4;
+        msg[1] = down ? 1 : 0;
+        msg.writeUInt32BE(keysym, 4);
+        return msg;
+    }
+
+    send(messages) {
+        this.socket.write(Array.isArray(messages) ? Buffer.concat(messages) : messages);
+    }
+
+    pointer(x, y, buttons) {
+        this.send(RfbClient.pointerEvent(x, y, buttons));
+    }
+
+    key(keysym, down) {
+        this.send(RfbClient.keyEvent(keysym, down));
+    }
+
+    close() {
+        this.socket.destroy();
+    }
+
+    _take(n) {
+        const bytes = this.buffer.subarray(0, n);
+        this.buffer = this.buffer.subarray(n);
+        return bytes;
+    }
+
+    _resize(w, h) {
+        this.width = w;
+        this.height = h;
+        this.framebuffer = Buffer.alloc(w * h * 4);
+    }
+
+    _parse() {
+        for (;;) {
+            const buf = this.buffer;
+            if (this.stage === 'http') {
+                const end = buf.indexOf('\r\n\r\n');
+                if (end < 0) return;
+                this._take(end + 4);
+                this.stage = 'version';
+            } else if (this.stage === 'version') {
+                if (buf.length < 12) return;
+                this._take(12);
+                this.socket.write('RFB 003.008\n');
+                this.stage = 'security';
+            } else if (this.stage === 'security') {
+                if (buf.length < 2) return;
+                this._take(2);
+                this.socket.write(Buffer.from([1])); // None
+                this.stage = 'init';
+            } else if (this.stage === 'init') {
+                if (buf.length < 24) return;
+                const nameLength = buf.readUInt32BE(20);
+                if (buf.length < 24 + nameLength) return;
+                this._resize(buf.readUInt16BE(0), buf.readUInt16BE(2));
+                this._take(24 + nameLength);
+                this.stage = 'messages';
+                this.emit('ready');
+            } else if (!this._message()) {
+                return;
+            }
+        }
+    }
+
+    // One server message if it is complete
+    _message() {
+        const buf = this.buffer;
+        if (buf.length < 1) return false;
+        switch (buf[0]) {
+            case 0:
+                return this._update();
+            case 150: // EndOfContinuousUpdates
+                this._take(1);
+                this.emit('end-of-continuous-updates');
+                return true;
+            case 248: { // Fence: [padding:3][flags:4][length][payload]
+                if (buf.length < 9 || buf.length < 9 + buf[8]) return false;
+                const fence = Buffer.from(this._take(9 + buf[8]));
+                const flags = fence.readUInt32BE(4);
+                if (flags & FENCE_REQUEST) {
+                    // Everything before it has been handled: answer at once
+                    fence.writeUInt32BE((flags & ~FENCE_REQUEST) >>> 0, 4);
+                    this.socket.write(fence);
+                    this.fences++;
+                }
+                return true;
+            }
+            default:
+                this.emit('error', new Error(`unexpected message ${buf[0]}`));
+                this.close();
+                return false;
+        }
+    }
+
+    // A FramebufferUpdate once all of it has arrived
+    _update() {
+        const buf = this.buffer;
+        if (buf.length < 4) return false;
+        const count = buf.readUInt16BE(2);
+        const rects = [];
+        let offset = 4;
+        let size = null;
+        for (let i = 0; i < count; i++) {
+            if (buf.length < offset + 12) return false;
+            const rect = {
+                x: buf.readUInt16BE(offset),
+                y: buf.readUInt16BE(offset + 2),
+                w: buf.readUInt16BE(offset + 4),
+                h: buf.readUInt16BE(offset + 6),
+                encoding: buf.readInt32BE(offset + 8),
+            };
+            offset += 12;
+            if (rect.encoding === ENCODING_LAST_RECT) break;
+            if (rect.encoding === ENCODING_RAW) {
+                const bytes = rect.w * rect.h * 4;
+                if (buf.length < offset + bytes) return false;
+                rect.offset = offset;
+                offset += bytes;
+            } else if (rect.encoding === ENCODING_TIGHT_PNG) {
+                // [control] then a fill colour, or a compact length and data
+                if (buf.length < offset + 1) return false;
+                const control = buf[offset++];
+                let bytes = 3;
+                if (control !== 0x80) {
+                    bytes = 0;
+                    for (let k = 0; k < 3; k++) {
+                        if (buf.length < offset + 1) return false;
+                        const b = buf[offset++];
+                        bytes |= (k < 2 ? b & 0x7F : b) << (7 * k);
+                        if (k === 2 || !(b & 0x80)) break;
+                    }
+                }
+                offset += bytes;
+                if (buf.length < offset) return false;
+            } else if (rect.encoding === ENCODING_EXTENDED_DESKTOP_SIZE) {
+                if (buf.length < offset + 4) return false;
+                offset += 4 + 16 * buf[offset];
+                if (buf.length < offset) return false;
+                size = rect;
+            } else if (rect.encoding === ENCODING_DESKTOP_SIZE) {
+                size = rect;
+            } else if (rect.encoding !== ENCODING_POINTER_POS) {
+                this.emit('error', new Error(`unexpected encoding ${rect.encoding}`));
+                this.close();
+                return false;
+            }
+            rects.push(rect);
+        }
+
+        if (size) this._resize(size.w, size.h);
+        for (const r of rects) {
+            if (r.encoding !== ENCODING_RAW) continue;
+            for (let row = 0; row < r.h; row++) {
+                const from = r.offset + row * r.w * 4;
+                buf.copy(this.framebuffer, ((r.y + row) * this.width + r.x) * 4,
+                    from, from + r.w * 4);
+            }
+        }
+        this._take(offset);
+        this.updates++;
+        this.emit('update', rects);
+        return true;
+    }
+}
+
+module.exports = {
+    RfbClient,
+    ENCODING_RAW,
+    ENCODING_TIGHT_PNG,
+    ENCODING_QUALITY_LEVEL_0,
+    ENCODING_COMPRESS_LEVEL_0,
+    ENCODING_LAST_RECT,
+    ENCODING_DESKTOP_SIZE,
+    ENCODING_EXTENDED_DESKTOP_SIZE,
+    ENCODING_FENCE,
+    ENCODING_CONTINUOUS_UPDATES,
+};